@@ -0,0 +1,195 @@
+/*!
+* \file memory_mapped_blob_file.hpp
+* \date 2026/10/18 12:25
+*
+* \author Ján Dugáček
+*
+* \brief Class for accessing an array of byte sequences of variable length stored in files
+*
+* The byte sequences are stored one after another in one file (the heap) and another file holds the offsets where each of them ends, so that any
+* of them can be found without reading the previous ones. Both files are accessed through the same archivers as in MemoryMappedFile.
+*
+* \note RAII guarantees flushing the changes into files
+*/
+
+#ifndef MEMORY_MAPPED_BLOB_FILE_H
+#define MEMORY_MAPPED_BLOB_FILE_H
+
+#include <span>
+#include <stdexcept>
+#include "memory_mapped_file.hpp"
+
+template<typename...>
+class MemoryMappedBlobFile;
+
+template<>
+class MemoryMappedBlobFile<> {
+	MemoryMappedFile<std::int32_t> offsets_;
+	std::unique_ptr<MemoryMappedFileBase> heap_;
+	mutable int heapSize_;
+
+	int heapSize() const
+	{
+		if (heapSize_ < 0) {
+			const int records = offsets_.size();
+			heapSize_ = records ? offsets_[records - 1] : 0;
+		}
+		return heapSize_;
+	}
+
+protected:
+
+	/*!
+	* \brief Constructor, use a derived class' constructor to specify the way the data is stored
+	*/
+	MemoryMappedBlobFile(MemoryMappedFile<std::int32_t> offsets, std::unique_ptr<MemoryMappedFileBase> heap) :
+		offsets_(std::move(offsets)), heap_(std::move(heap)), heapSize_(-1) {}
+
+public:
+
+	/*!
+	* \brief Move constructor
+	*/
+	MemoryMappedBlobFile(MemoryMappedBlobFile<>&& other) = default;
+
+	/*!
+	* \brief Move assignment
+	*/
+	MemoryMappedBlobFile<>& operator=(MemoryMappedBlobFile<>&& other) = default;
+
+	/*!
+	* \brief Returns the file name without extension and suffixes of the two files
+	*
+	* \return The name of the file
+	*/
+	std::string fileName() const
+	{
+		const std::string &heapName = heap_->fileName();
+		return heapName.substr(0, heapName.size() - heapSuffix().size());
+	}
+
+	/*!
+	* \brief Saves the contents if they were modified into the files they were loaded from
+	*/
+	void flush() const
+	{
+		heap_->flush();
+		offsets_.flush();
+	}
+
+	/*!
+	* \brief Access to a record, modification not possible
+	*
+	* \param Index of the record
+	* \return The bytes of the record, valid until the file is modified
+	*/
+	std::span<const std::uint8_t> operator[](int at) const
+	{
+		if (at < 0 || at >= offsets_.size())
+			throw(std::logic_error("Reading behind the end of an archive"));
+		const int begin = at ? offsets_[at - 1] : 0;
+		const int end = offsets_[at];
+		if (end == begin)
+			return {};
+		const MemoryMappedFileBase &heap = *heap_;
+		if (!heap.canReadAt(end - 1))
+			throw(std::runtime_error("Record " + std::to_string(at) + " is behind the end of " + heap.extendedFileName(heap.fileName())));
+		return { &heap[begin], static_cast<std::size_t>(end - begin) };
+	}
+
+	/*!
+	* \brief Appends a record at the end of the file
+	*
+	* \param The bytes of the record
+	*/
+	void push_back(std::span<const std::uint8_t> added)
+	{
+		const int end = heapSize() + int(added.size());
+		heap_->append(added.data(), int(added.size()));
+		offsets_.push_back(end);
+		heapSize_ = end;
+	}
+
+	/*!
+	* \brief Clears the contents
+	*/
+	void clear()
+	{
+		heap_->clear();
+		offsets_.clear();
+		heapSize_ = 0;
+	}
+
+	/*!
+	* \brief Gets the number of records
+	*
+	* \return The number of records
+	*/
+	int size() const
+	{
+		return offsets_.size();
+	}
+
+	/*!
+	* \brief Gets the total size of all records
+	*
+	* \return Size of the heap in bytes
+	*/
+	int dataSize() const
+	{
+		return heapSize();
+	}
+
+	/*!
+	* \brief Returns the suffix appended to the file name to get the name of the file with offsets
+	*
+	* \return The suffix
+	*/
+	static const std::string &offsetsSuffix()
+	{
+		static std::string retval = "_offsets";
+		return retval;
+	}
+
+	/*!
+	* \brief Returns the suffix appended to the file name to get the name of the file with the contents of the records
+	*
+	* \return The suffix
+	*/
+	static const std::string &heapSuffix()
+	{
+		static std::string retval = "_heap";
+		return retval;
+	}
+
+	/*!
+	* \brief Destructor
+	*/
+	virtual ~MemoryMappedBlobFile() = default;
+};
+
+template<typename archiverType>
+class MemoryMappedBlobFile<archiverType> : public MemoryMappedBlobFile<> {
+public:
+
+	/*!
+	* \brief Constructor, specify the template argument to set the way the data is stored
+	*
+	* \param The name of the file, suffixes are appended to it to get the names of the files with the offsets and the contents
+	*/
+	MemoryMappedBlobFile(const std::string &fileName) :
+		MemoryMappedBlobFile<>(MemoryMappedFile<std::int32_t, archiverType>(fileName + offsetsSuffix()),
+				std::make_unique<archiverType>(fileName + heapSuffix())) {}
+
+	/*!
+	* \brief Move constructor
+	*/
+	MemoryMappedBlobFile(MemoryMappedBlobFile<archiverType>&& other) = default;
+
+	/*!
+	* \brief Move assignment
+	*/
+	MemoryMappedBlobFile<archiverType>& operator=(MemoryMappedBlobFile<archiverType>&& other) = default;
+};
+
+#endif //MEMORY_MAPPED_BLOB_FILE_H
@@ -16,21 +16,25 @@
 #ifndef MEMORY_MAPPED_FILE_H
 #define MEMORY_MAPPED_FILE_H
 
+#include <chrono>
+#include <climits>
+#include <span>
 #include "memory_mapped_file_base.hpp"
+#include "memory_mapped_file_async.hpp"
+#include "memory_mapped_file_snapshot.hpp"
 
 template<typename...>
 class MemoryMappedFile;
 
 template<typename T>
 class MemoryMappedFile<T> {
-	std::unique_ptr<MemoryMappedFileBase> archiver_;
-
 	union Converter {
 		std::uint8_t byte[sizeof(T)];
 		T contents;
 	};
 
 protected:
+	std::unique_ptr<MemoryMappedFileBase> archiver_;
 
 	/*!
 	* \brief Constructor, use a derived class' constructor to specify the way the data is stored
@@ -87,6 +91,8 @@ public:
 	{
 		if (!archiver_->canReadAt(at * (sizeof(T)) + 1))
 			throw(std::logic_error("Reading behind the end of an archive"));
+		if constexpr (((1 << MemoryMappedFileBase::PAGE_BITS) % sizeof(T)) != 0)
+			(*archiver_)[at * sizeof(T) + sizeof(T) - 1]; // The record may reach into the next page, which must be marked as modified too
 		return reinterpret_cast<T &>((*archiver_)[at * sizeof(T)]);
 	}
 
@@ -103,6 +109,103 @@ public:
 		return reinterpret_cast<const T &>(const_cast<const MemoryMappedFileBase &>(*archiver_)[at * sizeof(T)]);
 	}
 
+	/*!
+	* \brief Copies records, without loading the records before them if the way the file is stored allows it
+	*
+	* \param Index of the first record
+	* \param Number of records
+	* \param Where to copy them
+	*/
+	void read(int from, int count, T* into) const
+	{
+		archiver_->read(int(from * sizeof(T)), int(count * sizeof(T)), reinterpret_cast<std::uint8_t*>(into));
+	}
+
+	/*!
+	* \brief Writes records into a file descriptor, like a socket or a pipe, without copying them into memory if the archiver allows it
+	*
+	* \param The descriptor, it must be blocking
+	* \param Index of the first record
+	* \param Number of records
+	*/
+	void sendRange(int descriptor, int begin, int count) const
+	{
+		archiver_->send(descriptor, int(begin * sizeof(T)), int(count * sizeof(T)));
+	}
+
+	/*!
+	* \brief Makes read() safe to call from multiple threads at once, until the file is modified or loaded again
+	*/
+	void prepareConcurrentReading() const
+	{
+		archiver_->prepareConcurrentReading();
+	}
+
+	/*!
+	* \brief Starts loading records that will be needed soon in the background
+	*
+	* \param Index of the first record
+	* \param Number of records
+	*/
+	void prefetch(int begin, int count) const
+	{
+		archiver_->prefetch(int(begin * sizeof(T)), int(count * sizeof(T)));
+	}
+
+	/*!
+	* \brief Announces that the records will be read in order, so that they are loaded in larger parts
+	*/
+	void adviseSequential() const
+	{
+		archiver_->adviseSequential();
+	}
+
+	/*!
+	* \brief Announces that the records will be read in random order
+	*/
+	void adviseRandom() const
+	{
+		archiver_->adviseRandom();
+	}
+
+	/*!
+	* \brief Announces that records won't be needed anymore, so that the system can release its caches of them
+	*
+	* \param Index of the first record
+	* \param Number of records
+	*/
+	void dropCache(int begin, int count) const
+	{
+		archiver_->dropCache(int(begin * sizeof(T)), int(count * sizeof(T)));
+	}
+
+	/*!
+	* \brief Loads records in a coroutine, without blocking the thread
+	*
+	* \param Index of the first record
+	* \param Number of records
+	* \return Awaitable that results in the records, completes immediately if they are loaded
+	*/
+	MemoryMappedFileReading<T> readAsync(int at, int count) const
+	{
+		return MemoryMappedFileReading<T>(archiver_.get(), at, count);
+	}
+
+	/*!
+	* \brief Loads the file up to the given record in a coroutine, without blocking the thread
+	*
+	* \param How many records have to be loaded, negative number means load all
+	* \return Awaitable that completes when they're loaded
+	*/
+	MemoryMappedFileLoading loadAsync(int until = -1) const
+	{
+		if (until < 0)
+			return archiver_->loadAsync();
+		// The archiver is given the index of the last byte, like when a record is accessed
+		const std::size_t end = std::max<std::size_t>(std::size_t(until) * sizeof(T), 1);
+		return archiver_->loadAsync(end <= std::size_t(INT_MAX) ? int(end) - 1 : -1);
+	}
+
 	/*!
 	* \brief Appends data at the end of the file
 	*
@@ -115,6 +218,17 @@ public:
 		archiver_->append(reinterpret_cast<const std::uint8_t*>(&added), sizeof(T));
 	}
 
+	/*!
+	* \brief Appends many records at the end of the file
+	*
+	* \param Pointer to the first record
+	* \param Number of records
+	*/
+	void append(const T* added, int count)
+	{
+		archiver_->append(reinterpret_cast<const std::uint8_t*>(added), int(count * sizeof(T)));
+	}
+
 	/*!
 	* \brief Clears the contents
 	*/
@@ -143,6 +257,62 @@ public:
 		return archiver_->size() / sizeof(T);
 	}
 
+	/*!
+	* \brief Waits until more records are written into the file by another process
+	*
+	* \param The number of records known to the caller
+	* \param Maximal time to wait in milliseconds, negative number means forever
+	* \return Whether there are more records
+	*/
+	bool waitForSize(int known, int timeout = -1) const
+	{
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+		while (size() <= known) {
+			int left = -1;
+			if (timeout >= 0) {
+				left = int(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count());
+				if (left < 0) return false;
+			}
+			archiver_->waitForChanges(left);
+		}
+		return true;
+	}
+
+	/*!
+	* \brief Access to the records that were already written
+	*
+	* \param Index of the first record
+	* \return The records from the given one to the last one
+	*/
+	std::span<const T> records(int from = 0) const
+	{
+		const int available = size();
+		if (from > available)
+			throw(std::logic_error("Reading behind the end of an archive"));
+		return { data() + from, static_cast<std::size_t>(available - from) };
+	}
+
+	/*!
+	* \brief Takes a read-only view of the records as they are now, it can be read from other threads while this file is modified
+	*
+	* \return The snapshot
+	* \note Pages are copied only when this file modifies them while the snapshot exists
+	*/
+	MemoryMappedFileSnapshot<T> snapshot() const
+	{
+		return MemoryMappedFileSnapshot<T>(archiver_->snapshot());
+	}
+
+	/*!
+	* \brief Returns what the file has done so far
+	*
+	* \return Values of the counters
+	*/
+	MemoryMappedFileStatisticsSnapshot statistics() const
+	{
+		return archiver_->statistics();
+	}
+
 	/*!
 	* \brief Swaps loaded contents with another file
 	*
@@ -175,14 +345,39 @@ public:
 
 template<typename T, typename archiverType>
 class MemoryMappedFile<T, archiverType> : public MemoryMappedFile<T> {
+
+	archiverType &archiver() const
+	{
+		return static_cast<archiverType &>(*this->archiver_);
+	}
+
+	/*!
+	* \brief Loads the file up to the end of a record, separated from the accessors so that they can be inlined
+	*
+	* \param Index of the byte behind the record
+	*/
+	void loadRecord(std::size_t end) const
+	{
+		const archiverType &archiver = this->archiver();
+		if (end <= std::size_t(INT_MAX)) {
+			archiver.statistics_.add(MemoryMappedFileCounter::LAZY_LOADS);
+			archiver.load(int(end) - 1);
+		}
+		if (end > archiver.data_.size())
+			throw(std::logic_error("Reading behind the end of an archive"));
+	}
+
 public:
 
 	/*!
 	* \brief Constructor, specify the second argument to set the way the data is stored
 	*
 	* \param The name of the file
+	* \param Additional arguments of the archiver's constructor, like the memory resource
 	*/
-	MemoryMappedFile(const std::string &fileName) : MemoryMappedFile<T>(std::make_unique<archiverType>(fileName)) {}
+	template<typename... Args>
+	MemoryMappedFile(const std::string &fileName, Args&&... args) :
+		MemoryMappedFile<T>(std::make_unique<archiverType>(fileName, std::forward<Args>(args)...)) {}
 
 	/*!
 	* \brief Move constructor
@@ -193,7 +388,113 @@ public:
 	* \brief Move assignment
 	*/
 	MemoryMappedFile<T, archiverType>& operator=(MemoryMappedFile<T, archiverType>&& other) = default;
-};
 
+	/*!
+	* \brief Record access, allows modification, calls the archiver directly rather than through virtual functions
+	*
+	* \param Index of the record
+	* \return Reference to the record
+	* \note If the file is already loaded, it's only a check of the size and marking of the page as modified
+	*/
+	T &operator[](int at)
+	{
+		archiverType &archiver = this->archiver();
+		if (!archiver.fullyLoaded())
+			archiver.load();
+		const std::size_t end = (std::size_t(static_cast<unsigned int>(at)) + 1) * sizeof(T);
+		if (end > archiver.data_.size())
+			throw(std::logic_error("Reading behind the end of an archive"));
+		archiver.modified_ = true;
+		archiver.markDirty(int(end - sizeof(T)));
+		if constexpr (((1 << MemoryMappedFileBase::PAGE_BITS) % sizeof(T)) != 0)
+			archiver.markDirty(int(end - 1)); // The record may reach into the next page
+		return reinterpret_cast<T &>(archiver.data_[end - sizeof(T)]);
+	}
+
+	/*!
+	* \brief Record access, modification not possible, calls the archiver directly rather than through virtual functions
+	*
+	* \param Index of the record
+	* \return Const reference to the record
+	* \note If the record is already loaded, it's only a check of the size
+	*/
+	const T &operator[](int at) const
+	{
+		const archiverType &archiver = this->archiver();
+		const std::size_t end = (std::size_t(static_cast<unsigned int>(at)) + 1) * sizeof(T);
+		if (end > archiver.data_.size())
+			loadRecord(end);
+		return reinterpret_cast<const T &>(archiver.data_[end - sizeof(T)]);
+	}
+
+	/*!
+	* \brief Access to constant data
+	*
+	* \return Const reference to array containing the data
+	*/
+	const T *data() const
+	{
+		archiverType &archiver = this->archiver();
+		if (!archiver.fullyLoaded())
+			archiver.load();
+		return reinterpret_cast<const T*>(archiver.data_.data());
+	}
+
+	/*!
+	* \brief Gets size of the data
+	*
+	* \return Size of the data
+	*/
+	int size() const
+	{
+		return archiver().size() / sizeof(T);
+	}
+
+	/*!
+	* \brief Appends data at the end of the file
+	*
+	* \param The added record
+	*/
+	void push_back(const T &added)
+	{
+		archiver().append(reinterpret_cast<const std::uint8_t*>(&added), sizeof(T));
+	}
+
+	/*!
+	* \brief Access to the records that were already written
+	*
+	* \param Index of the first record
+	* \return The records from the given one to the last one
+	* \note Loops over the result can be vectorised, unlike loops that use operator[]
+	*/
+	std::span<const T> records(int from = 0) const
+	{
+		const int available = size();
+		if (from > available)
+			throw(std::logic_error("Reading behind the end of an archive"));
+		return { data() + from, static_cast<std::size_t>(available - from) };
+	}
+
+	/*!
+	* \brief Swaps loaded contents with another file of the same type
+	*
+	* \param Another file to swap
+	* \note Swapping it with a file of another type through the parent class is not allowed
+	*/
+	void swap(MemoryMappedFile<T, archiverType> &other)
+	{
+		MemoryMappedFile<T>::swap(other);
+	}
+
+	/*!
+	* \brief Swaps contents with other data
+	*
+	* \param Another file to swap
+	*/
+	void swap(const T* data, int size)
+	{
+		MemoryMappedFile<T>::swap(data, size);
+	}
+};
 
 #endif // !memory_mapped_file_H
@@ -0,0 +1,82 @@
+#include "memory_mapped_file_async.hpp"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+constexpr int IO_THREADS = 4;
+
+namespace {
+class IoThreads {
+	std::mutex mutex_;
+	std::condition_variable wakeUp_;
+	std::deque<std::function<void()>> tasks_;
+	std::vector<std::thread> threads_;
+	bool stopping_ = false;
+
+	IoThreads()
+	{
+		for (int i = 0; i < IO_THREADS; i++)
+			threads_.emplace_back([this] { work(); });
+	}
+
+	void work()
+	{
+		while (true) {
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				wakeUp_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+				if (tasks_.empty())
+					return;
+				task = std::move(tasks_.front());
+				tasks_.pop_front();
+			}
+			task();
+		}
+	}
+
+public:
+	~IoThreads()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stopping_ = true;
+		}
+		wakeUp_.notify_all();
+		for (std::thread &thread : threads_)
+			thread.join();
+	}
+
+	static IoThreads &instance()
+	{
+		static IoThreads retval;
+		return retval;
+	}
+
+	void run(std::function<void()> task)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			tasks_.push_back(std::move(task));
+		}
+		wakeUp_.notify_one();
+	}
+};
+}
+
+void runOnIoThread(std::function<void()> task)
+{
+	IoThreads::instance().run(std::move(task));
+}
+
+MemoryMappedFileLoading MemoryMappedFileBase::loadAsync(int until) const
+{
+	return MemoryMappedFileLoading(this, until);
+}
+
+MemoryMappedFileReading<std::uint8_t> MemoryMappedFileBase::readAsync(int at, int count) const
+{
+	return MemoryMappedFileReading<std::uint8_t>(this, at, count);
+}
@@ -0,0 +1,104 @@
+/*!
+* \file memory_mapped_file_async.hpp
+* \date 2026/10/18 17:10
+*
+* \author Ján Dugáček
+*
+* \brief Loading files in coroutines without blocking the thread
+*
+* The awaitables returned by loadAsync() and readAsync() complete immediately if the data is already loaded. Otherwise, the coroutine is
+* suspended, the data is loaded by one of a few I/O threads shared by all files and the coroutine is resumed on that thread. It's up to the
+* caller to move it elsewhere if it needs to.
+*
+* \note The file must not be accessed in any other way until the awaitable completes
+*/
+
+#ifndef MEMORY_MAPPED_FILE_ASYNC_H
+#define MEMORY_MAPPED_FILE_ASYNC_H
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <span>
+#include <stdexcept>
+#include "memory_mapped_file_base.hpp"
+
+/*!
+* \brief Runs a function on an I/O thread
+*
+* \param The function, it must not throw
+*/
+void runOnIoThread(std::function<void()> task);
+
+class MemoryMappedFileLoading {
+protected:
+	const MemoryMappedFileBase* file_;
+	int until_;
+	std::exception_ptr error_;
+
+public:
+	/*!
+	* \brief Constructor, to be called through MemoryMappedFileBase::loadAsync()
+	*
+	* \param The file to load
+	* \param How many bytes have to be loaded, negative number means load all
+	*/
+	MemoryMappedFileLoading(const MemoryMappedFileBase* file, int until) : file_(file), until_(until) {}
+
+	bool await_ready() const
+	{
+		return file_->resident(until_);
+	}
+
+	void await_suspend(std::coroutine_handle<> waiting)
+	{
+		runOnIoThread([this, waiting] {
+			try {
+				file_->load(until_);
+			}
+			catch(...) {
+				error_ = std::current_exception();
+			}
+			waiting.resume();
+		});
+	}
+
+	void await_resume() const
+	{
+		if (error_)
+			std::rethrow_exception(error_);
+	}
+};
+
+template<typename T>
+class MemoryMappedFileReading : public MemoryMappedFileLoading {
+	int from_;
+	int count_;
+
+public:
+	/*!
+	* \brief Constructor, to be called through readAsync()
+	*
+	* \param The file to read from
+	* \param Index of the first record
+	* \param Number of records
+	*/
+	MemoryMappedFileReading(const MemoryMappedFileBase* file, int at, int count) :
+		MemoryMappedFileLoading(file, (count > 0) ? int((at + count) * sizeof(T)) - 1 : 0), from_(int(at * sizeof(T))), count_(count)
+	{
+		if (at < 0 || count < 0)
+			throw(std::logic_error("Reading a negative range of an archive"));
+	}
+
+	std::span<const T> await_resume() const
+	{
+		MemoryMappedFileLoading::await_resume();
+		if (count_ == 0)
+			return {};
+		if (!file_->canReadAt(until_))
+			throw(std::logic_error("Reading behind the end of an archive"));
+		return { reinterpret_cast<const T*>(&(*file_)[from_]), static_cast<std::size_t>(count_) };
+	}
+};
+
+#endif //MEMORY_MAPPED_FILE_ASYNC_H
@@ -1,15 +1,124 @@
 #include "memory_mapped_file_base.hpp"
+#include "memory_mapped_file_watcher.hpp"
+#include "memory_mapped_file_snapshot.hpp"
+#include <algorithm>
+#include <bit>
+#include <thread>
+#ifndef _WIN32
+#include <cerrno>
+#include <unistd.h>
+#endif
 
-MemoryMappedFileBase::MemoryMappedFileBase(const std::string &fileName) :
+constexpr int WATCH_UNTRIED = -1;
+constexpr int WATCH_FAILED = -2;
+constexpr int UNWATCHED_POLL_INTERVAL = 10;
+
+MemoryMappedFileBase::MemoryMappedFileBase(const std::string &fileName, std::pmr::memory_resource* memory) :
 	modified_(false),
 	fileName_(fileName),
+	data_(memory),
 	loadedUntil_(0),
-	fileSize_(-1)
+	fileSize_(-1),
+	watch_(WATCH_UNTRIED),
+	changes_(nullptr),
+	changesSeen_(0),
+	sequential_(false),
+	residentReported_(0)
 {
 }
 
 MemoryMappedFileBase::~MemoryMappedFileBase()
 {
+	if (snapshots_) {
+		// Snapshots can outlive the file
+		preserveAllPages();
+		std::lock_guard<std::mutex> guard(snapshots_->mutex);
+		snapshots_->data = nullptr;
+	}
+	stopWatching();
+	statistics_.add(MemoryMappedFileCounter::RESIDENT_BYTES, -residentReported_);
+}
+
+void MemoryMappedFileBase::updateResidentBytes() const
+{
+	const std::int64_t resident = std::int64_t(data_.capacity());
+	statistics_.add(MemoryMappedFileCounter::RESIDENT_BYTES, resident - residentReported_);
+	residentReported_ = resident;
+}
+
+bool MemoryMappedFileBase::changedOnDisk() const
+{
+	if (watch_ == WATCH_UNTRIED) {
+		watch_ = MemoryMappedFileWatcher::instance().watch(extendedFileName(fileName_));
+		if (watch_ < 0) {
+			watch_ = WATCH_FAILED;
+			return false;
+		}
+		changes_ = &MemoryMappedFileWatcher::instance().counter(watch_);
+		changesSeen_ = MemoryMappedFileWatcher::instance().changes(watch_);
+		return false;
+	}
+	if (watch_ < 0) return false;
+
+	const std::uint64_t changes = changes_->load(std::memory_order_relaxed);
+	if (changes == changesSeen_) return false;
+	changesSeen_ = changes;
+	return true;
+}
+
+void MemoryMappedFileBase::acknowledgeChanges() const
+{
+	// Other objects of this process watching the file are told about the change right away, not a moment later by the watcher's thread
+	if (watch_ >= 0) {
+		changesSeen_ = MemoryMappedFileWatcher::instance().changes(watch_);
+		return;
+	}
+	if (watch_ == WATCH_FAILED)
+		watch_ = WATCH_UNTRIED; // The file may have been just created
+	MemoryMappedFileWatcher::instance().update();
+}
+
+void MemoryMappedFileBase::stopWatching() const
+{
+	if (watch_ >= 0)
+		MemoryMappedFileWatcher::instance().unwatch(watch_);
+	watch_ = WATCH_UNTRIED;
+	changes_ = nullptr;
+}
+
+bool MemoryMappedFileBase::waitForChanges(int timeout) const
+{
+	if (watch_ == WATCH_UNTRIED)
+		changedOnDisk();
+	if (watch_ < 0) {
+		const int sleep = (timeout >= 0) ? std::min(timeout, UNWATCHED_POLL_INTERVAL) : UNWATCHED_POLL_INTERVAL;
+		std::this_thread::sleep_for(std::chrono::milliseconds(sleep));
+		watch_ = WATCH_UNTRIED; // The file may have been created in the meantime
+		return true;
+	}
+	return MemoryMappedFileWatcher::instance().wait(watch_, changesSeen_, timeout);
+}
+
+void MemoryMappedFileBase::prefetch(int from, int size) const
+{
+	(void)from;
+	(void)size;
+}
+
+void MemoryMappedFileBase::adviseSequential() const
+{
+	sequential_ = true;
+}
+
+void MemoryMappedFileBase::adviseRandom() const
+{
+	sequential_ = false;
+}
+
+void MemoryMappedFileBase::dropCache(int from, int size) const
+{
+	(void)from;
+	(void)size;
 }
 
 const std::string &MemoryMappedFileBase::fileName() const
@@ -26,6 +135,7 @@ void MemoryMappedFileBase::append(const std::vector<std::uint8_t> &added)
 {
 	load();
 	modified_ = true;
+	reserveData(data_.size() + added.size());
 	data_.insert(data_.end(), added.begin(), added.end());
 }
 
@@ -33,36 +143,173 @@ void MemoryMappedFileBase::append(const std::uint8_t* added, int size)
 {
 	load();
 	modified_ = true;
-	for (int i = 0; i < size; i++)
-		data_.push_back(added[i]);
+	reserveData(data_.size() + size);
+	data_.insert(data_.end(), added, added + size);
 }
 
 void MemoryMappedFileBase::push_back(uint8_t added)
 {
 	load();
 	modified_ = true;
+	reserveData(data_.size() + 1);
 	data_.push_back(added);
 }
 
 void MemoryMappedFileBase::clear()
 {
 	if (!data_.empty() || !fullyLoaded()) {
+		preserveAllPages();
 		modified_ = true;
 		data_.clear();
 		loadedUntil_ = 0;
 		fileSize_ = 0;
 	}
+	updateResidentBytes();
+}
+
+void MemoryMappedFileBase::markDirty(int from, int to)
+{
+	for (int page = from >> PAGE_BITS; page << PAGE_BITS < to; page++)
+		markDirty(page << PAGE_BITS);
+}
+
+void MemoryMappedFileBase::clearDirtyPages() const
+{
+	const_cast<std::vector<std::uint64_t>&>(dirtyPages_).clear();
+}
+
+void MemoryMappedFileBase::preservePage(int page) const
+{
+	std::lock_guard<std::mutex> guard(snapshots_->mutex);
+	std::shared_ptr<const std::vector<std::uint8_t>> copy; // Snapshots that need it share the same copy
+	for (MemoryMappedFileSnapshotPages* snapshot : snapshots_->snapshots) {
+		if (page >= int(snapshot->preserved_.size()) || snapshot->preserved_[page])
+			continue;
+		if (!copy) {
+			const std::size_t from = std::size_t(page) << PAGE_BITS;
+			const std::size_t to = std::min(from + (std::size_t(1) << PAGE_BITS), data_.size());
+			copy = std::make_shared<const std::vector<std::uint8_t>>(data_.begin() + from, data_.begin() + to);
+		}
+		snapshot->preserved_[page] = copy;
+	}
+	sharedPages_[page >> 6] &= ~(std::uint64_t(1) << (page & 63));
+}
+
+void MemoryMappedFileBase::preserveAllPages() const
+{
+	for (unsigned int i = 0; i < sharedPages_.size(); i++)
+		while (sharedPages_[i])
+			preservePage(int(i * 64 + std::countr_zero(sharedPages_[i])));
+	sharedPages_.clear();
+}
+
+void MemoryMappedFileBase::growData(std::size_t size) const
+{
+	std::pmr::vector<std::uint8_t> &data = const_cast<std::pmr::vector<std::uint8_t>&>(data_);
+	const std::size_t capacity = std::max(size, data.capacity() * 2);
+	if (!snapshots_) {
+		data.reserve(capacity);
+		return;
+	}
+	std::lock_guard<std::mutex> guard(snapshots_->mutex); // Snapshots may be reading the pages they share
+	data.reserve(capacity);
+}
+
+void MemoryMappedFileBase::read(int from, int size, std::uint8_t* into) const
+{
+	if (from < 0 || size < 0 || (size > 0 && !canReadAt(from + size - 1)))
+		throw(std::logic_error("Reading behind the end of an archive"));
+	std::copy_n(data_.begin() + from, size, into);
+}
+
+void MemoryMappedFileBase::send(int descriptor, int from, int size) const
+{
+	if (from < 0 || size < 0)
+		throw(std::logic_error("Reading behind the end of an archive"));
+#ifndef _WIN32
+	// Parts are copied through read(), so that archivers able to read without loading don't load the whole file
+	constexpr int BUFFER_SIZE = 1 << 16;
+	std::vector<std::uint8_t> buffer(std::min(size, BUFFER_SIZE));
+	for (int sent = 0; sent < size; ) {
+		const int part = std::min(size - sent, BUFFER_SIZE);
+		read(from + sent, part, buffer.data());
+		for (int written = 0; written < part; ) {
+			const ssize_t done = write(descriptor, buffer.data() + written, std::size_t(part - written));
+			if (done < 0 && errno == EINTR)
+				continue;
+			if (done <= 0)
+				throw(std::runtime_error("Could not write into descriptor " + std::to_string(descriptor)));
+			written += int(done);
+		}
+		sent += part;
+	}
+#else
+	(void)descriptor;
+	throw(std::logic_error("Sending into file descriptors isn't supported on this system"));
+#endif
 }
 
-const std::vector<std::uint8_t> &MemoryMappedFileBase::data() const
+void MemoryMappedFileBase::prepareConcurrentReading() const
+{
+	load();
+}
+
+MemoryMappedFileSnapshot<std::uint8_t> MemoryMappedFileBase::snapshot() const
+{
+	load();
+	if (!snapshots_) {
+		snapshots_ = std::make_shared<MemoryMappedFileSnapshotRegistry>();
+		snapshots_->data = &data_;
+	}
+	auto pages = std::make_shared<MemoryMappedFileSnapshotPages>(snapshots_, int(data_.size()));
+	const std::size_t pageCount = (data_.size() + (std::size_t(1) << PAGE_BITS) - 1) >> PAGE_BITS;
+	sharedPages_.resize(std::max(sharedPages_.size(), (pageCount + 63) >> 6));
+	for (std::size_t i = 0; i < pageCount >> 6; i++)
+		sharedPages_[i] = ~std::uint64_t(0);
+	if (pageCount & 63)
+		sharedPages_[pageCount >> 6] |= (std::uint64_t(1) << (pageCount & 63)) - 1;
+	return MemoryMappedFileSnapshot<std::uint8_t>(std::move(pages));
+}
+
+MemoryMappedFileStatisticsSnapshot MemoryMappedFileBase::statistics() const
+{
+	updateResidentBytes();
+	return statistics_.snapshot();
+}
+
+const std::pmr::vector<std::uint8_t> &MemoryMappedFileBase::data() const
 {
 	load();
 	return data_;
 }
 
+void MemoryMappedFileBase::swapContents(std::pmr::vector<std::uint8_t> &other)
+{
+	load();
+	preserveAllPages();
+	modified_ = true;
+	if (other.get_allocator() == data_.get_allocator()) {
+		swap(data_, other);
+	} else {
+		std::pmr::vector<std::uint8_t> previous(data_.begin(), data_.end(), other.get_allocator());
+		data_.assign(other.begin(), other.end());
+		swap(previous, other);
+	}
+	markDirty(0, int(data_.size()));
+}
+
 void MemoryMappedFileBase::swapContents(std::vector<std::uint8_t> &other)
 {
 	load();
+	preserveAllPages();
 	modified_ = true;
-	swap(data_, other);
+	std::vector<std::uint8_t> previous(data_.begin(), data_.end());
+	data_.assign(other.begin(), other.end());
+	swap(previous, other);
+	markDirty(0, int(data_.size()));
+}
+
+std::pmr::memory_resource* MemoryMappedFileBase::memoryResource() const
+{
+	return data_.get_allocator().resource();
 }
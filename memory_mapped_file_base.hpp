@@ -16,26 +16,158 @@
 
 #include <string>
 #include <vector>
+#include <atomic>
 #include <cstdint>
 #include <memory>
+#include <memory_resource>
 #include <iostream>
+#include "memory_mapped_file_statistics.hpp"
+
+class MemoryMappedFileLoading;
+template<typename T>
+class MemoryMappedFileReading;
+template<typename T>
+class MemoryMappedFileSnapshot;
+struct MemoryMappedFileSnapshotRegistry;
+template<typename...>
+class MemoryMappedFile;
+
+struct MemoryMappedFileOptions {
+	bool checksums = false; // Keep CRC32C checksums of pages in a sidecar file and check them when loading, only for uncompressed files
+	bool appendOnly = false; // Never load the existing contents, only keep the appended bytes until they're flushed behind them
+	bool changeLog = false; // Write the changes made by each flush into a sidecar file, so that copies can be updated, only for uncompressed files
+	int preallocation = 0; // Reserve disk space behind the end in steps of this many bytes when appending, on Linux, only for uncompressed files
+	bool directIo = false; // Load and flush bypassing the system's cache, for files read or written once, on Linux, only for uncompressed files, not with preallocation
+};
 
 class MemoryMappedFileBase {
+	template<typename...>
+	friend class MemoryMappedFile; // Files with a known archiver type access the contents directly
+
+public:
+	constexpr static int PAGE_BITS = 12; // Modifications are tracked in pages of 4 kiB
+
 protected:
 	mutable bool modified_;
 	std::string fileName_;
-	std::vector<std::uint8_t> data_;
+	std::pmr::vector<std::uint8_t> data_;
 	mutable int loadedUntil_;
 	mutable int fileSize_;
+	mutable int watch_;
+	mutable const std::atomic<std::uint64_t>* changes_; // Counter of changes of the watched file, updated by the watcher's thread
+	mutable std::uint64_t changesSeen_;
+	mutable bool sequential_;
+	mutable MemoryMappedFileStatistics statistics_;
+	mutable std::int64_t residentReported_;
+	std::vector<std::uint64_t> dirtyPages_; // One bit per page modified since the last flush
+	mutable std::shared_ptr<MemoryMappedFileSnapshotRegistry> snapshots_;
+	mutable std::vector<std::uint64_t> sharedPages_; // One bit per page that some snapshots read from data_
 
 	virtual std::string fileNameExtension() const = 0;
+
+	/*!
+	* \brief Checks if another process has changed the file since the last check, starts watching it when called for the first time
+	*
+	* \return Whether it has changed, always false if changes can't be watched
+	* \note It only loads a counter, so it's cheap enough to be called on every access, changes are noticed a moment after they're made
+	*/
+	bool changedOnDisk() const;
+
+	/*!
+	* \brief Marks all changes of the file made so far as known, to be called after writing into it
+	*/
+	void acknowledgeChanges() const;
+
+	/*!
+	* \brief Stops watching the file, to be called when switching to another file
+	*/
+	void stopWatching() const;
+
+	/*!
+	* \brief Updates the count of bytes held in memory, to be called after loading or flushing
+	*/
+	void updateResidentBytes() const;
+
+	/*!
+	* \brief Copies a page for snapshots that still read it from the contents
+	*
+	* \param Index of the page
+	*/
+	void preservePage(int page) const;
+
+	/*!
+	* \brief Copies all pages that snapshots still read from the contents, to be called before the contents are cleared or replaced
+	*/
+	void preserveAllPages() const;
+
+	/*!
+	* \brief Enlarges the capacity of the contents while no snapshot is reading them
+	*
+	* \param The required capacity
+	*/
+	void growData(std::size_t size) const;
+
+	/*!
+	* \brief Ensures that the contents can grow to the given size without being moved, to be called before adding bytes
+	*
+	* \param The size the contents will have
+	*/
+	inline void reserveData(std::size_t size) const
+	{
+		if (size > data_.capacity())
+			growData(size);
+	}
+
+	/*!
+	* \brief Marks the page containing a byte as modified, must be called before modifying it
+	*
+	* \param Index of the byte
+	*/
+	inline void markDirty(int at)
+	{
+		const unsigned int page = static_cast<unsigned int>(at) >> PAGE_BITS;
+		if ((page >> 6) >= dirtyPages_.size())
+			dirtyPages_.resize((page >> 6) + 1);
+		dirtyPages_[page >> 6] |= std::uint64_t(1) << (page & 63);
+		if ((page >> 6) < sharedPages_.size() && (sharedPages_[page >> 6] >> (page & 63)) & 1)
+			preservePage(int(page));
+	}
+
+	/*!
+	* \brief Marks all pages containing bytes in a range as modified
+	*
+	* \param Index of the first byte
+	* \param Index behind the last byte
+	*/
+	void markDirty(int from, int to);
+
+	/*!
+	* \brief Checks if a page was modified since the last flush
+	*
+	* \param Index of the page
+	* \return Whether it was modified
+	*/
+	inline bool isDirty(int page) const
+	{
+		const unsigned int index = static_cast<unsigned int>(page);
+		return (index >> 6) < dirtyPages_.size() && (dirtyPages_[index >> 6] >> (index & 63)) & 1;
+	}
+
+	/*!
+	* \brief Forgets about modified pages, to be called after flushing
+	*/
+	void clearDirtyPages() const;
 public:
 	/*!
 	* \brief Constructor: should load file if exists, or start holding an empty string
 	*
 	* \param Name of the file, without suffix
+	* \param Memory resource to allocate the contents from
 	*/
-	MemoryMappedFileBase(const std::string &fileName);
+	MemoryMappedFileBase(const std::string &fileName, std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+
+	MemoryMappedFileBase(const MemoryMappedFileBase &other) = delete;
+	MemoryMappedFileBase &operator=(const MemoryMappedFileBase &other) = delete;
 
 	/*!
 	* \brief Destructor, should flush changes
@@ -79,10 +211,104 @@ public:
 	{
 		if (at < loadedUntil_ || at < int(data_.size()))
 			return true;
+		statistics_.add(MemoryMappedFileCounter::LAZY_LOADS);
 		load(at);
 		return (at < loadedUntil_ || at < int(data_.size()));
 	}
 
+	/*!
+	* \brief Starts loading bytes that will be needed soon in the background, if the way the file is stored allows it
+	*
+	* \param Index of the first byte that will be needed
+	* \param Number of bytes that will be needed
+	*/
+	virtual void prefetch(int from, int size) const;
+
+	/*!
+	* \brief Announces that the file will be read from the beginning to the end, so that it's loaded in larger parts
+	*/
+	virtual void adviseSequential() const;
+
+	/*!
+	* \brief Announces that the file will be read at random places, so that nothing is read ahead
+	*/
+	virtual void adviseRandom() const;
+
+	/*!
+	* \brief Announces that bytes won't be needed anymore, so that the system can release whatever it keeps for them
+	*
+	* \param Index of the first byte that won't be needed
+	* \param Number of bytes that won't be needed
+	* \note Loaded contents are kept, this only affects the system's caches and data prepared by prefetch()
+	*/
+	virtual void dropCache(int from, int size) const;
+
+	/*!
+	* \brief Copies bytes, without loading the bytes before them if the way the file is stored allows it
+	*
+	* \param Index of the first byte
+	* \param Number of bytes
+	* \param Where to copy them
+	* \note Throws std::logic_error if the bytes are behind the end
+	*/
+	virtual void read(int from, int size, std::uint8_t* into) const;
+
+	/*!
+	* \brief Writes bytes into a file descriptor, like a socket or a pipe
+	*
+	* \param The descriptor, it must be blocking
+	* \param Index of the first byte
+	* \param Number of bytes
+	* \note Throws std::logic_error if the bytes are behind the end, possibly after sending those before, and std::runtime_error if writing fails
+	* \note Archivers that keep the file as it is on disk send it without copying it through memory, others copy it through read()
+	*/
+	virtual void send(int descriptor, int from, int size) const;
+
+	/*!
+	* \brief Makes read() safe to call from multiple threads at once, until the file is modified or loaded again
+	*
+	* \note Archivers that can't read without loading load the whole file
+	*/
+	virtual void prepareConcurrentReading() const;
+
+	/*!
+	* \brief Checks if bytes are loaded, so that accessing them won't block
+	*
+	* \param Index of the last byte that has to be loaded, negative number means all
+	* \return Whether they are loaded, or the file ends before them
+	*/
+	inline bool resident(int until) const
+	{
+		if (fullyLoaded())
+			return true;
+		return (until >= 0 && (until < loadedUntil_ || until < int(data_.size())));
+	}
+
+	/*!
+	* \brief Loads the file up to the given byte in a coroutine, without blocking the thread
+	*
+	* \param How many bytes have to be loaded, negative number means load all
+	* \return Awaitable that completes when it's loaded, memory_mapped_file_async.hpp has to be included to use it
+	*/
+	MemoryMappedFileLoading loadAsync(int until = -1) const;
+
+	/*!
+	* \brief Loads bytes in a coroutine, without blocking the thread
+	*
+	* \param Index of the first byte
+	* \param Number of bytes
+	* \return Awaitable that results in the bytes, memory_mapped_file_async.hpp has to be included to use it
+	*/
+	MemoryMappedFileReading<std::uint8_t> readAsync(int at, int count) const;
+
+	/*!
+	* \brief Takes a read-only view of the contents as they are now, it can be read from other threads while this file is modified
+	*
+	* \return The snapshot, memory_mapped_file_snapshot.hpp has to be included to use it
+	* \note Loads the whole file, pages are copied only when this file modifies them while the snapshot exists
+	*/
+	MemoryMappedFileSnapshot<std::uint8_t> snapshot() const;
+
 	/*!
 	* \brief Byte acccess, allows modification
 	*
@@ -93,6 +319,7 @@ public:
 	{
 		load();
 		modified_ = true;
+		markDirty(at);
 		return data_[static_cast<unsigned int>(at)];
 	}
 
@@ -104,7 +331,10 @@ public:
 	*/
 	inline const std::uint8_t &operator[](int at) const
 	{
-		if (at >= loadedUntil_) load(at);
+		if (at >= loadedUntil_ && at >= int(data_.size())) {
+			statistics_.add(MemoryMappedFileCounter::LAZY_LOADS);
+			load(at);
+		}
 		return data_[static_cast<unsigned int>(at)];
 	}
 
@@ -112,10 +342,19 @@ public:
 	* \brief Gets size of the data
 	*
 	* \return Size of the data
-	* \note May have to read the whole file
+	* \note Cached, but it notices if another process appends to the file
 	*/
 	virtual int size() const = 0;
 
+	/*!
+	* \brief Waits until another process changes the file, so that size() can be checked again
+	*
+	* \param Maximal time to wait in milliseconds, negative number means forever
+	* \return Whether something might have changed
+	* \note If the file can't be watched (for example because it doesn't exist yet), it only sleeps for a short while
+	*/
+	bool waitForChanges(int timeout = -1) const;
+
 	/*!
 	* \brief Gets size of the data
 	*
@@ -157,23 +396,48 @@ public:
 
 	/*!
 	* \brief Clears the contents
+	*
+	* \note It's virtual to allow dropping data that archivers keep aside from the contents
 	*/
-	void clear();
+	virtual void clear();
 
 	/*!
 	* \brief Access to constant data
 	*
 	* \return Const reference to vector containing the data
 	*/
-	const std::vector<std::uint8_t> &data() const;
+	const std::pmr::vector<std::uint8_t> &data() const;
+
+	/*!
+	* \brief Swaps contents for another vector of std::uint8_ts
+	*
+	* \param The other vector
+	* \note The buffers are copied if the vector uses a different memory resource
+	*/
+	void swapContents(std::pmr::vector<std::uint8_t> &other);
 
 	/*!
 	* \brief Swaps contents for another vector of std::uint8_ts
 	*
 	* \param The other vector
+	* \note The buffers are copied, because the vector can't use the file's memory resource
 	*/
 	void swapContents(std::vector<std::uint8_t> &other);
 
+	/*!
+	* \brief Returns the memory resource the contents are allocated from
+	*
+	* \return The memory resource
+	*/
+	std::pmr::memory_resource* memoryResource() const;
+
+	/*!
+	* \brief Returns what this file has done so far, MemoryMappedFileStatistics::global() holds the sums for all files
+	*
+	* \return Values of the counters
+	*/
+	MemoryMappedFileStatisticsSnapshot statistics() const;
+
 	/*!
 	* \brief Returns if the archive is fully loaded
 	*
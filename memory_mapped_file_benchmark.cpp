@@ -0,0 +1,695 @@
+#include <iostream>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <cstring>
+#include <climits>
+#include <cstdio>
+#include <filesystem>
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "memory_mapped_file_base.hpp"
+#include "memory_mapped_file_uncompressed.hpp"
+#include "memory_mapped_file_compressed.hpp"
+#include "memory_mapped_file_encoded.hpp"
+#include "memory_mapped_file.hpp"
+#include "memory_mapped_file_memory.hpp"
+#include "memory_mapped_file_tail.hpp"
+#include "memory_mapped_file_zone_map.hpp"
+#include "memory_mapped_file_sort.hpp"
+#include "memory_mapped_file_parallel.hpp"
+#include "memory_mapped_file_pack.hpp"
+#include "memory_mapped_file_change_log.hpp"
+
+// Usage: memory_mapped_file_benchmark [--json] [--max-size BYTES] [--output FILE]
+// Prints one result per line as CSV (or a JSON array), sizes go from 1 KiB up to the maximal size (64 MiB by default)
+
+volatile int sink; // Prevents optimising away the computations whose results aren't used
+
+struct BenchmarkResult {
+	std::string backend;
+	std::string scenario;
+	long long bytes;
+	long long operations;
+	double seconds;
+	long peakMemoryGrowth; // In kilobytes
+};
+
+std::vector<BenchmarkResult> results;
+
+struct Backend {
+	std::string name;
+	std::function<std::unique_ptr<MemoryMappedFileBase>(const std::string&)> open;
+};
+
+long peakMemoryKilobytes()
+{
+#ifndef _WIN32
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+#else
+	return -1;
+#endif
+}
+
+void makeBenchmark(const std::string &backend, const std::string &scenario, long long bytes, long long operations, std::function<void()> action)
+{
+	const long memoryBefore = peakMemoryKilobytes();
+	const auto start = std::chrono::steady_clock::now();
+	try {
+		action();
+	}
+	catch(std::exception &e) {
+		std::cerr << backend << " " << scenario << " failed: " << e.what() << std::endl;
+		return;
+	}
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	results.push_back({ backend, scenario, bytes, operations, seconds, peakMemoryKilobytes() - memoryBefore });
+	std::cerr << backend << " " << scenario << " " << bytes << " B: " << bytes / seconds / (1 << 20) << " MB/s" << std::endl;
+}
+
+std::vector<std::uint8_t> makeSample(int size)
+{
+	// Measurements with slowly changing values, roughly as compressible as real data
+	std::vector<std::uint8_t> sample;
+	sample.reserve(size);
+	std::mt19937 generator(13);
+	std::int32_t value = 0;
+	while (int(sample.size()) < size) {
+		value += int(generator() % 7) - 3;
+		for (int i = 0; i < 4 && int(sample.size()) < size; i++)
+			sample.push_back(std::uint8_t(value >> (i * 8)));
+	}
+	return sample;
+}
+
+void benchmarkBackend(const Backend &backend, int size)
+{
+	const std::string name = "benchmark";
+	const int reads = std::min(size, 1 << 22);
+	{
+		std::unique_ptr<MemoryMappedFileBase> archive = backend.open(name);
+		archive->clear();
+		std::vector<std::uint8_t> sample = makeSample(size);
+		archive->swapContents(sample);
+		makeBenchmark(backend.name, "flush", size, 1, [&] { archive->flush(); });
+		archive->dropCache(0, size);
+	}
+
+	makeBenchmark(backend.name, "cold open", size, 1, [&] {
+		std::unique_ptr<MemoryMappedFileBase> archive = backend.open(name);
+		sink = archive->size() + (*static_cast<const MemoryMappedFileBase*>(archive.get()))[0];
+	});
+
+	makeBenchmark(backend.name, "sequential read", size, size, [&] {
+		std::unique_ptr<MemoryMappedFileBase> archive = backend.open(name);
+		archive->adviseSequential();
+		const MemoryMappedFileBase &reading = *archive;
+		int sum = 0;
+		for (int i = 0; i < size; i++)
+			sum += reading[i];
+		sink = sum;
+	});
+
+	makeBenchmark(backend.name, "random read", reads, reads, [&] {
+		std::unique_ptr<MemoryMappedFileBase> archive = backend.open(name);
+		archive->adviseRandom();
+		const MemoryMappedFileBase &reading = *archive;
+		std::uint32_t position = 13;
+		int sum = 0;
+		for (int i = 0; i < reads; i++) {
+			position = position * 1664525 + 1013904223;
+			sum += reading[int(position % std::uint32_t(size))];
+		}
+		sink = sum;
+	});
+
+	makeBenchmark(backend.name, "partial update", size, size / 100 + 1, [&] {
+		std::unique_ptr<MemoryMappedFileBase> archive = backend.open(name);
+		for (int i = 0; i < size; i += 100)
+			(*archive)[i]++;
+		archive->flush();
+	});
+
+	const int record = 64;
+	const int flushEvery = std::max(record, std::min(size / 16, 1 << 20));
+	makeBenchmark(backend.name, "append ingest", size, size / record, [&] {
+		std::unique_ptr<MemoryMappedFileBase> archive = backend.open(name);
+		archive->clear();
+		archive->flush();
+		std::uint8_t added[record] = {};
+		for (int appended = 0; appended + record <= size; appended += record) {
+			std::memcpy(added, &appended, sizeof(appended));
+			archive->append(added, record);
+			if ((appended + record) % flushEvery == 0)
+				archive->flush();
+		}
+		archive->flush();
+	});
+}
+
+void benchmarkMemoryResources(int size)
+{
+	const int reads = 1 << 24;
+	MemoryMappedFileHugePages transparentHugePages;
+	MemoryMappedFileHugePages explicitHugePages(true);
+	MemoryMappedFileNumaLocal numaLocal;
+	std::vector<std::pair<std::string, std::pmr::memory_resource*>> resources{ { "Default allocator", std::pmr::get_default_resource() },
+			{ "Transparent huge pages", &transparentHugePages }, { "Explicit huge pages", &explicitHugePages }, { "NUMA local", &numaLocal } };
+	for (auto &resource : resources) {
+		MemoryMappedFileUncompressed archive("benchmark_memory", resource.second);
+		archive.clear();
+		makeBenchmark("Uncompressed (" + resource.first + ")", "append in memory", size, size >> 16, [&] {
+			std::vector<std::uint8_t> block(1 << 16, 13);
+			for (int i = 0; i < size; i += int(block.size()))
+				archive.append(block);
+		});
+		const MemoryMappedFileBase &reading = archive;
+		makeBenchmark("Uncompressed (" + resource.first + ")", "random read in memory", reads, reads, [&] {
+			std::uint32_t position = 13;
+			int sum = 0;
+			for (int i = 0; i < reads; i++) {
+				position = position * 1664525 + 1013904223;
+				sum += reading[int(position % std::uint32_t(size))];
+			}
+			sink = sum;
+		});
+		archive.clear();
+	}
+
+	MemoryMappedFileArena arena(64 << 20);
+	resources = { { "Default allocator", std::pmr::get_default_resource() }, { "Arena", &arena } };
+	const int files = 10000;
+	const std::vector<std::uint8_t> block(1000, 13);
+	for (auto &resource : resources) {
+		std::vector<std::unique_ptr<MemoryMappedFileUncompressed>> archives;
+		makeBenchmark("Uncompressed (" + resource.first + ")", "many small files", files * 8 * block.size(), files, [&] {
+			for (int i = 0; i < files; i++) {
+				archives.push_back(std::make_unique<MemoryMappedFileUncompressed>("benchmark_memory", resource.second));
+				archives.back()->clear();
+				for (int j = 0; j < 8; j++)
+					archives.back()->append(block);
+			}
+		});
+	}
+}
+
+void benchmarkDispatch(int size)
+{
+	// Loops over a loaded file, the type-erased file calls the archiver through virtual functions, the other one calls it directly
+	const int count = size / int(sizeof(std::int32_t));
+	MemoryMappedFile<std::int32_t, MemoryMappedFileUncompressed> file("benchmark_dispatch");
+	file.clear();
+	for (int i = 0; i < count; i++)
+		file.push_back(i);
+	MemoryMappedFile<std::int32_t> &erased = file;
+	const MemoryMappedFile<std::int32_t, MemoryMappedFileUncompressed> &reading = file;
+	const MemoryMappedFile<std::int32_t> &erasedReading = file;
+
+	makeBenchmark("Type-erased", "indexed sum", size, count, [&] {
+		int sum = 0;
+		for (int i = 0; i < count; i++)
+			sum += erasedReading[i];
+		sink = sum;
+	});
+	makeBenchmark("Statically dispatched", "indexed sum", size, count, [&] {
+		int sum = 0;
+		for (int i = 0; i < count; i++)
+			sum += reading[i];
+		sink = sum;
+	});
+	makeBenchmark("Statically dispatched", "records sum", size, count, [&] {
+		int sum = 0;
+		for (std::int32_t record : reading.records())
+			sum += record;
+		sink = sum;
+	});
+	// The bound is checked on every iteration of a file that isn't modified, so it checks whether the file was changed on disk
+	file.flush();
+	const MemoryMappedFile<std::int32_t, MemoryMappedFileUncompressed> unmodified("benchmark_dispatch");
+	sink = int(unmodified.records().size()); // Loads it whole
+	makeBenchmark("Statically dispatched", "size-bounded sum", size, count, [&] {
+		int sum = 0;
+		for (int i = 0; i < unmodified.size(); i++)
+			sum += unmodified[i];
+		sink = sum;
+	});
+	makeBenchmark("Type-erased", "indexed increment", size, count, [&] {
+		for (int i = 0; i < count; i++)
+			erased[i]++;
+	});
+	makeBenchmark("Statically dispatched", "indexed increment", size, count, [&] {
+		for (int i = 0; i < count; i++)
+			file[i]++;
+	});
+	file.clear();
+}
+
+void benchmarkAppendOnly(int size)
+{
+	// A logger that opens a large file, appends a record and closes it
+	const int reopenings = 20;
+	const std::uint8_t record[64] = {};
+	{
+		MemoryMappedFileUncompressed file("benchmark_append");
+		file.clear();
+		std::vector<std::uint8_t> sample = makeSample(size);
+		file.swapContents(sample);
+	}
+	for (bool appendOnly : { false, true }) {
+		makeBenchmark(appendOnly ? "Uncompressed append-only" : "Uncompressed", "reopen and append", reopenings * int(sizeof(record)), reopenings, [&] {
+			for (int i = 0; i < reopenings; i++) {
+				MemoryMappedFileUncompressed file("benchmark_append", MemoryMappedFileOptions{ .appendOnly = appendOnly });
+				file.append(record, int(sizeof(record)));
+			}
+		});
+	}
+	MemoryMappedFileUncompressed("benchmark_append").clear();
+}
+
+void benchmarkZoneMap(int size)
+{
+	// Records ordered by time, a query asks for a narrow range of time, the file is opened again for every query so that nothing is loaded
+	struct Reading {
+		std::int32_t time;
+		std::int32_t value;
+	};
+	const int count = size / int(sizeof(Reading));
+	const int queries = 20;
+	auto byTime = [] (const Reading &reading) { return reading.time; };
+	{
+		MemoryMappedFile<Reading, MemoryMappedFileUncompressed> file("benchmark_zones");
+		file.clear();
+		for (int i = 0; i < count; i++)
+			file.push_back({ i, i % 100 });
+		MemoryMappedFileZoneMap<Reading, std::int32_t> zones(file, "benchmark_zones_by_time", byTime);
+		zones.rebuild();
+		zones.flush();
+	}
+	std::mt19937 generator(7);
+	std::uniform_int_distribution<int> distribution(0, std::max(count - 100, 0));
+	makeBenchmark("Uncompressed", "range query by full scan", size, queries, [&] {
+		for (int i = 0; i < queries; i++) {
+			const int from = distribution(generator);
+			const MemoryMappedFile<Reading, MemoryMappedFileUncompressed> file("benchmark_zones");
+			int sum = 0;
+			for (const Reading &reading : file.records())
+				if (reading.time >= from && reading.time < from + 100)
+					sum += reading.value;
+			sink = sum;
+		}
+	});
+	makeBenchmark("Uncompressed", "range query with zone map", size, queries, [&] {
+		for (int i = 0; i < queries; i++) {
+			const int from = distribution(generator);
+			MemoryMappedFile<Reading, MemoryMappedFileUncompressed> file("benchmark_zones");
+			MemoryMappedFileZoneMap<Reading, std::int32_t> zones(file, "benchmark_zones_by_time", byTime);
+			int sum = 0;
+			zones.forEach(from, from + 99, [&] (const Reading &reading, int) {
+				sum += reading.value;
+			});
+			sink = sum;
+		}
+	});
+	MemoryMappedFileUncompressed("benchmark_zones").clear();
+	MemoryMappedFileUncompressed("benchmark_zones_by_time").clear();
+}
+
+void benchmarkSort(int size)
+{
+	// Random 64-bit records, sorted in memory after loading everything and externally in runs of an eighth of the file
+	const int count = size / int(sizeof(std::uint64_t));
+	{
+		MemoryMappedFile<std::uint64_t, MemoryMappedFileUncompressed> file("benchmark_sort");
+		file.clear();
+		std::mt19937_64 generator(13);
+		for (int i = 0; i < count; i++)
+			file.push_back(generator());
+	}
+	makeBenchmark("Uncompressed", "sort in memory", size, count, [&] {
+		const MemoryMappedFile<std::uint64_t, MemoryMappedFileUncompressed> input("benchmark_sort");
+		std::vector<std::uint64_t> records(input.data(), input.data() + input.size());
+		std::sort(records.begin(), records.end());
+		MemoryMappedFile<std::uint64_t, MemoryMappedFileUncompressed> output("benchmark_sorted");
+		output.swap(records.data(), int(records.size()));
+	});
+	MemoryMappedFileSortOptions options;
+	options.runBytes = std::max(size / 8, 1 << 12);
+	makeBenchmark("Uncompressed", "external sort", size, count, [&] {
+		const MemoryMappedFile<std::uint64_t, MemoryMappedFileUncompressed> input("benchmark_sort");
+		MemoryMappedFile<std::uint64_t, MemoryMappedFileUncompressed> output("benchmark_sorted", MemoryMappedFileOptions{ .appendOnly = true });
+		sortMemoryMappedFile(input, output, std::less<std::uint64_t>(), options);
+	});
+	MemoryMappedFileUncompressed("benchmark_sort").clear();
+	MemoryMappedFileUncompressed("benchmark_sorted").clear();
+}
+
+void benchmarkParallelScan(int size)
+{
+	// Sums a file that was just opened, on one thread through operator[] and on all workers of the global pool
+	const int count = size / int(sizeof(std::int64_t));
+	{
+		MemoryMappedFile<std::int64_t, MemoryMappedFileUncompressed> file("benchmark_parallel");
+		file.clear();
+		for (int i = 0; i < count; i++)
+			file.push_back(i);
+	}
+	const std::string workers = std::to_string(MemoryMappedFileThreadPool::global().workers());
+	makeBenchmark("Uncompressed (1 thread)", "scan sum", size, count, [&] {
+		const MemoryMappedFile<std::int64_t, MemoryMappedFileUncompressed> file("benchmark_parallel");
+		std::int64_t sum = 0;
+		for (int i = 0; i < count; i++)
+			sum += file[i];
+		sink = int(sum);
+	});
+	makeBenchmark("Uncompressed (" + workers + " workers)", "scan sum", size, count, [&] {
+		const MemoryMappedFile<std::int64_t, MemoryMappedFileUncompressed> file("benchmark_parallel");
+		sink = int(parallelReduce(file, std::int64_t(0), [] (std::int64_t &sum, std::int64_t value) { sum += value; },
+				[] (std::int64_t first, std::int64_t second) { return first + second; }));
+	});
+	MemoryMappedFileUncompressed("benchmark_parallel").clear();
+}
+
+void benchmarkPack()
+{
+	// Opens and reads many small files, each in its own file and each in a pack
+	const int files = 10000;
+	const int records = 64;
+	{
+		MemoryMappedFilePack pack("benchmark_pack");
+		for (int i = 0; i < files; i++) {
+			MemoryMappedFile<std::int32_t, MemoryMappedFileUncompressed> separate("benchmark_small_" + std::to_string(i));
+			MemoryMappedFile<std::int32_t, MemoryMappedFilePacked> packed("small_" + std::to_string(i), pack);
+			separate.clear();
+			packed.clear();
+			for (int j = 0; j < records; j++) {
+				separate.push_back(i + j);
+				packed.push_back(i + j);
+			}
+		}
+	}
+	makeBenchmark("Uncompressed (separate files)", "open small files", files * records * int(sizeof(std::int32_t)), files, [&] {
+		std::int64_t sum = 0;
+		for (int i = 0; i < files; i++) {
+			const MemoryMappedFile<std::int32_t, MemoryMappedFileUncompressed> file("benchmark_small_" + std::to_string(i));
+			sum += file[records - 1];
+		}
+		sink = int(sum);
+	});
+	makeBenchmark("Packed", "open small files", files * records * int(sizeof(std::int32_t)), files, [&] {
+		MemoryMappedFilePack pack("benchmark_pack");
+		std::int64_t sum = 0;
+		for (int i = 0; i < files; i++) {
+			const MemoryMappedFile<std::int32_t, MemoryMappedFilePacked> file("small_" + std::to_string(i), pack);
+			sum += file[records - 1];
+		}
+		sink = int(sum);
+	});
+	for (int i = 0; i < files; i++)
+		std::remove(("benchmark_small_" + std::to_string(i) + "." + MemoryMappedFileUncompressed::standardExtension()).c_str());
+	std::remove(("benchmark_pack." + MemoryMappedFilePack::standardExtension()).c_str());
+}
+
+#ifndef _WIN32
+void benchmarkSendRange(int size)
+{
+	// Sends the whole file into a local socket whose other end is drained by another thread
+	const int count = size / int(sizeof(std::int64_t));
+	{
+		MemoryMappedFile<std::int64_t, MemoryMappedFileUncompressed> file("benchmark_send");
+		file.clear();
+		for (int i = 0; i < count; i++)
+			file.push_back(i);
+	}
+	auto measure = [&] (const std::string &backend, const std::function<void(int)> &send) {
+		int sockets[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0)
+			return;
+		std::thread draining([&] {
+			std::vector<char> buffer(1 << 16);
+			while (::read(sockets[1], buffer.data(), buffer.size()) > 0);
+		});
+		makeBenchmark(backend, "send to socket", size, 1, [&] { send(sockets[0]); });
+		close(sockets[0]);
+		draining.join();
+		close(sockets[1]);
+	};
+	measure("Uncompressed (read and write)", [&] (int socket) {
+		const MemoryMappedFile<std::int64_t, MemoryMappedFileUncompressed> file("benchmark_send");
+		std::vector<std::int64_t> buffer(1 << 13);
+		for (int i = 0; i < count; i += int(buffer.size())) {
+			const int part = std::min(int(buffer.size()), count - i);
+			for (int j = 0; j < part; j++)
+				buffer[j] = file[i + j];
+			if (write(socket, buffer.data(), part * sizeof(std::int64_t)) != ssize_t(part * sizeof(std::int64_t)))
+				throw(std::runtime_error("Could not write into the socket"));
+		}
+	});
+	measure("Uncompressed (sendRange)", [&] (int socket) {
+		const MemoryMappedFile<std::int64_t, MemoryMappedFileUncompressed> file("benchmark_send");
+		file.sendRange(socket, 0, count);
+	});
+	MemoryMappedFileUncompressed("benchmark_send").clear();
+}
+#endif
+
+void benchmarkChangeLog(int size)
+{
+	// Brings a copy up to date after a few records were modified and a few appended, by copying the file or by applying the delta
+	const int count = size / int(sizeof(std::int64_t));
+	const std::string primaryName = "benchmark_primary." + MemoryMappedFileUncompressed::standardExtension();
+	const std::string copyName = "benchmark_copy." + MemoryMappedFileUncompressed::standardExtension();
+	std::remove(MemoryMappedFileChangeLog::logFileName(primaryName).c_str());
+	MemoryMappedFile<std::int64_t, MemoryMappedFileUncompressed> primary("benchmark_primary", MemoryMappedFileOptions{ .changeLog = true });
+	primary.clear();
+	for (int i = 0; i < count; i++)
+		primary.push_back(i);
+	primary.flush();
+	std::filesystem::copy_file(primaryName, copyName, std::filesystem::copy_options::overwrite_existing);
+	MemoryMappedFileChangeLog log(primaryName);
+	log.seek(MemoryMappedFileChangeLog::lastSequence(primaryName));
+
+	std::mt19937 generator(13);
+	for (int i = 0; i < 100; i++)
+		primary[int(generator() % unsigned(count))] = -i;
+	for (int i = 0; i < 1000; i++)
+		primary.push_back(count + i);
+	primary.flush();
+	makeBenchmark("Uncompressed (copying the file)", "replica catch-up", size, 1, [&] {
+		std::filesystem::copy_file(primaryName, copyName, std::filesystem::copy_options::overwrite_existing);
+	});
+	makeBenchmark("Uncompressed (applying the delta)", "replica catch-up", size, 1, [&] {
+		MemoryMappedFileUncompressed copy("benchmark_copy");
+		MemoryMappedFileDelta delta;
+		while (log.next(delta))
+			copy.apply(delta);
+	});
+	primary.clear();
+	primary.flush();
+	MemoryMappedFileUncompressed("benchmark_copy").clear();
+	std::remove(MemoryMappedFileChangeLog::logFileName(primaryName).c_str());
+}
+
+void benchmarkPreallocation()
+{
+	// Appends small batches of records to a log in append-only mode, flushing after each of them
+	const int batches = 20000;
+	const int batchRecords = 8;
+	for (int preallocation : { 0, 1 << 22 }) {
+		const std::string backend = preallocation ? "Uncompressed (preallocation)" : "Uncompressed (no preallocation)";
+		MemoryMappedFileUncompressed("benchmark_preallocation").clear();
+		makeBenchmark(backend, "flushed appends", batches * batchRecords * long(sizeof(std::int64_t)), batches, [&] {
+			MemoryMappedFile<std::int64_t, MemoryMappedFileUncompressed> file("benchmark_preallocation",
+					MemoryMappedFileOptions{ .appendOnly = true, .preallocation = preallocation });
+			for (int i = 0; i < batches; i++) {
+				for (int j = 0; j < batchRecords; j++)
+					file.push_back(i * batchRecords + j);
+				file.flush();
+			}
+		});
+	}
+	MemoryMappedFileUncompressed("benchmark_preallocation").clear();
+}
+
+#ifndef _WIN32
+long cachedKilobytes(const std::string &fileName)
+{
+	// Counts the pages of a file kept in the system's cache
+	const int descriptor = open(fileName.c_str(), O_RDONLY);
+	struct stat status;
+	if (descriptor < 0 || fstat(descriptor, &status) != 0 || status.st_size == 0)
+		return 0;
+	const long pageSize = sysconf(_SC_PAGESIZE);
+	void* mapped = mmap(nullptr, std::size_t(status.st_size), PROT_READ, MAP_SHARED, descriptor, 0);
+	close(descriptor);
+	if (mapped == MAP_FAILED)
+		return 0;
+	std::vector<unsigned char> resident(std::size_t((status.st_size + pageSize - 1) / pageSize));
+	long cached = 0;
+	if (mincore(mapped, std::size_t(status.st_size), resident.data()) == 0)
+		for (unsigned char page : resident)
+			cached += page & 1;
+	munmap(mapped, std::size_t(status.st_size));
+	return cached * pageSize / 1024;
+}
+
+void benchmarkDirectIo(int size)
+{
+	// Writes a file and scans it once, with and without bypassing the system's cache, starting with nothing cached
+	const int count = size / int(sizeof(std::int64_t));
+	const std::string fileName = "benchmark_direct." + MemoryMappedFileUncompressed::standardExtension();
+	for (bool directIo : { false, true }) {
+		const std::string backend = directIo ? "Uncompressed (direct)" : "Uncompressed (cached)";
+		const MemoryMappedFileOptions options = { .directIo = directIo };
+		makeBenchmark(backend, "one-shot write", size, count, [&] {
+			MemoryMappedFile<std::int64_t, MemoryMappedFileUncompressed> file("benchmark_direct", options);
+			file.clear();
+			for (int i = 0; i < count; i++)
+				file.push_back(i);
+		});
+		MemoryMappedFile<std::int64_t, MemoryMappedFileUncompressed>("benchmark_direct").dropCache(0, count);
+		makeBenchmark(backend, "one-shot scan", size, count, [&] {
+			const MemoryMappedFile<std::int64_t, MemoryMappedFileUncompressed> file("benchmark_direct", options);
+			std::int64_t sum = 0;
+			for (int i = 0; i < count; i++)
+				sum += file[i];
+			sink = int(sum);
+		});
+		std::cerr << backend << " left " << cachedKilobytes(fileName) << " kB of the file in the system's cache" << std::endl;
+	}
+	MemoryMappedFileUncompressed("benchmark_direct").clear();
+}
+#endif
+
+void benchmarkTailing()
+{
+	// Every record holds the time when it was appended, so that the reader can measure how long it took to get it
+	const int records = 1000;
+	{
+		MemoryMappedFile<std::int64_t, MemoryMappedFileUncompressed> writer("benchmark_tail");
+		writer.clear();
+	}
+	MemoryMappedFile<std::int64_t, MemoryMappedFileUncompressed> reader("benchmark_tail");
+	MemoryMappedFileTail<std::int64_t> tail(reader);
+	reader.size(); // Starts watching the file before anything is appended
+	std::thread writing([&] {
+		MemoryMappedFile<std::int64_t, MemoryMappedFileUncompressed> writer("benchmark_tail");
+		for (int i = 0; i < records; i++) {
+			writer.push_back(std::chrono::steady_clock::now().time_since_epoch().count());
+			writer.flush();
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+		}
+	});
+	std::chrono::steady_clock::duration totalLatency = {};
+	int delivered = 0;
+	while (delivered < records && tail.next([&] (std::span<const std::int64_t> appended) {
+		const std::int64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
+		for (std::int64_t appendedAt : appended)
+			totalLatency += std::chrono::steady_clock::duration(now - appendedAt);
+		delivered += int(appended.size());
+	}, 1000));
+	writing.join();
+	// The time is the sum of latencies, so that time per operation is the average latency
+	results.push_back({ "Uncompressed", "tailing latency", delivered * long(sizeof(std::int64_t)), delivered,
+			std::chrono::duration<double>(totalLatency).count(), 0 });
+}
+
+void writeResults(std::ostream &out, bool json)
+{
+	auto perOperation = [] (const BenchmarkResult &result) {
+		return result.operations ? result.seconds / result.operations * 1e9 : 0;
+	};
+	auto throughput = [] (const BenchmarkResult &result) {
+		return result.seconds > 0 ? result.bytes / result.seconds / (1 << 20) : 0;
+	};
+	if (json) {
+		out << "[" << std::endl;
+		for (unsigned int i = 0; i < results.size(); i++) {
+			const BenchmarkResult &result = results[i];
+			out << "\t{ \"backend\": \"" << result.backend << "\", \"scenario\": \"" << result.scenario << "\", \"bytes\": " << result.bytes
+					<< ", \"operations\": " << result.operations << ", \"seconds\": " << result.seconds << ", \"megabytes_per_second\": "
+					<< throughput(result) << ", \"nanoseconds_per_operation\": " << perOperation(result) << ", \"peak_memory_growth_kb\": "
+					<< result.peakMemoryGrowth << " }" << (i + 1 < results.size() ? "," : "") << std::endl;
+		}
+		out << "]" << std::endl;
+	} else {
+		out << "backend,scenario,bytes,operations,seconds,megabytes_per_second,nanoseconds_per_operation,peak_memory_growth_kb" << std::endl;
+		for (const BenchmarkResult &result : results)
+			out << result.backend << "," << result.scenario << "," << result.bytes << "," << result.operations << "," << result.seconds << ","
+					<< throughput(result) << "," << perOperation(result) << "," << result.peakMemoryGrowth << std::endl;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bool json = false;
+	long long maxSize = 64 << 20;
+	std::string output;
+	for (int i = 1; i < argc; i++) {
+		const std::string argument = argv[i];
+		if (argument == "--json")
+			json = true;
+		else if (argument == "--max-size" && i + 1 < argc)
+			maxSize = std::stoll(argv[++i]);
+		else if (argument == "--output" && i + 1 < argc)
+			output = argv[++i];
+		else {
+			std::cerr << "Usage: " << argv[0] << " [--json] [--max-size BYTES] [--output FILE]" << std::endl;
+			return 1;
+		}
+	}
+	// Indexes are ints, so files can't be larger than 2 GiB
+	maxSize = std::min<long long>(maxSize, 1 << 30);
+
+	std::vector<Backend> backends{ { "Uncompressed", [] (const std::string &name) { return std::make_unique<MemoryMappedFileUncompressed>(name); } },
+			{ "Uncompressed with checksums", [] (const std::string &name) {
+				return std::make_unique<MemoryMappedFileUncompressed>(name, MemoryMappedFileOptions{ .checksums = true });
+			} },
+			{ "Encoded", [] (const std::string &name) {
+				// The sample consists of slowly changing 32-bit values
+				return std::make_unique<MemoryMappedFileEncoded>(name, MemoryMappedFileLayout(4, { { 0, 4, MemoryMappedFileTransform::DELTA } }));
+			} } };
+#ifdef MEMORY_MAPPED_FILE_LZMA
+	backends.push_back({ "Compressed", [] (const std::string &name) { return std::make_unique<MemoryMappedFileCompressed>(name); } });
+#endif
+
+	for (long long size = 1 << 10; size <= maxSize; size *= 16)
+		for (const Backend &backend : backends)
+			benchmarkBackend(backend, int(size));
+
+	benchmarkMemoryResources(int(std::min<long long>(maxSize, 256 << 20)));
+	benchmarkDispatch(int(maxSize));
+	benchmarkAppendOnly(int(maxSize));
+	benchmarkZoneMap(int(maxSize));
+	benchmarkSort(int(maxSize));
+	benchmarkParallelScan(int(maxSize));
+	benchmarkPack();
+#ifndef _WIN32
+	benchmarkSendRange(int(maxSize));
+#endif
+	benchmarkChangeLog(int(maxSize));
+	benchmarkPreallocation();
+#ifndef _WIN32
+	benchmarkDirectIo(int(maxSize));
+#endif
+	benchmarkTailing();
+
+	if (output.empty()) {
+		writeResults(std::cout, json);
+	} else {
+		std::ofstream file(output);
+		writeResults(file, json);
+	}
+
+	return 0;
+}
@@ -0,0 +1,196 @@
+#include "memory_mapped_file_change_log.hpp"
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+// Each delta is stored as its length, the serialised delta and its length again, so that the last one can be found from the end
+constexpr int RECORD_FRAMING_SIZE = 2 * sizeof(std::uint32_t);
+constexpr int DELTA_HEADER_SIZE = sizeof(std::uint64_t) + sizeof(std::int32_t) + sizeof(std::uint32_t);
+
+namespace {
+// Gets the size of the part of the log with complete deltas and the sequence number of the last one, a delta cut off by a crash may follow it
+std::uint64_t completeSize(const std::string &logName, std::uint64_t &fileSize, std::uint64_t &sequence)
+{
+	fileSize = 0;
+	sequence = 0;
+	std::ifstream file(logName, std::ifstream::binary | std::ifstream::ate);
+	if (!file.good())
+		return 0;
+	fileSize = std::uint64_t(file.tellg());
+	auto readAt = [&] (std::uint64_t position, void* into, std::size_t size) {
+		file.seekg(std::streamoff(position));
+		file.read(reinterpret_cast<char*>(into), std::streamsize(size));
+		return file.good();
+	};
+	auto completeAt = [&] (std::uint64_t position, std::uint32_t length, std::uint32_t other) {
+		return length >= DELTA_HEADER_SIZE && position + RECORD_FRAMING_SIZE + length <= fileSize && other == length;
+	};
+
+	// Usually the last delta is complete and is found from the end
+	std::uint32_t length = 0;
+	std::uint32_t leading = 0;
+	std::uint64_t found = 0;
+	if (fileSize >= std::uint64_t(RECORD_FRAMING_SIZE + DELTA_HEADER_SIZE) && readAt(fileSize - sizeof(length), &length, sizeof(length))
+			&& std::uint64_t(length) + RECORD_FRAMING_SIZE <= fileSize
+			&& readAt(fileSize - RECORD_FRAMING_SIZE - length, &leading, sizeof(leading))
+			&& completeAt(fileSize - RECORD_FRAMING_SIZE - length, length, leading)
+			&& readAt(fileSize - sizeof(length) - length, &found, sizeof(found))) {
+		sequence = found;
+		return fileSize;
+	}
+
+	// Otherwise all deltas are checked from the beginning
+	file.clear();
+	std::uint64_t position = 0;
+	std::uint32_t trailing = 0;
+	while (readAt(position, &length, sizeof(length)) && readAt(position + sizeof(length) + length, &trailing, sizeof(trailing))
+			&& completeAt(position, length, trailing)
+			&& readAt(position + sizeof(length), &found, sizeof(found))) {
+		position += RECORD_FRAMING_SIZE + length;
+		sequence = found;
+	}
+	return position;
+}
+}
+
+std::vector<std::uint8_t> MemoryMappedFileDelta::serialise() const
+{
+	std::vector<std::uint8_t> serialised;
+	auto put = [&] (const void* from, std::size_t size) {
+		const std::uint8_t* bytes = reinterpret_cast<const std::uint8_t*>(from);
+		serialised.insert(serialised.end(), bytes, bytes + size);
+	};
+	const std::uint32_t rangeCount = std::uint32_t(ranges.size());
+	put(&sequence, sizeof(sequence));
+	put(&size, sizeof(size));
+	put(&rangeCount, sizeof(rangeCount));
+	for (const Range &range : ranges) {
+		const std::uint32_t length = std::uint32_t(range.bytes.size());
+		put(&range.offset, sizeof(range.offset));
+		put(&length, sizeof(length));
+		put(range.bytes.data(), range.bytes.size());
+	}
+	return serialised;
+}
+
+MemoryMappedFileDelta MemoryMappedFileDelta::deserialise(const std::uint8_t* data, int size)
+{
+	int position = 0;
+	auto take = [&] (void* into, int taken) {
+		if (taken < 0 || position + taken > size)
+			throw(std::runtime_error("Delta is damaged"));
+		memcpy(into, data + position, std::size_t(taken));
+		position += taken;
+	};
+	MemoryMappedFileDelta delta;
+	std::uint32_t rangeCount = 0;
+	take(&delta.sequence, sizeof(delta.sequence));
+	take(&delta.size, sizeof(delta.size));
+	take(&rangeCount, sizeof(rangeCount));
+	for (std::uint32_t i = 0; i < rangeCount; i++) {
+		Range range;
+		std::uint32_t length = 0;
+		take(&range.offset, sizeof(range.offset));
+		take(&length, sizeof(length));
+		if (range.offset < 0 || std::int64_t(range.offset) + length > delta.size || length > std::uint32_t(size - position))
+			throw(std::runtime_error("Delta is damaged"));
+		range.bytes.resize(length);
+		take(range.bytes.data(), int(length));
+		delta.ranges.push_back(std::move(range));
+	}
+	if (delta.size < 0 || position != size)
+		throw(std::runtime_error("Delta is damaged"));
+	return delta;
+}
+
+MemoryMappedFileChangeLog::MemoryMappedFileChangeLog(const std::string &fileName) :
+	fileName_(fileName),
+	position_(0),
+	sequence_(0)
+{
+}
+
+bool MemoryMappedFileChangeLog::readHeader(std::uint32_t &length, std::uint64_t &sequence)
+{
+	// The file is opened again if it wasn't there before or reading failed, it's read only when complete deltas are there
+	if (!file_.is_open() || !file_.good()) {
+		file_ = std::ifstream(logFileName(fileName_), std::ifstream::binary);
+		if (!file_.good())
+			return false;
+	}
+	file_.seekg(0, std::ifstream::end);
+	const std::uint64_t fileSize = std::uint64_t(file_.tellg());
+	if (position_ + RECORD_FRAMING_SIZE + DELTA_HEADER_SIZE > fileSize)
+		return false;
+	file_.seekg(std::streamoff(position_));
+	file_.read(reinterpret_cast<char*>(&length), sizeof(length));
+	file_.read(reinterpret_cast<char*>(&sequence), sizeof(sequence));
+	if (!file_.good())
+		return false;
+	return position_ + RECORD_FRAMING_SIZE + length <= fileSize;
+}
+
+bool MemoryMappedFileChangeLog::next(MemoryMappedFileDelta &delta)
+{
+	std::uint32_t length = 0;
+	std::uint64_t sequence = 0;
+	if (!readHeader(length, sequence))
+		return false;
+	std::vector<std::uint8_t> serialised(length);
+	file_.seekg(std::streamoff(position_ + sizeof(std::uint32_t)));
+	file_.read(reinterpret_cast<char*>(serialised.data()), std::streamsize(length));
+	if (!file_.good())
+		throw(std::runtime_error("Could not read change log " + logFileName(fileName_)));
+	delta = MemoryMappedFileDelta::deserialise(serialised.data(), int(length));
+	position_ += RECORD_FRAMING_SIZE + length;
+	sequence_ = delta.sequence;
+	return true;
+}
+
+void MemoryMappedFileChangeLog::seek(std::uint64_t sequence)
+{
+	position_ = 0;
+	sequence_ = 0;
+	std::uint32_t length = 0;
+	std::uint64_t found = 0;
+	while (readHeader(length, found) && found <= sequence) {
+		position_ += RECORD_FRAMING_SIZE + length;
+		sequence_ = found;
+	}
+}
+
+std::uint64_t MemoryMappedFileChangeLog::sequence() const
+{
+	return sequence_;
+}
+
+std::uint64_t MemoryMappedFileChangeLog::lastSequence(const std::string &fileName)
+{
+	std::uint64_t fileSize = 0;
+	std::uint64_t sequence = 0;
+	completeSize(logFileName(fileName), fileSize, sequence);
+	return sequence;
+}
+
+void MemoryMappedFileChangeLog::write(const std::string &fileName, MemoryMappedFileDelta &delta)
+{
+	std::uint64_t fileSize = 0;
+	std::uint64_t sequence = 0;
+	const std::uint64_t complete = completeSize(logFileName(fileName), fileSize, sequence);
+	if (complete < fileSize)
+		std::filesystem::resize_file(logFileName(fileName), complete); // Removes a delta that wasn't finished
+	delta.sequence = sequence + 1;
+	const std::vector<std::uint8_t> serialised = delta.serialise();
+	const std::uint32_t length = std::uint32_t(serialised.size());
+	std::ofstream file(logFileName(fileName), std::fstream::app | std::fstream::binary);
+	if (!file.good()) throw(std::runtime_error("Could not open file " + logFileName(fileName)));
+	file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+	file.write(reinterpret_cast<const char*>(serialised.data()), std::streamsize(serialised.size()));
+	file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+	if (!file.good()) throw(std::runtime_error("Could not write to file " + logFileName(fileName)));
+}
+
+std::string MemoryMappedFileChangeLog::logFileName(const std::string &fileName)
+{
+	return fileName + ".changes";
+}
@@ -0,0 +1,119 @@
+/*!
+* \file memory_mapped_file_change_log.hpp
+* \date 2026/10/18 23:55
+*
+* \author Ján Dugáček
+*
+* \brief Log of changes written by flushes, for keeping copies of files up to date
+*
+* An uncompressed file opened with the changeLog option writes a delta into a sidecar file whenever it's flushed. The delta holds the size
+* of the file after the flush, the contents of the modified pages and the appended bytes, and a sequence number one greater than that of
+* the previous delta. MemoryMappedFileChangeLog reads the deltas one after another, so that they can be sent elsewhere in serialised form
+* and applied to a copy of the file with MemoryMappedFileUncompressed::apply(), writing only the changed bytes.
+*
+* \note Only flushes into the file's own name are logged
+* \note The log grows until it's removed, sequence numbers start from 1 again if it's removed
+* \note A delta is written only after the file was written, a delta left incomplete by a crash is ignored and overwritten by the next one
+*/
+
+#ifndef MEMORY_MAPPED_FILE_CHANGE_LOG_H
+#define MEMORY_MAPPED_FILE_CHANGE_LOG_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+struct MemoryMappedFileDelta {
+	struct Range {
+		int offset;
+		std::vector<std::uint8_t> bytes;
+	};
+
+	std::uint64_t sequence = 0;
+	int size = 0; // Size of the file after the change
+	std::vector<Range> ranges;
+
+	/*!
+	* \brief Converts the delta into bytes that can be stored or sent
+	*
+	* \return The bytes
+	*/
+	std::vector<std::uint8_t> serialise() const;
+
+	/*!
+	* \brief Reads a delta converted by serialise()
+	*
+	* \param The bytes
+	* \param Their number
+	* \return The delta
+	* \note Throws std::runtime_error if the bytes aren't a valid delta
+	*/
+	static MemoryMappedFileDelta deserialise(const std::uint8_t* data, int size);
+};
+
+class MemoryMappedFileChangeLog {
+	std::string fileName_;
+	std::ifstream file_;
+	std::uint64_t position_;
+	std::uint64_t sequence_;
+
+	bool readHeader(std::uint32_t &length, std::uint64_t &sequence);
+
+public:
+	/*!
+	* \brief Constructor, starts reading from the oldest delta
+	*
+	* \param Name of the logged file, with suffix
+	*/
+	MemoryMappedFileChangeLog(const std::string &fileName);
+
+	/*!
+	* \brief Reads the next delta
+	*
+	* \param Where to store it
+	* \return Whether there was a delta, if not, it can be called later again to get deltas written meanwhile
+	*/
+	bool next(MemoryMappedFileDelta &delta);
+
+	/*!
+	* \brief Skips deltas up to a sequence number, reading only their headers
+	*
+	* \param Sequence number of the last delta that is not needed, like the last one applied to a copy
+	*/
+	void seek(std::uint64_t sequence);
+
+	/*!
+	* \brief Gets the sequence number of the last delta read
+	*
+	* \return The sequence number, zero if none was read
+	*/
+	std::uint64_t sequence() const;
+
+	/*!
+	* \brief Gets the sequence number of the newest delta in a log
+	*
+	* \param Name of the logged file, with suffix
+	* \return The sequence number, zero if the log is empty
+	*/
+	static std::uint64_t lastSequence(const std::string &fileName);
+
+	/*!
+	* \brief Writes a delta at the end of a log, giving it the next sequence number
+	*
+	* \param Name of the logged file, with suffix
+	* \param The delta, its sequence number is set
+	* \note An incomplete delta at the end of the log is removed first
+	*/
+	static void write(const std::string &fileName, MemoryMappedFileDelta &delta);
+
+	/*!
+	* \brief Gets the name of the sidecar file of a log
+	*
+	* \param Name of the logged file, with suffix
+	* \return Name of the log
+	*/
+	static std::string logFileName(const std::string &fileName);
+};
+
+#endif //MEMORY_MAPPED_FILE_CHANGE_LOG_H
@@ -0,0 +1,75 @@
+#include "memory_mapped_file_checksum.hpp"
+#include <array>
+#include <cstring>
+#if defined(__x86_64__) || defined(_M_X64)
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#define MEMORY_MAPPED_FILE_CRC32_INSTRUCTION
+#endif
+
+namespace {
+constexpr std::uint32_t CASTAGNOLI_POLYNOMIAL = 0x82f63b78; // Reversed
+
+std::array<std::uint32_t, 256> makeTable()
+{
+	std::array<std::uint32_t, 256> table;
+	for (std::uint32_t i = 0; i < 256; i++) {
+		std::uint32_t entry = i;
+		for (int bit = 0; bit < 8; bit++)
+			entry = (entry & 1) ? (entry >> 1) ^ CASTAGNOLI_POLYNOMIAL : entry >> 1;
+		table[i] = entry;
+	}
+	return table;
+}
+
+std::uint32_t crc32cTable(const std::uint8_t* data, std::size_t size, std::uint32_t crc)
+{
+	static const std::array<std::uint32_t, 256> table = makeTable();
+	for (std::size_t i = 0; i < size; i++)
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+#ifdef MEMORY_MAPPED_FILE_CRC32_INSTRUCTION
+#ifndef _MSC_VER
+__attribute__((target("sse4.2")))
+#endif
+std::uint32_t crc32cInstruction(const std::uint8_t* data, std::size_t size, std::uint32_t crc)
+{
+	std::uint64_t crc64 = crc;
+	std::size_t i = 0;
+	for ( ; i + 8 <= size; i += 8) {
+		std::uint64_t word;
+		std::memcpy(&word, data + i, sizeof(word));
+		crc64 = _mm_crc32_u64(crc64, word);
+	}
+	crc = std::uint32_t(crc64);
+	for ( ; i < size; i++)
+		crc = _mm_crc32_u8(crc, data[i]);
+	return crc;
+}
+
+bool hasCrc32Instruction()
+{
+#ifdef _MSC_VER
+	int registers[4];
+	__cpuid(registers, 1);
+	return (registers[2] & (1 << 20)) != 0;
+#else
+	return __builtin_cpu_supports("sse4.2");
+#endif
+}
+#endif
+}
+
+std::uint32_t crc32c(const std::uint8_t* data, std::size_t size, std::uint32_t previous)
+{
+#ifdef MEMORY_MAPPED_FILE_CRC32_INSTRUCTION
+	static const bool instruction = hasCrc32Instruction();
+	if (instruction)
+		return ~crc32cInstruction(data, size, ~previous);
+#endif
+	return ~crc32cTable(data, size, ~previous);
+}
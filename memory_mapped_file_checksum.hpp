@@ -0,0 +1,28 @@
+/*!
+* \file memory_mapped_file_checksum.hpp
+* \date 2026/10/18 18:40
+*
+* \author Ján Dugáček
+*
+* \brief CRC32C checksums
+*
+* Uses the processor's CRC32 instruction if it's available (SSE4.2 on x86), otherwise a lookup table.
+*/
+
+#ifndef MEMORY_MAPPED_FILE_CHECKSUM_H
+#define MEMORY_MAPPED_FILE_CHECKSUM_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*!
+* \brief Computes the CRC32C (Castagnoli) checksum of data
+*
+* \param Pointer to the data
+* \param Size of the data in bytes
+* \param Checksum of preceding data if the checksum is computed in parts
+* \return The checksum
+*/
+std::uint32_t crc32c(const std::uint8_t* data, std::size_t size, std::uint32_t previous = 0);
+
+#endif //MEMORY_MAPPED_FILE_CHECKSUM_H
@@ -4,6 +4,11 @@
 #include <iostream>
 #include <algorithm>
 #include <exception>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <future>
+#include <filesystem>
 
 #include "lzma_lib/Alloc.h"
 #include "lzma_lib/7zFile.h"
@@ -19,6 +24,8 @@
 constexpr float LOADED_PART_INCREMENT = 1.5;
 constexpr int LOADED_PART_MAX_INCREMENT = (1 << 15);
 constexpr int LOADED_PART_MIN_INCREMENT = (1 << 11);
+constexpr int LOADED_PART_SEQUENTIAL_INCREMENT = (1 << 21);
+constexpr int APPEND_ONLY_TAIL_LIMIT = (1 << 20);
 
 
 namespace FromLzma {
@@ -34,62 +41,161 @@ static ISzAlloc g_Alloc = { (void* (__cdecl*)(ISzAllocPtr, std::size_t))SzAlloc,
 
 constexpr uint32_t INPUT_BUFFER_SIZE = (1 << 15);
 constexpr uint32_t OUTPUT_BUFFER_SIZE = (1 << 15);
+constexpr size_t WRITE_BUFFER_SIZE = (1 << 20);
 
+// Collects the encoder's output into a large page-aligned buffer so that the file is written in few large blocks
 struct CFileSeqOutStream {
 	ISeqOutStream funcTable;
 	FILE* file;
+	Byte* buffer;
+	size_t buffered;
+	bool failed;
+	std::uint64_t written;
+	std::chrono::steady_clock::duration writingTime;
 };
 
+static bool writeMeasured(CFileSeqOutStream* stream, const void* buf, size_t size)
+{
+	const auto start = std::chrono::steady_clock::now();
+	const bool succeeded = (fwrite(buf, 1, size, stream->file) == size);
+	stream->writingTime += std::chrono::steady_clock::now() - start;
+	if (succeeded)
+		stream->written += size;
+	return succeeded;
+}
+
 struct ReadingStreamData {
-	const std::vector<std::uint8_t> &vector;
-	unsigned int position;
+	const std::pmr::vector<std::uint8_t> &vector;
+	size_t position;
 };
 
 static SRes readFromMemory(void* p, void* buf, size_t* size)
 {
-	if (*size == 0)
-		return SZ_OK;
-
 	ReadingStreamData* data = (ReadingStreamData*)((CFileSeqInStream*)p)->file.handle;
-	int sizeRead = 0;
-	for (unsigned int i = data->position; i < data->vector.size() && i < data->position + *size; i++) {
-		((std::uint8_t*)buf)[i - data->position] = data->vector[i];
-		sizeRead++;
-	}
-	*size = size_t(sizeRead);
-	data->position += size_t(sizeRead);
+	const size_t sizeRead = std::min<size_t>(*size, data->vector.size() - data->position);
+	if (sizeRead > 0)
+		memcpy(buf, data->vector.data() + data->position, sizeRead);
+	*size = sizeRead;
+	data->position += sizeRead;
 
 	return SZ_OK;
 }
 
-static size_t writeToMemory(void* pp, const void* buf, size_t size)
+static bool writeBuffered(CFileSeqOutStream* stream)
 {
-	if (size == 0)
+	if (stream->buffered > 0 && !writeMeasured(stream, stream->buffer, stream->buffered))
+		stream->failed = true;
+	stream->buffered = 0;
+	return !stream->failed;
+}
+
+static size_t writeToFile(void* pp, const void* buf, size_t size)
+{
+	CFileSeqOutStream* stream = (CFileSeqOutStream*)pp;
+	if (size == 0 || stream->failed)
+		return 0;
+	if (stream->buffered + size > WRITE_BUFFER_SIZE && !writeBuffered(stream))
 		return 0;
-	return fwrite(buf, 1, size, ((CFileSeqOutStream*)pp)->file);
+	if (size >= WRITE_BUFFER_SIZE) {
+		if (!writeMeasured(stream, buf, size)) {
+			stream->failed = true;
+			return 0;
+		}
+		return size;
+	}
+	memcpy(stream->buffer + stream->buffered, buf, size);
+	stream->buffered += size;
+	return size;
 }
 }
 
+int MemoryMappedFileCompressed::loadingStop(int until) const
+{
+	const int maxIncrement = sequential_ ? LOADED_PART_SEQUENTIAL_INCREMENT : LOADED_PART_MAX_INCREMENT;
+	return (until >= 0) ? std::max<int>(std::min<int>(int(until * LOADED_PART_INCREMENT), until + maxIncrement),
+										until + LOADED_PART_MIN_INCREMENT) : INT_MAX;
+}
+
 void MemoryMappedFileCompressed::load(int until) const
 {
+	if (options_.appendOnly)
+		throw(std::logic_error("File " + extendedFileName(fileName_) + " was opened only for appending"));
 	if (fullyLoaded() || (until >= 0 && loadedUntil_ > until)) return;
+	MemoryMappedFileStopwatch stopwatch(statistics_, MemoryMappedFileTiming::LOAD);
+	auto useDecoded = [this] (Decoded &decoded) {
+		preserveAllPages();
+		const_cast<std::pmr::vector<std::uint8_t>&>(data_).swap(decoded.data);
+		loadedUntil_ = int(data_.size());
+		fileSize_ = decoded.fileSize;
+		statistics_.add(MemoryMappedFileCounter::LOADS);
+		statistics_.add(MemoryMappedFileCounter::BYTES_READ, decoded.bytesRead);
+		statistics_.record(MemoryMappedFileTiming::DECODE, decoded.decodingTime);
+		updateResidentBytes();
+	};
+
+	if (prefetched_.valid()) {
+		// Decoding in the background has started earlier, so it can't be further away than decoding again
+		Decoded decoded = prefetched_.get();
+		if (int(decoded.data.size()) > loadedUntil_ && !modified_)
+			useDecoded(decoded);
+		if (fullyLoaded() || (until >= 0 && loadedUntil_ > until)) return;
+	}
 
-	std::unique_ptr<CLzmaDec> lzmaState;
+	Decoded decoded = decode(extendedFileName(fileName_), loadingStop(until), memoryResource());
+	useDecoded(decoded);
+}
 
-	int stopAt = (until >= 0) ? std::max<int>(std::min<int>(int(until * LOADED_PART_INCREMENT), until + LOADED_PART_MAX_INCREMENT),
-											  until + LOADED_PART_MIN_INCREMENT) : INT_MAX;
+bool MemoryMappedFileCompressed::sizeFromHeader(const std::uint8_t* header, std::uint64_t &size)
+{
+	size = 0;
+	bool archiveHasSize = false;
+	for (int i = 0; i < 8; i++) {
+		std::uint8_t b = header[LZMA_PROPS_SIZE + i];
+		if (b != 0xFF)
+			archiveHasSize = true;
+		size += (UInt64)b << (i * 8);
+	}
+	return archiveHasSize;
+}
 
-	FILE* input = fopen(extendedFileName(fileName_).c_str(), "rb");
-	if (input == nullptr) {
-		fileSize_ = 0;
-		return;
+std::string MemoryMappedFileCompressed::framesFileName(const std::string &path)
+{
+	return path + ".frames";
+}
+
+std::vector<MemoryMappedFileCompressed::Frame> MemoryMappedFileCompressed::readFrames(const std::string &path)
+{
+	std::vector<Frame> frames;
+	FILE* list = fopen(framesFileName(path).c_str(), "rb");
+	if (list == nullptr)
+		return frames;
+	std::error_code error;
+	const std::uint64_t archiveSize = std::filesystem::file_size(path, error);
+	Frame frame;
+	while (fread(&frame, sizeof(Frame), 1, list) == 1) {
+		// Frames that aren't entirely in the archive were being written when the program stopped
+		const Frame previous = frames.empty() ? Frame{ 0, 0 } : frames.back();
+		if (error || frame.end > archiveSize || frame.end <= previous.end || frame.decodedEnd < previous.decodedEnd)
+			break;
+		frames.push_back(frame);
 	}
+	fclose(list);
+	return frames;
+}
+
+void MemoryMappedFileCompressed::decodeFrame(FILE* input, std::uint64_t begin, std::uint64_t end, int stopAt, Decoded &decoded)
+{
+	std::pmr::vector<std::uint8_t> &data = decoded.data;
+	const int frameStart = int(data.size());
+	std::uint64_t remaining = end - begin;
+	std::unique_ptr<CLzmaDec> lzmaState;
+
+	if (fseek(input, long(begin), SEEK_SET) != 0)
+		throw(std::runtime_error("Archive is truncated"));
 
 	ELzmaStatus status;
 	bool corrupt = false; // bool corrupt = !government.isCorrupt(); // sets variable to false
 
-	//std::cout << "Initialising " << extendedFileName(fileName_) << " ..." << std::endl;
-
 	lzmaState = std::make_unique<CLzmaDec>();
 
 	/* header: 5 bytes of LZMA properties and 8 bytes of uncompressed size */
@@ -98,98 +204,114 @@ void MemoryMappedFileCompressed::load(int until) const
 	/* Read and parse header */
 
 	const size_t lengthRead = fread(header, 1, sizeof(header), input);
-	if (lengthRead != sizeof(header)) {
+	decoded.bytesRead += std::int64_t(lengthRead);
+	if (lengthRead != sizeof(header) || remaining < sizeof(header))
 		throw(std::runtime_error("Archive header is broken"));
-	}
+	remaining -= sizeof(header);
 
-	bool archiveHasSize = false;
-	fileSize_ = 0;
-	for (int i = 0; i < 8; i++) {
-		std::uint8_t b = header[LZMA_PROPS_SIZE + i];
-		if (b != 0xFF)
-			archiveHasSize = true;
-		fileSize_ += (UInt64)b << (i * 8);
-	}
-	if (!archiveHasSize)
-		fileSize_ = -1;
+	std::uint64_t frameSize = 0;
+	const bool archiveHasSize = sizeFromHeader(header, frameSize);
 
 	LzmaDec_Construct(lzmaState.get());
 	int result = LzmaDec_Allocate(lzmaState.get(), header, LZMA_PROPS_SIZE, &FromLzma::g_Alloc);
 
-	if (result != SZ_OK) {
+	if (result != SZ_OK)
 		throw(std::runtime_error("LzmaDec_Allocate failed because " + std::to_string(result)));
-	}
 
 	LzmaDec_Init(lzmaState.get());
-	//std::cout << "Successful allocation for file size " << fileSize_ << std::endl;
-
-	if (result == SZ_OK) {
-		const_cast<std::vector<std::uint8_t>&>(data_).clear();
-		loadedUntil_ = 0;
 
-		Byte inBuf[FromLzma::INPUT_BUFFER_SIZE];
-		Byte outBuf[FromLzma::OUTPUT_BUFFER_SIZE];
-		size_t inPos = 0, inSize = 0, outPos = 0;
-		LzmaDec_Init(lzmaState.get());
-		int left = fileSize_ - int(data_.size());
-		while (true) {
-			if (inPos == inSize) {
-				inSize = fread(inBuf, 1, FromLzma::INPUT_BUFFER_SIZE, input);
-				inPos = 0;
-			}
-			SizeT inProcessed = inSize - inPos;
-			SizeT outProcessed = FromLzma::OUTPUT_BUFFER_SIZE - outPos;
-			ELzmaFinishMode finishMode = LZMA_FINISH_ANY;
-			if (archiveHasSize && (int)outProcessed > left) {
-				outProcessed = (SizeT)left;
-				finishMode = LZMA_FINISH_END;
-			}
+	Byte inBuf[FromLzma::INPUT_BUFFER_SIZE];
+	Byte outBuf[FromLzma::OUTPUT_BUFFER_SIZE];
+	size_t inPos = 0, inSize = 0, outPos = 0;
+	int left = int(frameSize);
+	while (true) {
+		if (inPos == inSize) {
+			// Reading stops at the end of the frame, the next one has its own header
+			inSize = fread(inBuf, 1, size_t(std::min<std::uint64_t>(FromLzma::INPUT_BUFFER_SIZE, remaining)), input);
+			remaining -= inSize;
+			decoded.bytesRead += std::int64_t(inSize);
+			inPos = 0;
+		}
+		SizeT inProcessed = inSize - inPos;
+		SizeT outProcessed = FromLzma::OUTPUT_BUFFER_SIZE - outPos;
+		ELzmaFinishMode finishMode = LZMA_FINISH_ANY;
+		if (archiveHasSize && (int)outProcessed > left) {
+			outProcessed = (SizeT)left;
+			finishMode = LZMA_FINISH_END;
+		}
 
-			result = LzmaDec_DecodeToBuf(lzmaState.get(), outBuf + outPos, &outProcessed,
-										 inBuf + inPos, &inProcessed, finishMode, &status);
-			inPos += (UInt32)inProcessed;
-			outPos += outProcessed;
-			left -= outProcessed;
-
-			if (input != nullptr) {
-				for (unsigned int i = 0; i < outPos; i++) {
-					const_cast<std::vector<std::uint8_t>&>(data_).push_back(outBuf[i]);
-					loadedUntil_++;
-				}
-			}
-			outPos = 0;
+		result = LzmaDec_DecodeToBuf(lzmaState.get(), outBuf + outPos, &outProcessed,
+									 inBuf + inPos, &inProcessed, finishMode, &status);
+		inPos += (UInt32)inProcessed;
+		outPos += outProcessed;
+		left -= outProcessed;
 
-			if (result != SZ_OK || (archiveHasSize && left == 0)) {
-				if (result != SZ_OK) std::cout << "Decompression broke" << std::endl;
-				break;
-			}
+		data.insert(data.end(), outBuf, outBuf + outPos);
+		outPos = 0;
 
-			if (inProcessed == 0 && outProcessed == 0) {
-				if (archiveHasSize || status != LZMA_STATUS_FINISHED_WITH_MARK)
-					corrupt = true;
-				break;
-			}
+		if (result != SZ_OK || (archiveHasSize && left == 0)) {
+			if (result != SZ_OK) std::cout << "Decompression broke" << std::endl;
+			break;
+		}
 
-			if (int(data_.size()) >= stopAt) break;
+		if (inProcessed == 0 && outProcessed == 0) {
+			if (archiveHasSize || status != LZMA_STATUS_FINISHED_WITH_MARK)
+				corrupt = true;
+			break;
 		}
+
+		if (int(data.size()) >= stopAt) break;
 	}
 
-	if (!archiveHasSize) fileSize_ = int(data_.size());
+	decoded.fileSize = archiveHasSize ? frameStart + int(frameSize) : int(data.size());
 
-	fclose(input);
+	LzmaDec_Free(lzmaState.get(), &FromLzma::g_Alloc);
 
 	if (result != SZ_OK)
 		throw(std::runtime_error("Decompression problem " + std::to_string(result)));
 
-	//   if (m_lastByteRead == size()) {
-	LzmaDec_Free(lzmaState.get(), &FromLzma::g_Alloc);
-	//   }
-
 	if (corrupt)
 		throw(std::runtime_error("Archive seems to be corrupted (has size: " + std::to_string(archiveHasSize) + " status: " +
 								 std::to_string(status) + ")"));
 }
 
+MemoryMappedFileCompressed::Decoded MemoryMappedFileCompressed::decode(const std::string &path, int stopAt, std::pmr::memory_resource* memory)
+{
+	const auto start = std::chrono::steady_clock::now();
+	Decoded decoded = { std::pmr::vector<std::uint8_t>(memory), 0, 0, {} };
+
+	FILE* input = fopen(path.c_str(), "rb");
+	if (input == nullptr)
+		return decoded;
+
+	// Archives that were appended to are a sequence of frames, others are a single frame that ends with the file
+	const std::vector<Frame> frames = readFrames(path);
+	try {
+		if (frames.empty()) {
+			decodeFrame(input, 0, UINT64_MAX, stopAt, decoded);
+		} else {
+			std::uint64_t begin = 0;
+			for (const Frame &frame : frames) {
+				decodeFrame(input, begin, frame.end, stopAt, decoded);
+				if (int(decoded.data.size()) >= stopAt)
+					break;
+				if (decoded.data.size() != frame.decodedEnd)
+					throw(std::runtime_error("Archive seems to be corrupted (a frame has a wrong size)"));
+				begin = frame.end;
+			}
+			decoded.fileSize = int(frames.back().decodedEnd);
+		}
+	}
+	catch(...) {
+		fclose(input);
+		throw;
+	}
+	fclose(input);
+
+	decoded.decodingTime = std::chrono::steady_clock::now() - start;
+	return decoded;
+}
+
 void MemoryMappedFileCompressed::load(const std::string &fileName, int until)
 {
 	if (fileName != fileName_) {
@@ -198,7 +320,8 @@ void MemoryMappedFileCompressed::load(const std::string &fileName, int until)
 		fileName_ = fileName;
 	}
 
-	load(until);
+	if (!options_.appendOnly)
+		load(until);
 }
 
 void MemoryMappedFileCompressed::flush() const
@@ -209,33 +332,59 @@ void MemoryMappedFileCompressed::flush() const
 
 void MemoryMappedFileCompressed::flush(const std::string &fileName) const
 {
+	if (options_.appendOnly) {
+		// The file was cleared if modified, otherwise the tail is written as a new frame behind the existing ones
+		if (!modified_ && tail_.empty())
+			return;
+		MemoryMappedFileStopwatch stopwatch(statistics_, MemoryMappedFileTiming::FLUSH);
+		if (modified_)
+			writeArchive(fileName, tail_);
+		else
+			appendFrame(fileName);
+		if (fileSize_ >= 0)
+			fileSize_ += int(tail_.size());
+		tail_.clear();
+		modified_ = false;
+		acknowledgeChanges();
+		return;
+	}
+
 	if (fileName == fileName_) {
 		if (!modified_)
 			return;
 	}
 
+	discardPrefetched(); // It would be reading the file while it's overwritten
 	//std::cout << "Flushing into " << extendedFileName(fileName) << std::endl;
-	FILE* output = fopen(extendedFileName(fileName).c_str(), "wb");
-	if (!output) {
-		std::cerr << "Cannot save the file" << std::endl; // Better shouldn't throw here
-		throw(std::runtime_error("Cannot save file " + extendedFileName(fileName)));
-	}
+	MemoryMappedFileStopwatch stopwatch(statistics_, MemoryMappedFileTiming::FLUSH);
+	writeArchive(fileName, data_);
+	fileSize_ = data_.size();
+	loadedUntil_ = fileSize_;
+	updateResidentBytes();
+	acknowledgeChanges();
+}
 
+std::uint64_t MemoryMappedFileCompressed::writeFrame(FILE* output, const std::pmr::vector<std::uint8_t> &contents) const
+{
 	CLzmaEncHandle enc = LzmaEnc_Create(&g_Alloc);
 	if (enc == nullptr) {
-		std::cerr << "Cannot create encoder to save the file" << std::endl; // Better shouldn't throw here
-		return;
+		std::cerr << "Cannot create encoder to save the file" << std::endl;
+		throw(std::runtime_error("Cannot create encoder"));
 	}
 
 	CFileSeqInStream inStream;
 	inStream.vt.Read = (SRes(*)(const ISeqInStream*, void* , size_t*))FromLzma::readFromMemory;
-	FromLzma::ReadingStreamData data{ data_, 0 };
+	FromLzma::ReadingStreamData data{ contents, 0 };
 	inStream.file.handle = (FILE*)&data;
 
 	FromLzma::CFileSeqOutStream outStream;
-	outStream.funcTable.Write = (size_t(*)(const ISeqOutStream*, const void* , size_t))FromLzma::writeToMemory;
+	outStream.funcTable.Write = (size_t(*)(const ISeqOutStream*, const void* , size_t))FromLzma::writeToFile;
 	outStream.file = output;
-
+	outStream.buffer = (Byte*)MidAlloc(FromLzma::WRITE_BUFFER_SIZE);
+	outStream.buffered = 0;
+	outStream.failed = (outStream.buffer == nullptr);
+	outStream.written = 0;
+	outStream.writingTime = {};
 
 	CLzmaEncProps props;
 	LzmaEncProps_Init(&props);
@@ -245,27 +394,109 @@ void MemoryMappedFileCompressed::flush(const std::string &fileName) const
 		Byte header[LZMA_PROPS_SIZE + 8];
 		size_t headerSize = LZMA_PROPS_SIZE;
 		result = LzmaEnc_WriteProperties(enc, header, &headerSize);
-		const UInt64 fileSize = data_.size();
+		const UInt64 fileSize = contents.size();
 
 		for (int i = 0; i < 8; i++)
 			header[headerSize++] = Byte(fileSize >> (8 * i));
 
-		if (headerSize == 0 || fwrite(header, 1, headerSize, output) != headerSize)
+		if (headerSize == 0 || !FromLzma::writeMeasured(&outStream, header, headerSize))
 			result = SZ_ERROR_WRITE;
 
+		const auto encodingStart = std::chrono::steady_clock::now();
+		const auto writingBefore = outStream.writingTime;
 		if (result == SZ_OK)
 			result = LzmaEnc_Encode(enc, &outStream.funcTable, &inStream.vt,
 									nullptr, &g_Alloc, &g_Alloc);
+		if (result == SZ_OK && !FromLzma::writeBuffered(&outStream))
+			result = SZ_ERROR_WRITE;
+		statistics_.record(MemoryMappedFileTiming::ENCODE, std::chrono::steady_clock::now() - encodingStart -
+				(outStream.writingTime - writingBefore));
+		statistics_.record(MemoryMappedFileTiming::WRITE, outStream.writingTime);
 	}
 	LzmaEnc_Destroy(enc, &g_Alloc, &g_Alloc);
-	fclose(output);
+	MidFree(outStream.buffer);
 
 	if (result != SZ_OK)
 		throw(std::runtime_error("Could not save compressed file"));
-	else {
-		fileSize_ = data_.size();
-		loadedUntil_ = fileSize_;
+	statistics_.add(MemoryMappedFileCounter::BYTES_WRITTEN, std::int64_t(outStream.written));
+	return outStream.written;
+}
+
+void MemoryMappedFileCompressed::writeArchive(const std::string &fileName, const std::pmr::vector<std::uint8_t> &contents) const
+{
+	const std::string path = extendedFileName(fileName);
+	std::remove(framesFileName(path).c_str()); // The new archive is a single frame
+	FILE* output = fopen(path.c_str(), "wb");
+	if (!output) {
+		std::cerr << "Cannot save the file" << std::endl; // Better shouldn't throw here
+		throw(std::runtime_error("Cannot save file " + path));
+	}
+	setvbuf(output, nullptr, _IONBF, 0); // Buffered by writeFrame()
+	try {
+		writeFrame(output, contents);
+	}
+	catch(...) {
+		fclose(output);
+		throw;
+	}
+	fclose(output);
+	statistics_.add(MemoryMappedFileCounter::FULL_FLUSHES);
+}
+
+void MemoryMappedFileCompressed::appendFrame(const std::string &fileName) const
+{
+	const std::string path = extendedFileName(fileName);
+	std::vector<Frame> frames = readFrames(path);
+	if (frames.empty()) {
+		// Not appended to yet, so it's a single frame if it exists
+		FILE* input = fopen(path.c_str(), "rb");
+		if (input != nullptr) {
+			std::uint8_t header[LZMA_PROPS_SIZE + 8];
+			const bool complete = (fread(header, 1, sizeof(header), input) == sizeof(header));
+			fclose(input);
+			std::uint64_t size = 0;
+			if (complete && !sizeFromHeader(header, size))
+				throw(std::runtime_error("Can't append to archive " + path + " because the size of its contents is unknown"));
+			if (complete)
+				frames.push_back({ std::filesystem::file_size(path), size });
+		}
+	}
+	if (frames.empty()) {
+		writeArchive(fileName, tail_);
+		return;
 	}
+
+	// Anything behind the last listed frame is an unfinished frame, so it's overwritten
+	FILE* output = fopen(path.c_str(), "r+b");
+	if (!output)
+		throw(std::runtime_error("Cannot open file " + path));
+	setvbuf(output, nullptr, _IONBF, 0); // Buffered by writeFrame()
+	std::uint64_t written = 0;
+	try {
+		if (fseek(output, long(frames.back().end), SEEK_SET) != 0)
+			throw(std::runtime_error("Cannot append to file " + path));
+		written = writeFrame(output, tail_);
+	}
+	catch(...) {
+		fclose(output);
+		throw;
+	}
+	fclose(output);
+	frames.push_back({ frames.back().end + written, frames.back().decodedEnd + tail_.size() });
+
+	// The archive is written first, so the new frame is ignored if this doesn't finish
+	const std::string listName = framesFileName(path);
+	FILE* list = fopen(listName.c_str(), frames.size() > 2 ? "r+b" : "wb");
+	if (!list)
+		throw(std::runtime_error("Cannot save file " + listName));
+	const std::size_t from = (frames.size() > 2) ? frames.size() - 1 : 0;
+	const bool saved = (fseek(list, long(from * sizeof(Frame)), SEEK_SET) == 0 &&
+			fwrite(frames.data() + from, sizeof(Frame), frames.size() - from, list) == frames.size() - from);
+	fclose(list);
+	if (!saved)
+		throw(std::runtime_error("Cannot save file " + listName));
+	std::filesystem::resize_file(listName, frames.size() * sizeof(Frame)); // Removes frames that weren't finished
+	statistics_.add(MemoryMappedFileCounter::APPEND_FLUSHES);
 }
 
 //inline std::string vec2string(const std::vector<std::uint8_t> &str)
@@ -278,15 +509,29 @@ void MemoryMappedFileCompressed::flush(const std::string &fileName) const
 
 void MemoryMappedFileCompressed::reset()
 {
+	discardPrefetched();
+	stopWatching();
+	preserveAllPages();
 	data_.clear();
+	tail_.clear();
 	modified_ = false;
 	loadedUntil_ = 0;
 	fileSize_ = -1;
 }
 
-MemoryMappedFileCompressed::MemoryMappedFileCompressed(const std::string &fileName) :
-	MemoryMappedFileBase(fileName)
+MemoryMappedFileCompressed::MemoryMappedFileCompressed(const std::string &fileName, std::pmr::memory_resource* memory) :
+	MemoryMappedFileCompressed(fileName, MemoryMappedFileOptions(), memory)
 {
+}
+
+MemoryMappedFileCompressed::MemoryMappedFileCompressed(const std::string &fileName, const MemoryMappedFileOptions &options,
+		std::pmr::memory_resource* memory) :
+	MemoryMappedFileBase(fileName, memory),
+	options_(options),
+	tail_(memory)
+{
+	if (options_.checksums)
+		throw(std::logic_error("Checksums can't be kept for compressed file " + extendedFileName(fileName)));
 	reset();
 }
 
@@ -301,20 +546,127 @@ MemoryMappedFileCompressed::~MemoryMappedFileCompressed()
 	}
 }
 
+bool MemoryMappedFileCompressed::readSizeFromHeader() const
+{
+	FILE* input = fopen(extendedFileName(fileName_).c_str(), "rb");
+	if (input == nullptr) {
+		fileSize_ = 0;
+		return true;
+	}
+	std::uint8_t header[LZMA_PROPS_SIZE + 8];
+	const bool complete = (fread(header, 1, sizeof(header), input) == sizeof(header));
+	fclose(input);
+	if (!complete)
+		return false;
+
+	const std::vector<Frame> frames = readFrames(extendedFileName(fileName_));
+	if (!frames.empty()) {
+		fileSize_ = int(frames.back().decodedEnd);
+		return true;
+	}
+	std::uint64_t size = 0;
+	const bool archiveHasSize = sizeFromHeader(header, size);
+	if (archiveHasSize)
+		fileSize_ = int(size);
+	return archiveHasSize;
+}
+
 int MemoryMappedFileCompressed::size() const
 {
+	if (options_.appendOnly) {
+		if (!modified_ && (fileSize_ < 0 || changedOnDisk())) {
+			fileSize_ = -1;
+			if (!readSizeFromHeader())
+				throw(std::runtime_error("Size of archive " + extendedFileName(fileName_) + " is unknown without loading it"));
+		}
+		return fileSize_ + int(tail_.size());
+	}
 	if (modified_) return int(data_.size());
 
+	if (changedOnDisk()) {
+		// Rewritten by another process, the whole archive is different
+		discardPrefetched();
+		preserveAllPages();
+		const_cast<std::pmr::vector<std::uint8_t>&>(data_).clear();
+		loadedUntil_ = 0;
+		fileSize_ = -1;
+	}
+
 	if (fileSize_ >= 0)
 		return fileSize_;
 
-	load(100);
-	if (fileSize_ >= 0)
+	if (readSizeFromHeader())
 		return fileSize_;
 	load();
 	return fileSize_;
 }
 
+void MemoryMappedFileCompressed::discardPrefetched() const
+{
+	if (!prefetched_.valid())
+		return;
+	try {
+		prefetched_.get();
+	}
+	catch(...) {
+		// Whatever was wrong will be found when loading again
+	}
+}
+
+void MemoryMappedFileCompressed::prefetch(int from, int size) const
+{
+	const int until = from + size - 1;
+	if (options_.appendOnly || modified_ || prefetched_.valid() || size <= 0 || fullyLoaded() || until < loadedUntil_)
+		return;
+	// The whole beginning of the archive has to be decoded anyway, so it's decoded on another thread into another buffer
+	prefetched_ = std::async(std::launch::async, &MemoryMappedFileCompressed::decode, extendedFileName(fileName_), loadingStop(until),
+			memoryResource());
+}
+
+void MemoryMappedFileCompressed::dropCache(int from, int size) const
+{
+	(void)from;
+	(void)size;
+	discardPrefetched();
+}
+
+void MemoryMappedFileCompressed::append(const std::vector<std::uint8_t> &added)
+{
+	if (options_.appendOnly)
+		appendToTail(added.data(), int(added.size()));
+	else
+		MemoryMappedFileBase::append(added);
+}
+
+void MemoryMappedFileCompressed::append(const std::uint8_t* added, int size)
+{
+	if (options_.appendOnly)
+		appendToTail(added, size);
+	else
+		MemoryMappedFileBase::append(added, size);
+}
+
+void MemoryMappedFileCompressed::push_back(std::uint8_t added)
+{
+	if (options_.appendOnly)
+		appendToTail(&added, 1);
+	else
+		MemoryMappedFileBase::push_back(added);
+}
+
+void MemoryMappedFileCompressed::clear()
+{
+	tail_.clear();
+	MemoryMappedFileBase::clear();
+}
+
+void MemoryMappedFileCompressed::appendToTail(const std::uint8_t* added, int size)
+{
+	tail_.insert(tail_.end(), added, added + size);
+	if (int(tail_.size()) >= APPEND_ONLY_TAIL_LIMIT)
+		flush(); // Keeps the memory bounded and frames large enough to compress well
+}
+
 const std::string &MemoryMappedFileCompressed::standardExtension()
 {
 	static std::string retval = "lzma";
@@ -9,6 +9,9 @@
 * Encapsulates access to a LZMA archive and allows modifying it as a vector of bytes and flushing the changes afterwards
 *
 * \note The main reason to create this class is to abstract from the user-hostile API of the otherwise very efficient implementation of LZMA
+*
+* In append-only mode, appended bytes are compressed as a separate frame written behind the archive. Archives consisting of multiple frames list
+* them in a file with additional .frames extension, frames that aren't listed there (because writing them was interrupted) are ignored.
 */
 
 #ifndef MEMORY_MAPPED_FILE_COMPESSED_H
@@ -17,21 +20,62 @@
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <cstdio>
+#include <chrono>
+#include <future>
 #include "memory_mapped_file_base.hpp"
 
-class MemoryMappedFileCompressed : public MemoryMappedFileBase {
+class MemoryMappedFileCompressed final : public MemoryMappedFileBase {
 	virtual std::string fileNameExtension() const override
 	{
 		return ".lzma";
 	}
+	struct Decoded {
+		std::pmr::vector<std::uint8_t> data;
+		int fileSize;
+		std::int64_t bytesRead;
+		std::chrono::steady_clock::duration decodingTime;
+	};
+	struct Frame {
+		std::uint64_t end; // Offset behind the frame in the archive
+		std::uint64_t decodedEnd; // Offset behind the frame's contents in the contents of the whole archive
+	};
+	MemoryMappedFileOptions options_;
+	mutable std::future<Decoded> prefetched_;
+	mutable std::pmr::vector<std::uint8_t> tail_; // Bytes appended in append-only mode that weren't flushed yet
+
 	void reset();
+	bool readSizeFromHeader() const;
+	int loadingStop(int until) const;
+	void discardPrefetched() const;
+	void appendToTail(const std::uint8_t* added, int size);
+	std::uint64_t writeFrame(std::FILE* output, const std::pmr::vector<std::uint8_t> &contents) const;
+	void writeArchive(const std::string &fileName, const std::pmr::vector<std::uint8_t> &contents) const;
+	void appendFrame(const std::string &fileName) const;
+	static bool sizeFromHeader(const std::uint8_t* header, std::uint64_t &size);
+	static std::string framesFileName(const std::string &path);
+	static std::vector<Frame> readFrames(const std::string &path);
+	static void decodeFrame(std::FILE* input, std::uint64_t begin, std::uint64_t end, int stopAt, Decoded &decoded);
+	static Decoded decode(const std::string &path, int stopAt, std::pmr::memory_resource* memory);
 public:
 	/*!
 	* \brief Constructor: loads file if exists, or starts holding an empty string
 	*
 	* \param Name of the file, without suffix
+	* \param Memory resource to allocate the contents from
+	*/
+	MemoryMappedFileCompressed(const std::string &fileName, std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+
+	/*!
+	* \brief Constructor: loads file if exists, or starts holding an empty string
+	*
+	* \param Name of the file, without suffix
+	* \param Additional features, checksums are not available
+	* \param Memory resource to allocate the contents from
+	* \note In append-only mode, the file can be only appended to, cleared and its size can be checked, accessing the contents throws std::logic_error
 	*/
-	MemoryMappedFileCompressed(const std::string &fileName);
+	MemoryMappedFileCompressed(const std::string &fileName, const MemoryMappedFileOptions &options,
+			std::pmr::memory_resource* memory = std::pmr::get_default_resource());
 
 	/*!
 	* \brief Destructor, flushes changes
@@ -42,6 +86,7 @@ public:
 	* \brief Gets size of the data
 	*
 	* \return Size of the data
+	* \note Obtained from the archive's header if it's there, otherwise the archive has to be decompressed
 	*/
 	virtual int size() const override;
 
@@ -72,6 +117,52 @@ public:
 	*/
 	virtual void flush(const std::string &fileName) const override;
 
+	/*!
+	* \brief Starts decoding the archive up to the given bytes on another thread, load() will use the result
+	*
+	* \param Index of the first byte that will be needed
+	* \param Number of bytes that will be needed
+	*/
+	virtual void prefetch(int from, int size) const override;
+
+	/*!
+	* \brief Abandons the result of prefetching
+	*
+	* \param Index of the first byte that won't be needed, ignored
+	* \param Number of bytes that won't be needed, ignored
+	*/
+	virtual void dropCache(int from, int size) const override;
+
+	/*!
+	* \brief Appends data at the end of the file
+	*
+	* \param Vector of bytes to append
+	* \note This overrides parent's method to keep the bytes aside in append-only mode
+	*/
+	virtual void append(const std::vector<std::uint8_t> &added) override;
+
+	/*!
+	* \brief Appends data at the end of the file
+	*
+	* \param Raw pointer to the data
+	* \param Size of the data in bytes
+	* \note This overrides parent's method to keep the bytes aside in append-only mode
+	*/
+	virtual void append(const std::uint8_t* added, int size) override;
+
+	/*!
+	* \brief Appends a byte at the end of the file
+	*
+	* \param The byte to append
+	* \note This overrides parent's method to keep the bytes aside in append-only mode
+	*/
+	virtual void push_back(std::uint8_t added) override;
+
+	/*!
+	* \brief Clears the contents
+	*/
+	virtual void clear() override;
+
 	/*!
 	* \brief Returns the extension typical for this type of archive
 	*
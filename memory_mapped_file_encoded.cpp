@@ -0,0 +1,757 @@
+#include "memory_mapped_file_encoded.hpp"
+#include <iostream>
+#include <algorithm>
+#include <unordered_map>
+#include <filesystem>
+#include <climits>
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include <bit>
+#include <chrono>
+#if defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MEMORY_MAPPED_FILE_SSE2 // Always available on 64-bit x86
+#endif
+
+constexpr int LOADED_PART_SEQUENTIAL_INCREMENT = (1 << 21);
+constexpr int BLOCK_RECORDS = 1024;
+constexpr int MAX_DICTIONARY_SIZE = (1 << 16);
+constexpr std::uint32_t FORMAT_VERSION = 1;
+constexpr std::size_t WRITE_BUFFER_SIZE = (1 << 20);
+
+namespace {
+
+struct FileHeader {
+	char magic[4];
+	std::uint32_t version;
+	std::uint64_t dataSize;
+	std::uint32_t recordSize;
+	std::uint32_t blockRecords;
+	std::uint32_t fields;
+	std::uint32_t reserved;
+};
+
+struct FieldHeader {
+	std::uint32_t offset;
+	std::uint8_t width;
+	std::uint8_t transform;
+	std::uint16_t reserved;
+};
+
+struct BlockHeader {
+	std::uint32_t encodedSize;
+	std::uint32_t records;
+	std::uint32_t tailBytes;
+};
+
+constexpr char MAGIC[4] = { 'M', 'M', 'F', 'E' };
+
+// Values that start the sequence and are stored whole instead of packed
+int headValues(MemoryMappedFileTransform transform)
+{
+	return (transform == MemoryMappedFileTransform::DELTA_OF_DELTA) ? 2 : 1;
+}
+
+inline std::uint64_t zigzag(std::int64_t value)
+{
+	return (std::uint64_t(value) << 1) ^ std::uint64_t(value >> 63);
+}
+
+inline std::uint64_t unzigzag(std::uint64_t value)
+{
+	return (value >> 1) ^ (~(value & 1) + 1);
+}
+
+inline std::uint64_t lowBits(int bits)
+{
+	return (bits >= 64) ? ~std::uint64_t(0) : (std::uint64_t(1) << bits) - 1;
+}
+
+std::int64_t readSigned(const std::uint8_t* from, int width)
+{
+	switch (width) {
+	case 1: { std::int8_t value; std::memcpy(&value, from, 1); return value; }
+	case 2: { std::int16_t value; std::memcpy(&value, from, 2); return value; }
+	case 4: { std::int32_t value; std::memcpy(&value, from, 4); return value; }
+	default: { std::int64_t value; std::memcpy(&value, from, 8); return value; }
+	}
+}
+
+template<typename Word, typename Value>
+void scatter(std::uint8_t* to, int stride, const Value* values, int count)
+{
+	for (int i = 0; i < count; i++) {
+		const Word word = Word(values[i]);
+		std::memcpy(to + std::size_t(i) * stride, &word, sizeof(Word));
+	}
+}
+
+template<typename Value>
+void scatter(std::uint8_t* to, int stride, int width, const Value* values, int count)
+{
+	switch (width) {
+	case 1: scatter<std::uint8_t>(to, stride, values, count); break;
+	case 2: scatter<std::uint16_t>(to, stride, values, count); break;
+	case 4: scatter<std::uint32_t>(to, stride, values, count); break;
+	default: scatter<std::uint64_t>(to, stride, values, count); break;
+	}
+}
+
+// Fields of up to 4 bytes are summed in 32 bits, overflows don't matter because only the lowest bytes are kept
+void prefixSum(std::uint32_t* values, int count)
+{
+	int i = 0;
+	std::uint32_t carry = 0;
+#ifdef MEMORY_MAPPED_FILE_SSE2
+	__m128i carried = _mm_setzero_si128();
+	for ( ; i + 4 <= count; i += 4) {
+		__m128i summed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+		summed = _mm_add_epi32(summed, _mm_slli_si128(summed, 4));
+		summed = _mm_add_epi32(summed, _mm_slli_si128(summed, 8));
+		summed = _mm_add_epi32(summed, carried);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(values + i), summed);
+		carried = _mm_shuffle_epi32(summed, _MM_SHUFFLE(3, 3, 3, 3));
+	}
+	carry = std::uint32_t(_mm_cvtsi128_si32(carried));
+#endif
+	for ( ; i < count; i++) {
+		carry += values[i];
+		values[i] = carry;
+	}
+}
+
+void prefixSum(std::uint64_t* values, int count)
+{
+	int i = 0;
+	std::uint64_t carry = 0;
+#ifdef MEMORY_MAPPED_FILE_SSE2
+	__m128i carried = _mm_setzero_si128();
+	for ( ; i + 2 <= count; i += 2) {
+		__m128i summed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+		summed = _mm_add_epi64(summed, _mm_slli_si128(summed, 8));
+		summed = _mm_add_epi64(summed, carried);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(values + i), summed);
+		carried = _mm_shuffle_epi32(summed, _MM_SHUFFLE(3, 2, 3, 2));
+	}
+	carry = std::uint64_t(_mm_cvtsi128_si64(carried));
+#endif
+	for ( ; i < count; i++) {
+		carry += values[i];
+		values[i] = carry;
+	}
+}
+
+// Integrates the differences back into values
+template<typename Word>
+void integrate(Word* values, int count, MemoryMappedFileTransform transform)
+{
+	if (transform == MemoryMappedFileTransform::DELTA_OF_DELTA && count > 1)
+		prefixSum(values + 1, count - 1); // The first value is the start, the second one is the first difference
+	prefixSum(values, count);
+}
+
+class BitWriter {
+	std::vector<std::uint8_t> &out_;
+	std::uint64_t buffer_ = 0;
+	int used_ = 0;
+
+	void writeShort(std::uint64_t value, int bits)
+	{
+		buffer_ |= value << used_;
+		used_ += bits;
+		while (used_ >= 8) {
+			out_.push_back(std::uint8_t(buffer_));
+			buffer_ >>= 8;
+			used_ -= 8;
+		}
+	}
+public:
+	BitWriter(std::vector<std::uint8_t> &out) : out_(out) {}
+
+	void write(std::uint64_t value, int bits)
+	{
+		const int low = std::min(bits, 32);
+		writeShort(value & lowBits(low), low);
+		if (bits > low)
+			writeShort(value >> 32, bits - low);
+	}
+
+	void finish()
+	{
+		if (used_ > 0)
+			out_.push_back(std::uint8_t(buffer_));
+		buffer_ = 0;
+		used_ = 0;
+	}
+};
+
+// Unpacks and converts the values, returns the position behind the packed values, or nullptr if there aren't enough bytes
+template<typename Word, typename Convert>
+const std::uint8_t* unpack(const std::uint8_t* from, const std::uint8_t* end, int bits, Word* values, int count, Convert convert)
+{
+	const std::size_t bytes = (std::size_t(count) * bits + 7) / 8;
+	const std::size_t available = std::size_t(end - from);
+	if (available < bytes)
+		return nullptr;
+	if (bits == 0) {
+		std::fill(values, values + count, convert(0));
+		return from;
+	}
+	const std::uint64_t mask = lowBits(bits);
+	int i = 0;
+	if (bits <= 56 && available >= sizeof(std::uint64_t)) {
+		// Whole words are read as long as they don't reach behind the end
+		const int wordReads = std::min<std::size_t>(count, ((available - sizeof(std::uint64_t)) * 8 + 7) / bits + 1);
+		for ( ; i < wordReads; i++) {
+			const std::size_t position = std::size_t(i) * bits;
+			std::uint64_t word;
+			std::memcpy(&word, from + (position >> 3), sizeof(word));
+			values[i] = convert((word >> (position & 7)) & mask);
+		}
+	}
+	for ( ; i < count; i++) {
+		const std::size_t position = std::size_t(i) * bits;
+		std::uint64_t value = 0;
+		for (int bit = 0; bit < bits; ) {
+			const int shift = int((position + bit) & 7);
+			const int taken = std::min(8 - shift, bits - bit);
+			value |= ((std::uint64_t(from[(position + bit) >> 3]) >> shift) & lowBits(taken)) << bit;
+			bit += taken;
+		}
+		values[i] = convert(value);
+	}
+	return from + bytes;
+}
+
+template<typename Value>
+void put(std::vector<std::uint8_t> &out, const Value &value, int bytes = sizeof(Value))
+{
+	const std::uint8_t* asBytes = reinterpret_cast<const std::uint8_t*>(&value);
+	out.insert(out.end(), asBytes, asBytes + bytes);
+}
+
+}
+
+MemoryMappedFileLayout::MemoryMappedFileLayout(int recordSize, const std::vector<MemoryMappedFileField> &fields) :
+	recordSize_(recordSize)
+{
+	if (recordSize <= 0)
+		throw(std::logic_error("Records must have a positive size"));
+	std::vector<MemoryMappedFileField> sorted = fields;
+	std::sort(sorted.begin(), sorted.end(), [] (const MemoryMappedFileField &first, const MemoryMappedFileField &second) {
+		return first.offset < second.offset;
+	});
+	int covered = 0;
+	auto coverUntil = [&] (int until) {
+		// Parts that aren't described are stored raw, in as large pieces as possible
+		while (covered < until) {
+			int width = 8;
+			while (covered + width > until)
+				width >>= 1;
+			fields_.push_back({ covered, width, MemoryMappedFileTransform::RAW });
+			covered += width;
+		}
+	};
+	for (const MemoryMappedFileField &field : sorted) {
+		if (field.width != 1 && field.width != 2 && field.width != 4 && field.width != 8)
+			throw(std::logic_error("Encoded fields must have 1, 2, 4 or 8 bytes, not " + std::to_string(field.width)));
+		if (field.offset < covered || field.offset + field.width > recordSize)
+			throw(std::logic_error("Encoded field at " + std::to_string(field.offset) + " overlaps another field or the end of the record"));
+		if (field.transform > MemoryMappedFileTransform::DICTIONARY)
+			throw(std::logic_error("Unknown transform of encoded field at " + std::to_string(field.offset)));
+		coverUntil(field.offset);
+		fields_.push_back(field);
+		covered = field.offset + field.width;
+	}
+	coverUntil(recordSize);
+}
+
+void MemoryMappedFileEncoded::reset()
+{
+	stopWatching();
+	preserveAllPages();
+	data_.clear();
+	clearDirtyPages();
+	blockOffsets_.clear();
+	modified_ = false;
+	loadedUntil_ = 0;
+	fileSize_ = -1;
+}
+
+MemoryMappedFileEncoded::MemoryMappedFileEncoded(const std::string &fileName, const MemoryMappedFileLayout &layout,
+		std::pmr::memory_resource* memory) :
+	MemoryMappedFileBase(fileName, memory),
+	layout_(layout),
+	blockRecords_(BLOCK_RECORDS)
+{
+	reset();
+}
+
+MemoryMappedFileEncoded::~MemoryMappedFileEncoded()
+{
+	try {
+		flush();
+	}
+	catch(std::exception &exception) {
+		std::cout << "Failed to flush: " << exception.what();
+	}
+}
+
+int MemoryMappedFileEncoded::blockBytes() const
+{
+	return blockRecords_ * layout_.recordSize();
+}
+
+int MemoryMappedFileEncoded::firstDirtyByte() const
+{
+	for (unsigned int i = 0; i < dirtyPages_.size(); i++)
+		if (dirtyPages_[i])
+			return int((i * 64 + std::countr_zero(dirtyPages_[i])) << PAGE_BITS);
+	return INT_MAX;
+}
+
+void MemoryMappedFileEncoded::readHeader() const
+{
+	blockOffsets_.clear();
+	FILE* input = fopen(extendedFileName(fileName_).c_str(), "rb");
+	if (input == nullptr) {
+		fileSize_ = 0;
+		return;
+	}
+	FileHeader header;
+	bool complete = (fread(&header, sizeof(header), 1, input) == 1);
+	std::vector<MemoryMappedFileField> fields;
+	for (unsigned int i = 0; complete && i < header.fields && i < (1u << 16); i++) {
+		FieldHeader field;
+		complete = (fread(&field, sizeof(field), 1, input) == 1);
+		fields.push_back({ int(field.offset), int(field.width), MemoryMappedFileTransform(field.transform) });
+	}
+	fclose(input);
+
+	const std::string name = extendedFileName(fileName_);
+	if (!complete || std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) || header.blockRecords == 0 || header.fields != fields.size()
+			|| header.dataSize > std::uint64_t(INT_MAX))
+		throw(std::runtime_error("File " + name + " is not an encoded file or its header is damaged"));
+	if (header.version != FORMAT_VERSION)
+		throw(std::runtime_error("File " + name + " has unknown version " + std::to_string(header.version)));
+	if (int(header.recordSize) != layout_.recordSize())
+		throw(std::runtime_error("File " + name + " holds records of " + std::to_string(header.recordSize) + " bytes, not "
+				+ std::to_string(layout_.recordSize())));
+	try {
+		layout_ = MemoryMappedFileLayout(int(header.recordSize), fields);
+	}
+	catch(std::logic_error &error) {
+		throw(std::runtime_error("File " + name + " has a damaged layout: " + error.what()));
+	}
+	blockRecords_ = int(header.blockRecords);
+	fileSize_ = int(header.dataSize);
+	blockOffsets_.push_back(std::int64_t(sizeof(FileHeader) + fields.size() * sizeof(FieldHeader)));
+}
+
+int MemoryMappedFileEncoded::size() const
+{
+	if (modified_) return int(data_.size());
+
+	// Another process may have rewritten the last block, so everything is read again, unless there are appends waiting to be flushed
+	if (changedOnDisk() && int(data_.size()) <= fileSize_) {
+		preserveAllPages();
+		const_cast<std::pmr::vector<std::uint8_t>&>(data_).clear();
+		loadedUntil_ = 0;
+		fileSize_ = -1;
+		updateResidentBytes();
+	}
+	if (fileSize_ < 0)
+		readHeader();
+	return std::max<int>(int(data_.size()), fileSize_);
+}
+
+void MemoryMappedFileEncoded::load(int until) const
+{
+	if (fileSize_ < 0)
+		readHeader();
+	if (fullyLoaded() || (until >= 0 && loadedUntil_ > until)) return;
+	MemoryMappedFileStopwatch stopwatch(statistics_, MemoryMappedFileTiming::LOAD);
+	const std::string name = extendedFileName(fileName_);
+	const int stopAt = (until < 0) ? INT_MAX : sequential_ ? std::min<int>(until, INT_MAX - LOADED_PART_SEQUENTIAL_INCREMENT)
+			+ LOADED_PART_SEQUENTIAL_INCREMENT : until;
+
+	FILE* input = fopen(name.c_str(), "rb");
+	if (input == nullptr)
+		throw(std::runtime_error("Could not open file " + name));
+	std::int64_t bytesRead = 0;
+	std::chrono::steady_clock::duration decodingTime = {};
+	try {
+		if (fseek(input, long(blockOffsets_.back()), SEEK_SET) != 0)
+			throw(std::runtime_error("File " + name + " is damaged"));
+		// The size is known from the header, so that the data doesn't have to be moved while growing
+		reserveData(std::size_t(std::min<std::int64_t>(fileSize_, std::int64_t(stopAt) + blockBytes())));
+		std::vector<std::uint8_t> encoded;
+		std::vector<std::uint64_t> values;
+		std::vector<std::uint32_t> narrowValues;
+		while (loadedUntil_ <= stopAt && loadedUntil_ < fileSize_) {
+			BlockHeader header;
+			if (fread(&header, sizeof(header), 1, input) != 1 || header.records > std::uint32_t(blockRecords_)
+					|| header.tailBytes >= std::uint32_t(layout_.recordSize())
+					|| std::int64_t(header.records) * layout_.recordSize() + header.tailBytes > fileSize_ - loadedUntil_
+					|| header.encodedSize > std::uint32_t(INT_MAX))
+				throw(std::runtime_error("Block at " + std::to_string(blockOffsets_.back()) + " of file " + name + " is damaged"));
+			encoded.resize(header.encodedSize);
+			if (fread(encoded.data(), 1, encoded.size(), input) != encoded.size())
+				throw(std::runtime_error("Block at " + std::to_string(blockOffsets_.back()) + " of file " + name + " is damaged"));
+			bytesRead += std::int64_t(sizeof(header) + encoded.size());
+
+			const auto decodingStart = std::chrono::steady_clock::now();
+			decodeBlock(encoded.data(), int(encoded.size()), int(header.records), int(header.tailBytes), values, narrowValues);
+			decodingTime += std::chrono::steady_clock::now() - decodingStart;
+			blockOffsets_.push_back(blockOffsets_.back() + std::int64_t(sizeof(header) + encoded.size()));
+			loadedUntil_ = int(data_.size());
+		}
+	}
+	catch(...) {
+		fclose(input);
+		throw;
+	}
+	fclose(input);
+
+	statistics_.add(MemoryMappedFileCounter::LOADS);
+	statistics_.add(MemoryMappedFileCounter::BYTES_READ, bytesRead);
+	statistics_.record(MemoryMappedFileTiming::DECODE, decodingTime);
+	updateResidentBytes();
+}
+
+void MemoryMappedFileEncoded::decodeBlock(const std::uint8_t* encoded, int encodedSize, int records, int tailBytes,
+		std::vector<std::uint64_t> &values, std::vector<std::uint32_t> &narrowValues) const
+{
+	std::pmr::vector<std::uint8_t> &data = const_cast<std::pmr::vector<std::uint8_t>&>(data_);
+	const std::size_t start = data.size();
+	const int recordSize = layout_.recordSize();
+	reserveData(start + std::size_t(records) * recordSize + tailBytes);
+	data.resize(start + std::size_t(records) * recordSize + tailBytes);
+	std::uint8_t* const block = data.data() + start;
+	const std::uint8_t* position = encoded;
+	const std::uint8_t* const end = encoded + encodedSize;
+	auto take = [&] (std::size_t bytes) {
+		if (std::size_t(end - position) < bytes)
+			return false;
+		position += bytes;
+		return true;
+	};
+
+	values.resize(records);
+	bool intact = true;
+	for (const MemoryMappedFileField &field : layout_.fields()) {
+		const std::uint8_t* const modeAt = position;
+		if (!take(1)) {
+			intact = false;
+			break;
+		}
+		const MemoryMappedFileTransform mode = MemoryMappedFileTransform(*modeAt);
+		std::uint8_t* const to = block + field.offset;
+
+		if (mode == MemoryMappedFileTransform::RAW) {
+			const std::uint8_t* const from = position;
+			if (!(intact = take(std::size_t(records) * field.width)))
+				break;
+			for (int i = 0; i < records; i++)
+				std::memcpy(to + std::size_t(i) * recordSize, from + std::size_t(i) * field.width, field.width);
+
+		} else if (mode == MemoryMappedFileTransform::DELTA || mode == MemoryMappedFileTransform::DELTA_OF_DELTA) {
+			const int head = std::min(headValues(mode), records);
+			const std::uint8_t* const headAt = position;
+			const std::uint8_t* const bitsAt = position + head * sizeof(std::uint64_t);
+			if (!(intact = take(head * sizeof(std::uint64_t) + 1) && *bitsAt <= 64))
+				break;
+			std::memcpy(values.data(), headAt, head * sizeof(std::uint64_t));
+			if (field.width <= 4) {
+				narrowValues.resize(records);
+				for (int i = 0; i < head; i++)
+					narrowValues[i] = std::uint32_t(values[i]);
+				position = unpack(position, end, *bitsAt, narrowValues.data() + head, records - head, [] (std::uint64_t packed) {
+					return std::uint32_t(unzigzag(packed));
+				});
+				if (!(intact = (position != nullptr)))
+					break;
+				integrate(narrowValues.data(), records, mode);
+				scatter(to, recordSize, field.width, narrowValues.data(), records);
+			} else {
+				position = unpack(position, end, *bitsAt, values.data() + head, records - head, unzigzag);
+				if (!(intact = (position != nullptr)))
+					break;
+				integrate(values.data(), records, mode);
+				scatter(to, recordSize, field.width, values.data(), records);
+			}
+
+		} else if (mode == MemoryMappedFileTransform::DICTIONARY) {
+			std::uint32_t count = 0;
+			const std::uint8_t* const countAt = position;
+			if (!(intact = take(sizeof(count))))
+				break;
+			std::memcpy(&count, countAt, sizeof(count));
+			const std::uint8_t* const dictionaryAt = position;
+			if (!(intact = count > 0 && count <= std::uint32_t(MAX_DICTIONARY_SIZE) && take(std::size_t(count) * field.width)))
+				break;
+			std::vector<std::uint64_t> dictionary(count, 0);
+			for (unsigned int i = 0; i < count; i++)
+				std::memcpy(&dictionary[i], dictionaryAt + std::size_t(i) * field.width, field.width);
+			position = unpack(position, end, std::bit_width(count - 1), values.data(), records, [] (std::uint64_t packed) {
+				return packed;
+			});
+			if (!(intact = (position != nullptr)))
+				break;
+			for (int i = 0; i < records; i++) {
+				if (values[i] >= count) {
+					intact = false;
+					break;
+				}
+				values[i] = dictionary[values[i]];
+			}
+			if (!intact)
+				break;
+			scatter(to, recordSize, field.width, values.data(), records);
+
+		} else {
+			intact = false;
+			break;
+		}
+	}
+	const std::uint8_t* const tailAt = position;
+	if (!intact || !take(tailBytes) || position != end) {
+		data.resize(start);
+		throw(std::runtime_error("Block of file " + extendedFileName(fileName_) + " can't be decoded, it's damaged"));
+	}
+	std::memcpy(block + std::size_t(records) * recordSize, tailAt, tailBytes);
+}
+
+void MemoryMappedFileEncoded::encodeBlock(int from, std::vector<std::uint8_t> &encoded) const
+{
+	const int recordSize = layout_.recordSize();
+	const int available = int(data_.size()) - from;
+	const int records = std::min(blockRecords_, available / recordSize);
+	const int tailBytes = (available > blockBytes()) ? 0 : available - records * recordSize;
+	const std::uint8_t* const block = data_.data() + from;
+
+	const std::size_t headerAt = encoded.size();
+	put(encoded, BlockHeader{ 0, std::uint32_t(records), std::uint32_t(tailBytes) });
+	std::vector<std::int64_t> values(records);
+	std::vector<std::uint64_t> residuals(records);
+	std::unordered_map<std::int64_t, std::uint32_t> indexes;
+	std::vector<std::int64_t> dictionary;
+	for (const MemoryMappedFileField &field : layout_.fields()) {
+		for (int i = 0; i < records; i++)
+			values[i] = readSigned(block + std::size_t(i) * recordSize + field.offset, field.width);
+		const std::size_t rawSize = std::size_t(records) * field.width;
+		MemoryMappedFileTransform mode = MemoryMappedFileTransform::RAW;
+
+		if (field.transform == MemoryMappedFileTransform::DELTA || field.transform == MemoryMappedFileTransform::DELTA_OF_DELTA) {
+			const int head = std::min(headValues(field.transform), records);
+			std::int64_t previous = 0;
+			std::int64_t previousDifference = 0;
+			int bits = 0;
+			for (int i = 0; i < records; i++) {
+				// Wrapping around is fine, decoding wraps around the same way
+				const std::int64_t difference = std::int64_t(std::uint64_t(values[i]) - std::uint64_t(previous));
+				const std::int64_t residual = (field.transform == MemoryMappedFileTransform::DELTA || i < 2) ? difference
+						: std::int64_t(std::uint64_t(difference) - std::uint64_t(previousDifference));
+				residuals[i] = (i < head) ? std::uint64_t(residual) : zigzag(residual);
+				if (i >= head)
+					bits = std::max<int>(bits, std::bit_width(residuals[i]));
+				previous = values[i];
+				previousDifference = difference;
+			}
+			if (head * sizeof(std::uint64_t) + 1 + (std::size_t(records - head) * bits + 7) / 8 < rawSize) {
+				mode = field.transform;
+				encoded.push_back(std::uint8_t(mode));
+				for (int i = 0; i < head; i++)
+					put(encoded, residuals[i]);
+				encoded.push_back(std::uint8_t(bits));
+				BitWriter writer(encoded);
+				for (int i = head; i < records; i++)
+					writer.write(residuals[i], bits);
+				writer.finish();
+			}
+
+		} else if (field.transform == MemoryMappedFileTransform::DICTIONARY && records > 0) {
+			indexes.clear();
+			dictionary.clear();
+			for (int i = 0; i < records && int(dictionary.size()) <= MAX_DICTIONARY_SIZE; i++)
+				if (indexes.emplace(values[i], std::uint32_t(dictionary.size())).second)
+					dictionary.push_back(values[i]);
+			const int bits = std::bit_width(std::uint32_t(dictionary.size() - 1));
+			if (int(dictionary.size()) <= MAX_DICTIONARY_SIZE
+					&& sizeof(std::uint32_t) + dictionary.size() * field.width + (std::size_t(records) * bits + 7) / 8 < rawSize) {
+				mode = field.transform;
+				encoded.push_back(std::uint8_t(mode));
+				put(encoded, std::uint32_t(dictionary.size()));
+				for (std::int64_t value : dictionary)
+					put(encoded, value, field.width);
+				BitWriter writer(encoded);
+				for (int i = 0; i < records; i++)
+					writer.write(indexes[values[i]], bits);
+				writer.finish();
+			}
+		}
+
+		if (mode == MemoryMappedFileTransform::RAW) {
+			// Also used when the transform wouldn't save anything
+			encoded.push_back(std::uint8_t(mode));
+			for (int i = 0; i < records; i++)
+				put(encoded, values[i], field.width);
+		}
+	}
+	encoded.insert(encoded.end(), block + std::size_t(records) * recordSize, block + std::size_t(records) * recordSize + tailBytes);
+	const std::uint32_t encodedSize = std::uint32_t(encoded.size() - headerAt - sizeof(BlockHeader));
+	std::memcpy(encoded.data() + headerAt, &encodedSize, sizeof(encodedSize));
+}
+
+void MemoryMappedFileEncoded::writeBlocks(const std::string &fileName, int firstBlock) const
+{
+	const std::string name = extendedFileName(fileName);
+	std::vector<std::int64_t> offsets;
+	FILE* output = nullptr;
+	if (firstBlock == 0) {
+		output = fopen(name.c_str(), "wb");
+	} else {
+		offsets.assign(blockOffsets_.begin(), blockOffsets_.begin() + firstBlock + 1);
+		output = fopen(name.c_str(), "r+b");
+	}
+	if (!output)
+		throw(std::runtime_error("Could not open file " + name));
+
+	std::vector<std::uint8_t> buffer;
+	std::chrono::steady_clock::duration encodingTime = {};
+	std::chrono::steady_clock::duration writingTime = {};
+	std::int64_t written = 0;
+	bool succeeded = true;
+	auto writeBuffer = [&] {
+		const auto start = std::chrono::steady_clock::now();
+		succeeded = succeeded && fwrite(buffer.data(), 1, buffer.size(), output) == buffer.size();
+		writingTime += std::chrono::steady_clock::now() - start;
+		written += std::int64_t(buffer.size());
+		buffer.clear();
+	};
+
+	FileHeader header = {};
+	std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = FORMAT_VERSION;
+	header.dataSize = data_.size();
+	header.recordSize = std::uint32_t(layout_.recordSize());
+	header.blockRecords = std::uint32_t(blockRecords_);
+	header.fields = std::uint32_t(layout_.fields().size());
+	if (firstBlock == 0) {
+		put(buffer, header);
+		for (const MemoryMappedFileField &field : layout_.fields())
+			put(buffer, FieldHeader{ std::uint32_t(field.offset), std::uint8_t(field.width), std::uint8_t(field.transform), 0 });
+		offsets.push_back(std::int64_t(buffer.size()));
+	} else {
+		// Only the size in the header changes
+		succeeded = fseek(output, long(offsetof(FileHeader, dataSize)), SEEK_SET) == 0
+				&& fwrite(&header.dataSize, sizeof(header.dataSize), 1, output) == 1 && fseek(output, long(offsets.back()), SEEK_SET) == 0;
+	}
+
+	for (std::int64_t from = std::int64_t(firstBlock) * blockBytes(); succeeded && from < std::int64_t(data_.size()); from += blockBytes()) {
+		const auto start = std::chrono::steady_clock::now();
+		const std::size_t before = buffer.size();
+		encodeBlock(int(from), buffer);
+		offsets.push_back(offsets.back() + std::int64_t(buffer.size() - before));
+		encodingTime += std::chrono::steady_clock::now() - start;
+		if (buffer.size() >= WRITE_BUFFER_SIZE)
+			writeBuffer();
+	}
+	if (succeeded)
+		writeBuffer();
+	succeeded = (fclose(output) == 0) && succeeded;
+	if (succeeded && firstBlock > 0) {
+		// The rewritten blocks may be shorter than before
+		std::error_code error;
+		std::filesystem::resize_file(name, std::uintmax_t(offsets.back()), error);
+		succeeded = !error;
+	}
+	if (!succeeded)
+		throw(std::runtime_error("Could not write to file " + name));
+
+	statistics_.record(MemoryMappedFileTiming::ENCODE, encodingTime);
+	statistics_.record(MemoryMappedFileTiming::WRITE, writingTime);
+	statistics_.add(firstBlock == 0 ? MemoryMappedFileCounter::FULL_FLUSHES : MemoryMappedFileCounter::APPEND_FLUSHES);
+	statistics_.add(MemoryMappedFileCounter::BYTES_WRITTEN, written);
+	if (fileName == fileName_)
+		blockOffsets_ = std::move(offsets);
+}
+
+void MemoryMappedFileEncoded::load(const std::string &fileName, int until)
+{
+	if (fileName != fileName_) {
+		flush();
+		reset();
+		fileName_ = fileName;
+	}
+	load(until);
+}
+
+void MemoryMappedFileEncoded::flush() const
+{
+	flush(fileName_);
+	modified_ = false;
+}
+
+void MemoryMappedFileEncoded::flush(const std::string &fileName) const
+{
+	if (fileName != fileName_) {
+		load();
+		MemoryMappedFileStopwatch stopwatch(statistics_, MemoryMappedFileTiming::FLUSH);
+		writeBlocks(fileName, 0);
+		return;
+	}
+	const bool appended = (fileSize_ >= 0 && int(data_.size()) > fileSize_);
+	if (!modified_ && !appended)
+		return;
+
+	// If modified, it must be fully loaded, the blocks before the first modified one stay as they are
+	MemoryMappedFileStopwatch stopwatch(statistics_, MemoryMappedFileTiming::FLUSH);
+	int firstBlock = 0;
+	if (fileSize_ > 0) {
+		firstBlock = std::min<int>(std::min<int>(fileSize_, int(data_.size())), firstDirtyByte()) / blockBytes();
+		if (firstBlock >= int(blockOffsets_.size()))
+			firstBlock = 0;
+	}
+	writeBlocks(fileName, firstBlock);
+	loadedUntil_ = int(data_.size());
+	fileSize_ = int(data_.size());
+	clearDirtyPages();
+	updateResidentBytes();
+	acknowledgeChanges();
+}
+
+void MemoryMappedFileEncoded::append(const std::vector<std::uint8_t>& added)
+{
+	load();
+	reserveData(data_.size() + added.size());
+	data_.insert(data_.end(), added.begin(), added.end());
+}
+
+void MemoryMappedFileEncoded::append(const std::uint8_t *added, int size)
+{
+	load();
+	reserveData(data_.size() + size);
+	data_.insert(data_.end(), added, added + size);
+}
+
+void MemoryMappedFileEncoded::push_back(std::uint8_t added)
+{
+	load();
+	reserveData(data_.size() + 1);
+	data_.push_back(added);
+}
+
+const MemoryMappedFileLayout &MemoryMappedFileEncoded::layout() const
+{
+	if (fileSize_ < 0)
+		readHeader();
+	return layout_;
+}
+
+const std::string &MemoryMappedFileEncoded::standardExtension()
+{
+	static std::string retval = "enc";
+	return retval;
+}
@@ -0,0 +1,184 @@
+/*!
+* \file memory_mapped_file_encoded.hpp
+* \date 2026/10/18 19:35
+*
+* \author Ján Dugáček
+*
+* \brief Class wrapping contents of a file of records encoded field by field
+*
+* The records are split into blocks and every field of the records in a block is stored as a column. Each column is transformed according to
+* the type of data it holds (differences of consecutive values, differences of differences or indexes into a dictionary), the results are
+* bit-packed. It's far faster than LZMA and compresses timestamps and slowly changing measurements better.
+*
+* \note Values are stored in the byte order of the machine, so the files can be read only on machines with the same byte order
+*/
+
+#ifndef MEMORY_MAPPED_FILE_ENCODED_H
+#define MEMORY_MAPPED_FILE_ENCODED_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "memory_mapped_file_base.hpp"
+
+enum class MemoryMappedFileTransform : std::uint8_t {
+	RAW, // Stored as it is
+	DELTA, // Differences between consecutive values, for slowly changing values
+	DELTA_OF_DELTA, // Differences between consecutive differences, for timestamps and counters
+	DICTIONARY // Indexes into a list of values used in the block, for values that have only a few possible states
+};
+
+struct MemoryMappedFileField {
+	int offset; // Position of the field in the record, offsetof() can be used to obtain it
+	int width; // Size of the field, must be 1, 2, 4 or 8 bytes
+	MemoryMappedFileTransform transform;
+};
+
+class MemoryMappedFileLayout {
+	int recordSize_;
+	std::vector<MemoryMappedFileField> fields_;
+
+public:
+	/*!
+	* \brief Constructor, describes the fields of records and how are they encoded
+	*
+	* \param Size of the record
+	* \param The fields, parts of the record not covered by any of them are stored raw
+	* \note Integer fields are expected, the transforms work on floating point fields too but they don't compress them well
+	*/
+	MemoryMappedFileLayout(int recordSize, const std::vector<MemoryMappedFileField> &fields);
+
+	/*!
+	* \brief Returns the size of the record
+	*
+	* \return The size in bytes
+	*/
+	int recordSize() const
+	{
+		return recordSize_;
+	}
+
+	/*!
+	* \brief Returns the fields sorted by position, including the raw ones covering parts not described by the user
+	*
+	* \return The fields
+	*/
+	const std::vector<MemoryMappedFileField> &fields() const
+	{
+		return fields_;
+	}
+};
+
+class MemoryMappedFileEncoded final : public MemoryMappedFileBase {
+	virtual std::string fileNameExtension() const override
+	{
+		return ".enc";
+	}
+	mutable MemoryMappedFileLayout layout_;
+	mutable int blockRecords_;
+	mutable std::vector<std::int64_t> blockOffsets_; // Positions of the loaded blocks in the file and the position of the next one
+
+	void reset();
+	int blockBytes() const;
+	int firstDirtyByte() const;
+	void readHeader() const;
+	void decodeBlock(const std::uint8_t* encoded, int encodedSize, int records, int tailBytes, std::vector<std::uint64_t> &values,
+			std::vector<std::uint32_t> &narrowValues) const;
+	void encodeBlock(int from, std::vector<std::uint8_t> &encoded) const;
+	void writeBlocks(const std::string &fileName, int firstBlock) const;
+
+public:
+	/*!
+	* \brief Constructor: loads file if exists, or starts holding an empty string
+	*
+	* \param Name of the file, without suffix
+	* \param Description of the records
+	* \param Memory resource to allocate the contents from
+	* \note If the file exists, it's read with the layout that was used to write it and its size of record must match
+	*/
+	MemoryMappedFileEncoded(const std::string &fileName, const MemoryMappedFileLayout &layout,
+			std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+
+	/*!
+	* \brief Destructor, flushes changes
+	*/
+	virtual ~MemoryMappedFileEncoded() override;
+
+	/*!
+	* \brief Gets size of the data
+	*
+	* \return Size of the data
+	* \note Obtained from the file's header
+	*/
+	virtual int size() const override;
+
+	/*!
+	* \brief Loads the file up to the given byte, decoding whole blocks
+	*
+	* \param How many bytes have to be loaded, negative number means load all
+	*/
+	virtual void load(int until = -1) const override;
+
+	/*!
+	* \brief Flushes and abandons the old file if necessary, loads a new one if necessary and loads up to the given byte
+	*
+	* \param Name of the new file to load, initialises to empty string if the file doesn't exist
+	* \param How many bytes have to be loaded, negative number means load all
+	*/
+	virtual void load(const std::string &fileName, int until = -1) override;
+
+	/*!
+	* \brief Saves the contents if it was modified into the last file it was loaded from
+	*
+	* \note Only the blocks behind the first modified one are encoded and written again
+	*/
+	virtual void flush() const override;
+
+	/*!
+	* \brief Saves the contents if it was modified into the specified file
+	*
+	* \param The name of the file to save to
+	*/
+	virtual void flush(const std::string &fileName) const override;
+
+	/*!
+	* \brief Appends data at the end of the file
+	*
+	* \param Vector of bytes to append
+	* \note This overrides parent's method to allow rewriting only the last blocks if only this method was used to modify it
+	*/
+	virtual void append(const std::vector<std::uint8_t> &added) override;
+
+	/*!
+	* \brief Appends data at the end of the file
+	*
+	* \param Raw pointer to the data
+	* \param Size of the data in bytes
+	* \note This overrides parent's method to allow rewriting only the last blocks if only this method was used to modify it
+	*/
+	virtual void append(const std::uint8_t* added, int size) override;
+
+	/*!
+	* \brief Appends a byte at the end of the file
+	*
+	* \param The byte to append
+	* \note This overrides parent's method to allow rewriting only the last blocks if only this method was used to modify it
+	*/
+	virtual void push_back(std::uint8_t added) override;
+
+	/*!
+	* \brief Returns the layout of records
+	*
+	* \return The layout, the one from the file if it was loaded from a file
+	*/
+	const MemoryMappedFileLayout &layout() const;
+
+	/*!
+	* \brief Returns the extension typical for this type of archive
+	*
+	* \return The extension, without point
+	*/
+	static const std::string &standardExtension();
+};
+
+#endif //MEMORY_MAPPED_FILE_ENCODED_H
@@ -0,0 +1,417 @@
+/*!
+* \file memory_mapped_file_index.hpp
+* \date 2026/10/18 11:40
+*
+* \author Ján Dugáček
+*
+* \brief B+tree mapping keys of records stored in a MemoryMappedFile to indexes of these records
+*
+* The tree is kept in its own file as an array of nodes of constant size, so it uses the same archivers as MemoryMappedFile. The first node
+* holds the tree's metadata. New nodes are appended and modified nodes only mark their pages as modified, so flushing writes only these. Keys don't have to be unique, entries are ordered by the key and then by the index of the record.
+*
+* \note The key must be trivially copyable, default constructible and comparable through operator<
+*/
+
+#ifndef MEMORY_MAPPED_FILE_INDEX_H
+#define MEMORY_MAPPED_FILE_INDEX_H
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <functional>
+#include <utility>
+#include "memory_mapped_file.hpp"
+#include "memory_mapped_file_uncompressed.hpp"
+
+template<typename Key, int nodeSize = 64>
+struct MemoryMappedFileIndexNode {
+	static constexpr int HEADER_SIZE = 8;
+	static constexpr int LEAF_CAPACITY = (nodeSize - HEADER_SIZE) / int(sizeof(Key) + sizeof(std::int32_t));
+	static constexpr int INNER_CAPACITY = (nodeSize - HEADER_SIZE) / int(sizeof(Key) + 2 * sizeof(std::int32_t));
+	static_assert(INNER_CAPACITY >= 3, "The node is too small to hold the key, use a larger node size");
+
+	// Keys, record indexes and children are stored as separate arrays to keep the keys together when searching
+	std::int16_t count;
+	std::int16_t leaf;
+	std::int32_t next;
+	std::uint8_t payload[nodeSize - HEADER_SIZE];
+
+	int capacity() const
+	{
+		return leaf ? LEAF_CAPACITY : INNER_CAPACITY;
+	}
+
+	Key key(int at) const
+	{
+		Key retval;
+		memcpy(&retval, payload + at * sizeof(Key), sizeof(Key));
+		return retval;
+	}
+
+	std::int32_t record(int at) const
+	{
+		std::int32_t retval;
+		memcpy(&retval, payload + capacity() * sizeof(Key) + at * sizeof(std::int32_t), sizeof(std::int32_t));
+		return retval;
+	}
+
+	std::int32_t child(int at) const
+	{
+		std::int32_t retval;
+		memcpy(&retval, payload + INNER_CAPACITY * (sizeof(Key) + sizeof(std::int32_t)) + at * sizeof(std::int32_t), sizeof(std::int32_t));
+		return retval;
+	}
+
+	void set(int at, const Key &key, std::int32_t record, std::int32_t child)
+	{
+		memcpy(payload + at * sizeof(Key), &key, sizeof(Key));
+		memcpy(payload + capacity() * sizeof(Key) + at * sizeof(std::int32_t), &record, sizeof(std::int32_t));
+		if (!leaf)
+			memcpy(payload + INNER_CAPACITY * (sizeof(Key) + sizeof(std::int32_t)) + at * sizeof(std::int32_t), &child, sizeof(std::int32_t));
+	}
+
+	void insert(int at, const Key &key, std::int32_t record, std::int32_t child)
+	{
+		for (int i = count; i > at; i--)
+			set(i, this->key(i - 1), this->record(i - 1), leaf ? 0 : this->child(i - 1));
+		set(at, key, record, child);
+		count++;
+	}
+
+	void moveTail(int from, MemoryMappedFileIndexNode &to)
+	{
+		for (int i = from; i < count; i++)
+			to.set(i - from, key(i), record(i), leaf ? 0 : child(i));
+		to.count = std::int16_t(count - from);
+		count = std::int16_t(from);
+	}
+};
+
+template<typename T, typename Key, typename archiverType = MemoryMappedFileUncompressed, int nodeSize = 64>
+class MemoryMappedFileIndex {
+public:
+	using Node = MemoryMappedFileIndexNode<Key, nodeSize>;
+
+private:
+	static_assert(sizeof(Node) == nodeSize, "Node size must be a multiple of 4");
+
+	struct Meta {
+		std::int32_t root;
+		std::int32_t height;
+		std::int32_t nodes;
+		std::int32_t entries;
+		std::int32_t indexed;
+	};
+
+	struct Split {
+		Key key;
+		std::int32_t record;
+		std::int32_t node;
+	};
+
+	MemoryMappedFile<T> &records_;
+	std::function<Key(const T &)> key_;
+	MemoryMappedFile<Node, archiverType> nodes_;
+	Meta meta_;
+
+	static bool less(const Key &key, int record, const Key &otherKey, int otherRecord)
+	{
+		return key < otherKey || (!(otherKey < key) && record < otherRecord);
+	}
+
+	Node readNode(int at) const
+	{
+		return static_cast<const MemoryMappedFile<Node> &>(nodes_)[at];
+	}
+
+	void writeNode(int at, const Node &node)
+	{
+		if (at == meta_.nodes) {
+			nodes_.push_back(node);
+			meta_.nodes++;
+		}
+		else
+			nodes_[at] = node;
+	}
+
+	void writeMeta()
+	{
+		Node node{};
+		memcpy(node.payload, &meta_, sizeof(Meta));
+		nodes_[0] = node;
+	}
+
+	int childFor(const Node &node, const Key &key, int record) const
+	{
+		for (int i = node.count - 1; i > 0; i--)
+			if (!less(key, record, node.key(i), node.record(i)))
+				return i;
+		return 0;
+	}
+
+	bool insertInto(int at, const Key &key, int record, Split &split)
+	{
+		Node node = readNode(at);
+		if (node.leaf) {
+			int position = 0;
+			while (position < node.count && less(node.key(position), node.record(position), key, record))
+				position++;
+			return insertEntry(at, node, position, key, record, 0, split);
+		}
+
+		const int childPosition = childFor(node, key, record);
+		Split childSplit;
+		if (!insertInto(node.child(childPosition), key, record, childSplit))
+			return false;
+		return insertEntry(at, node, childPosition + 1, childSplit.key, childSplit.record, childSplit.node, split);
+	}
+
+	bool insertEntry(int at, Node &node, int position, const Key &key, int record, std::int32_t child, Split &split)
+	{
+		if (node.count < node.capacity()) {
+			node.insert(position, key, record, child);
+			writeNode(at, node);
+			return false;
+		}
+
+		Node right{};
+		right.leaf = node.leaf;
+		node.moveTail((node.count + 1) / 2, right);
+		if (position <= node.count)
+			node.insert(position, key, record, child);
+		else
+			right.insert(position - node.count, key, record, child);
+
+		split.node = meta_.nodes;
+		split.key = right.key(0);
+		split.record = right.record(0);
+		if (node.leaf) {
+			right.next = node.next;
+			node.next = split.node;
+		}
+		writeNode(split.node, right);
+		writeNode(at, node);
+		return true;
+	}
+
+	template<typename Callback>
+	void scan(const Key &from, Callback callback) const
+	{
+		if (meta_.root < 0) return;
+		int at = meta_.root;
+		Node node = readNode(at);
+		while (!node.leaf) {
+			at = node.child(childFor(node, from, INT_MIN));
+			node = readNode(at);
+		}
+		while (true) {
+			for (int i = 0; i < node.count; i++) {
+				if (node.key(i) < from) continue;
+				if (!callback(node.key(i), node.record(i)))
+					return;
+			}
+			if (node.next <= 0) return;
+			node = readNode(node.next);
+		}
+	}
+
+public:
+	/*!
+	* \brief Constructor, opens the index and indexes records that were added since it was last used
+	*
+	* \param The file with the records
+	* \param Name of the file holding the index
+	* \param Function obtaining the key from a record
+	*/
+	MemoryMappedFileIndex(MemoryMappedFile<T> &records, const std::string &fileName, std::function<Key(const T &)> key) :
+		records_(records), key_(std::move(key)), nodes_(fileName)
+	{
+		if (nodes_.size() == 0) {
+			meta_ = { -1, 0, 1, 0, 0 };
+			Node node{};
+			memcpy(node.payload, &meta_, sizeof(Meta));
+			nodes_.push_back(node);
+		} else
+			memcpy(&meta_, readNode(0).payload, sizeof(Meta));
+		update();
+	}
+
+	/*!
+	* \brief Destructor, flushes the index
+	*/
+	~MemoryMappedFileIndex() = default;
+
+	/*!
+	* \brief Appends a record to the file and indexes it
+	*
+	* \param The record
+	* \note Assumes the index is up to date, call update() if records were appended in other ways
+	*/
+	void push_back(const T &added)
+	{
+		records_.push_back(added);
+		const int record = meta_.indexed++;
+		insert(key_(added), record); // Also writes the metadata
+	}
+
+	/*!
+	* \brief Adds an entry into the tree without checking the records
+	*
+	* \param The key
+	* \param Index of the record
+	*/
+	void insert(const Key &key, int record)
+	{
+		if (meta_.root < 0) {
+			Node leaf{};
+			leaf.leaf = 1;
+			leaf.insert(0, key, record, 0);
+			meta_.root = meta_.nodes;
+			meta_.height = 1;
+			writeNode(meta_.root, leaf);
+		} else {
+			Split split;
+			if (insertInto(meta_.root, key, record, split)) {
+				Node oldRoot = readNode(meta_.root);
+				Node root{};
+				root.insert(0, oldRoot.key(0), oldRoot.record(0), meta_.root);
+				root.insert(1, split.key, split.record, split.node);
+				meta_.root = meta_.nodes;
+				meta_.height++;
+				writeNode(meta_.root, root);
+			}
+		}
+		meta_.entries++;
+		writeMeta();
+	}
+
+	/*!
+	* \brief Indexes the records appended since the last update, rebuilds the index if the file has shrunk
+	*/
+	void update()
+	{
+		const int available = records_.size();
+		if (meta_.indexed > available) {
+			rebuild();
+			return;
+		}
+		const MemoryMappedFile<T> &records = records_;
+		for (int i = meta_.indexed; i < available; i++) {
+			meta_.indexed = i + 1;
+			insert(key_(records[i]), i);
+		}
+	}
+
+	/*!
+	* \brief Discards the tree and builds it again from all records, sorting them first and filling the nodes completely
+	*/
+	void rebuild()
+	{
+		const MemoryMappedFile<T> &records = records_;
+		const int available = records.size();
+		std::vector<std::pair<Key, std::int32_t>> entries;
+		entries.reserve(static_cast<unsigned int>(available));
+		for (int i = 0; i < available; i++)
+			entries.emplace_back(key_(records[i]), i);
+		std::sort(entries.begin(), entries.end(), [] (const std::pair<Key, std::int32_t> &first, const std::pair<Key, std::int32_t> &second) {
+			return less(first.first, first.second, second.first, second.second);
+		});
+
+		std::vector<Node> nodes(1, Node{});
+		std::vector<Split> level;
+		for (unsigned int i = 0; i < entries.size(); i += Node::LEAF_CAPACITY) {
+			Node leaf{};
+			leaf.leaf = 1;
+			for (unsigned int j = i; j < entries.size() && j < i + Node::LEAF_CAPACITY; j++)
+				leaf.insert(leaf.count, entries[j].first, entries[j].second, 0);
+			if (!level.empty())
+				nodes.back().next = std::int32_t(nodes.size());
+			level.push_back({ entries[i].first, entries[i].second, std::int32_t(nodes.size()) });
+			nodes.push_back(leaf);
+		}
+
+		meta_ = { -1, 0, 0, int(entries.size()), available };
+		if (!level.empty())
+			meta_.height = 1;
+		while (level.size() > 1) {
+			std::vector<Split> upper;
+			for (unsigned int i = 0; i < level.size(); i += Node::INNER_CAPACITY) {
+				Node inner{};
+				for (unsigned int j = i; j < level.size() && j < i + Node::INNER_CAPACITY; j++)
+					inner.insert(inner.count, level[j].key, level[j].record, level[j].node);
+				upper.push_back({ level[i].key, level[i].record, std::int32_t(nodes.size()) });
+				nodes.push_back(inner);
+			}
+			level.swap(upper);
+			meta_.height++;
+		}
+		if (!level.empty())
+			meta_.root = level.front().node;
+		meta_.nodes = int(nodes.size());
+		memcpy(nodes.front().payload, &meta_, sizeof(Meta));
+		nodes_.swap(nodes.data(), int(nodes.size()));
+	}
+
+	/*!
+	* \brief Finds all records with the given key
+	*
+	* \param The key
+	* \return Indexes of the records, in ascending order
+	*/
+	std::vector<int> find(const Key &key) const
+	{
+		std::vector<int> found;
+		scan(key, [&] (const Key &entry, int record) {
+			if (key < entry) return false;
+			found.push_back(record);
+			return true;
+		});
+		return found;
+	}
+
+	/*!
+	* \brief Calls a function on all entries whose key is in the given range, ordered by key
+	*
+	* \param The lowest key, inclusive
+	* \param The highest key, inclusive
+	* \param The function, receiving the key and the index of the record
+	*/
+	void forEach(const Key &from, const Key &to, const std::function<void(const Key &, int)> &function) const
+	{
+		scan(from, [&] (const Key &entry, int record) {
+			if (to < entry) return false;
+			function(entry, record);
+			return true;
+		});
+	}
+
+	/*!
+	* \brief Gets the number of entries in the tree
+	*
+	* \return The number of entries
+	*/
+	int size() const
+	{
+		return meta_.entries;
+	}
+
+	/*!
+	* \brief Gets the number of levels of the tree
+	*
+	* \return The height, zero if empty
+	*/
+	int height() const
+	{
+		return meta_.height;
+	}
+
+	/*!
+	* \brief Saves the index if it was modified
+	*/
+	void flush() const
+	{
+		nodes_.flush();
+	}
+};
+
+#endif //MEMORY_MAPPED_FILE_INDEX_H
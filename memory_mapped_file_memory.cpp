@@ -0,0 +1,163 @@
+#include "memory_mapped_file_memory.hpp"
+#include <cstdint>
+#include <new>
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+constexpr std::size_t HUGE_PAGE_SIZE = (1 << 21);
+constexpr std::size_t SMALL_ALLOCATION = (1 << 16); // Smaller allocations would waste more than they could gain
+constexpr int MEMORY_POLICY_PREFERRED = 1; // MPOL_PREFERRED, numaif.h may not be installed
+constexpr int MEMORY_POLICY_NODES = 1024;
+
+namespace {
+std::size_t roundUp(std::size_t size, std::size_t to)
+{
+	return (size + to - 1) / to * to;
+}
+
+#ifdef __linux__
+void* mapAligned(std::size_t size, std::size_t alignment)
+{
+	// Maps more than necessary and unmaps the unaligned edges
+	const std::size_t mapped = size + alignment;
+	void* raw = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (raw == MAP_FAILED)
+		throw std::bad_alloc();
+	const std::uintptr_t start = reinterpret_cast<std::uintptr_t>(raw);
+	const std::uintptr_t aligned = roundUp(start, alignment);
+	if (aligned > start)
+		munmap(raw, aligned - start);
+	if (start + mapped > aligned + size)
+		munmap(reinterpret_cast<void*>(aligned + size), start + mapped - aligned - size);
+	return reinterpret_cast<void*>(aligned);
+}
+#endif
+}
+
+MemoryMappedFileHugePages::MemoryMappedFileHugePages(bool explicitPages) :
+	explicitPages_(explicitPages)
+{
+}
+
+void* MemoryMappedFileHugePages::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+#ifdef __linux__
+	if (bytes >= SMALL_ALLOCATION) {
+		const std::size_t size = roundUp(bytes, HUGE_PAGE_SIZE);
+		if (explicitPages_) {
+			void* allocated = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if (allocated != MAP_FAILED)
+				return allocated;
+		}
+		void* allocated = mapAligned(size, HUGE_PAGE_SIZE);
+		madvise(allocated, size, MADV_HUGEPAGE);
+		return allocated;
+	}
+#endif
+	return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+void MemoryMappedFileHugePages::do_deallocate(void* pointer, std::size_t bytes, std::size_t alignment)
+{
+#ifdef __linux__
+	if (bytes >= SMALL_ALLOCATION) {
+		munmap(pointer, roundUp(bytes, HUGE_PAGE_SIZE));
+		return;
+	}
+#endif
+	std::pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+}
+
+bool MemoryMappedFileHugePages::do_is_equal(const std::pmr::memory_resource &other) const noexcept
+{
+	return this == &other;
+}
+
+std::size_t MemoryMappedFileHugePages::pageSize()
+{
+	return HUGE_PAGE_SIZE;
+}
+
+MemoryMappedFileNumaLocal::MemoryMappedFileNumaLocal(int node) :
+	node_(node)
+{
+}
+
+void* MemoryMappedFileNumaLocal::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+#ifdef __linux__
+	if (bytes >= SMALL_ALLOCATION) {
+		const std::size_t size = roundUp(bytes, std::size_t(sysconf(_SC_PAGESIZE)));
+		void* allocated = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (allocated == MAP_FAILED)
+			throw std::bad_alloc();
+		const int node = (node_ >= 0) ? node_ : currentNode();
+		unsigned long nodes[MEMORY_POLICY_NODES / (8 * sizeof(unsigned long))] = {};
+		if (node < MEMORY_POLICY_NODES) {
+			nodes[node / (8 * sizeof(unsigned long))] |= 1ul << (node % (8 * sizeof(unsigned long)));
+			// If it fails, the pages are placed according to the default policy, which is usually the same
+			syscall(SYS_mbind, allocated, size, MEMORY_POLICY_PREFERRED, nodes, MEMORY_POLICY_NODES, 0);
+		}
+		return allocated;
+	}
+#endif
+	return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+void MemoryMappedFileNumaLocal::do_deallocate(void* pointer, std::size_t bytes, std::size_t alignment)
+{
+#ifdef __linux__
+	if (bytes >= SMALL_ALLOCATION) {
+		munmap(pointer, roundUp(bytes, std::size_t(sysconf(_SC_PAGESIZE))));
+		return;
+	}
+#endif
+	std::pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+}
+
+bool MemoryMappedFileNumaLocal::do_is_equal(const std::pmr::memory_resource &other) const noexcept
+{
+	return this == &other;
+}
+
+int MemoryMappedFileNumaLocal::currentNode()
+{
+#ifdef __linux__
+	unsigned int cpu = 0;
+	unsigned int node = 0;
+	if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0)
+		return int(node);
+#endif
+	return 0;
+}
+
+MemoryMappedFileArena::MemoryMappedFileArena(std::size_t size, std::size_t largestPooled) :
+	buffer_(new std::byte[size]),
+	largestPooled_(largestPooled),
+	preallocated_(buffer_.get(), size),
+	pool_(std::pmr::pool_options{ 0, largestPooled }, &preallocated_)
+{
+}
+
+void* MemoryMappedFileArena::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+	if (bytes > largestPooled_)
+		return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+	return pool_.allocate(bytes, alignment);
+}
+
+void MemoryMappedFileArena::do_deallocate(void* pointer, std::size_t bytes, std::size_t alignment)
+{
+	if (bytes > largestPooled_)
+		std::pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+	else
+		pool_.deallocate(pointer, bytes, alignment);
+}
+
+bool MemoryMappedFileArena::do_is_equal(const std::pmr::memory_resource &other) const noexcept
+{
+	return this == &other;
+}
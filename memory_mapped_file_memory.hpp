@@ -0,0 +1,90 @@
+/*!
+* \file memory_mapped_file_memory.hpp
+* \date 2026/10/18 14:10
+*
+* \author Ján Dugáček
+*
+* \brief Memory resources for allocating the contents of files
+*
+* Any std::pmr::memory_resource can be given to the archivers' constructors, these are the ones useful for large files or many small ones.
+* Huge pages and NUMA placement are available only on Linux, elsewhere the resources allocate through new and delete.
+*/
+
+#ifndef MEMORY_MAPPED_FILE_MEMORY_H
+#define MEMORY_MAPPED_FILE_MEMORY_H
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+
+class MemoryMappedFileHugePages : public std::pmr::memory_resource {
+	bool explicitPages_;
+
+protected:
+	void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+	void do_deallocate(void* pointer, std::size_t bytes, std::size_t alignment) override;
+	bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+
+public:
+	/*!
+	* \brief Constructor
+	*
+	* \param Whether to use reserved huge pages (hugetlbfs) rather than transparent huge pages, it falls back to transparent ones if none are available
+	*/
+	MemoryMappedFileHugePages(bool explicitPages = false);
+
+	/*!
+	* \brief Returns the size of a huge page, allocations are rounded up to it
+	*
+	* \return The size in bytes
+	*/
+	static std::size_t pageSize();
+};
+
+class MemoryMappedFileNumaLocal : public std::pmr::memory_resource {
+	int node_;
+
+protected:
+	void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+	void do_deallocate(void* pointer, std::size_t bytes, std::size_t alignment) override;
+	bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+
+public:
+	/*!
+	* \brief Constructor
+	*
+	* \param The NUMA node to allocate the memory at, negative number means the node of the thread that allocates
+	*/
+	MemoryMappedFileNumaLocal(int node = -1);
+
+	/*!
+	* \brief Returns the NUMA node of the calling thread
+	*
+	* \return Index of the node, 0 if it can't be determined
+	*/
+	static int currentNode();
+};
+
+class MemoryMappedFileArena : public std::pmr::memory_resource {
+	std::unique_ptr<std::byte[]> buffer_;
+	std::size_t largestPooled_;
+	std::pmr::monotonic_buffer_resource preallocated_;
+	std::pmr::synchronized_pool_resource pool_;
+
+protected:
+	void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+	void do_deallocate(void* pointer, std::size_t bytes, std::size_t alignment) override;
+	bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+
+public:
+	/*!
+	* \brief Constructor, preallocates the whole arena
+	*
+	* \param Size of the arena in bytes, it takes more memory from new when it's exhausted
+	* \param Largest allocation that is pooled, larger ones are passed to new and delete
+	* \note Memory returned by files is reused by other files, but it's returned to the system only when the arena is destroyed
+	*/
+	MemoryMappedFileArena(std::size_t size, std::size_t largestPooled = (1 << 20));
+};
+
+#endif //MEMORY_MAPPED_FILE_MEMORY_H
@@ -0,0 +1,608 @@
+#include "memory_mapped_file_pack.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+constexpr char PACK_MAGIC[8] = { 'M', 'M', 'F', 'P', 'A', 'C', 'K', '1' };
+constexpr int PACK_HEADER_SIZE = 32;
+constexpr std::uint64_t EXTENT_ALIGNMENT = 64;
+constexpr std::uint64_t COMPACTION_THRESHOLD = 16 << 20;
+constexpr int COPIED_PART_SIZE = 1 << 20;
+constexpr float PACKED_LOADED_PART_INCREMENT = 1.5;
+constexpr int PACKED_LOADED_PART_MIN_INCREMENT = 1 << 12;
+
+static std::uint64_t alignExtent(std::uint64_t size)
+{
+	return (size + EXTENT_ALIGNMENT - 1) / EXTENT_ALIGNMENT * EXTENT_ALIGNMENT;
+}
+
+MemoryMappedFilePack::MemoryMappedFilePack(const std::string &fileName) :
+	fileName_(fileName),
+	descriptor_(-1),
+	end_(PACK_HEADER_SIZE),
+	directorySize_(0),
+	liveBytes_(0),
+	changes_(0),
+	directoryModified_(false)
+{
+#ifndef _WIN32
+	descriptor_ = open(path().c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (descriptor_ < 0)
+		throw(std::runtime_error("Could not open pack " + path()));
+	try {
+		const off_t fileSize = lseek(descriptor_, 0, SEEK_END);
+		if (fileSize > 0)
+			readDirectory(std::uint64_t(fileSize));
+		else {
+			directorySize_ = writeDirectory(descriptor_, end_, directory_);
+			end_ += directorySize_;
+		}
+	} catch (...) {
+		close(descriptor_);
+		throw;
+	}
+#else
+	throw(std::runtime_error("Packs are supported only on POSIX systems"));
+#endif
+}
+
+MemoryMappedFilePack::~MemoryMappedFilePack()
+{
+	try {
+		waitForCompaction();
+		std::lock_guard<std::mutex> lock(mutex_);
+		saveDirectory();
+	}
+	catch(std::exception &exception) {
+		std::cout << "Failed to flush: " << exception.what();
+	}
+#ifndef _WIN32
+	if (descriptor_ >= 0)
+		close(descriptor_);
+#endif
+}
+
+std::string MemoryMappedFilePack::path() const
+{
+	return fileName_ + "." + standardExtension();
+}
+
+void MemoryMappedFilePack::readAt(int descriptor, std::uint64_t offset, std::uint8_t* into, std::size_t size) const
+{
+#ifndef _WIN32
+	std::size_t done = 0;
+	while (done < size) {
+		const ssize_t obtained = pread(descriptor, into + done, size - done, off_t(offset + done));
+		if (obtained < 0 && errno == EINTR)
+			continue;
+		if (obtained <= 0)
+			throw(std::runtime_error("Could not read from pack " + path()));
+		done += std::size_t(obtained);
+	}
+#endif
+}
+
+void MemoryMappedFilePack::writeAt(int descriptor, std::uint64_t offset, const std::uint8_t* from, std::size_t size) const
+{
+#ifndef _WIN32
+	std::size_t done = 0;
+	while (done < size) {
+		const ssize_t written = pwrite(descriptor, from + done, size - done, off_t(offset + done));
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			throw(std::runtime_error("Could not write to pack " + path()));
+		done += std::size_t(written);
+	}
+#endif
+}
+
+void MemoryMappedFilePack::readDirectory(std::uint64_t fileSize)
+{
+	std::uint8_t header[PACK_HEADER_SIZE];
+	if (fileSize < PACK_HEADER_SIZE)
+		throw(std::runtime_error("File " + path() + " is not a pack"));
+	readAt(descriptor_, 0, header, PACK_HEADER_SIZE);
+	if (memcmp(header, PACK_MAGIC, sizeof(PACK_MAGIC)))
+		throw(std::runtime_error("File " + path() + " is not a pack"));
+	std::uint64_t directoryOffset = 0;
+	memcpy(&directoryOffset, header + 8, sizeof(directoryOffset));
+	memcpy(&directorySize_, header + 16, sizeof(directorySize_));
+	if (directoryOffset < PACK_HEADER_SIZE || directoryOffset + directorySize_ > fileSize)
+		throw(std::runtime_error("Directory of pack " + path() + " is damaged"));
+	end_ = fileSize;
+
+	std::vector<std::uint8_t> serialised(directorySize_);
+	readAt(descriptor_, directoryOffset, serialised.data(), serialised.size());
+	std::size_t position = 0;
+	auto take = [&] (void* into, std::size_t size) {
+		if (position + size > serialised.size())
+			throw(std::runtime_error("Directory of pack " + path() + " is damaged"));
+		memcpy(into, serialised.data() + position, size);
+		position += size;
+	};
+	std::uint32_t entries = 0;
+	take(&entries, sizeof(entries));
+	for (std::uint32_t i = 0; i < entries; i++) {
+		std::uint16_t nameLength = 0;
+		take(&nameLength, sizeof(nameLength));
+		std::string name(nameLength, '\0');
+		take(name.data(), nameLength);
+		Entry entry;
+		std::uint32_t extents = 0;
+		take(&entry.size, sizeof(entry.size));
+		take(&extents, sizeof(extents));
+		std::uint64_t capacity = 0;
+		for (std::uint32_t j = 0; j < extents; j++) {
+			Extent extent;
+			take(&extent.offset, sizeof(extent.offset));
+			take(&extent.capacity, sizeof(extent.capacity));
+			if (extent.offset < PACK_HEADER_SIZE || extent.offset + extent.capacity > directoryOffset)
+				throw(std::runtime_error("Directory of pack " + path() + " is damaged"));
+			capacity += extent.capacity;
+			entry.extents.push_back(extent);
+		}
+		if (entry.size < 0 || std::uint64_t(entry.size) > capacity)
+			throw(std::runtime_error("Directory of pack " + path() + " is damaged"));
+		liveBytes_ += capacity;
+		directory_.emplace(std::move(name), std::move(entry));
+	}
+}
+
+std::uint64_t MemoryMappedFilePack::writeDirectory(int descriptor, std::uint64_t at, const Directory &directory) const
+{
+	std::vector<std::uint8_t> serialised;
+	auto put = [&] (const void* from, std::size_t size) {
+		const std::uint8_t* bytes = reinterpret_cast<const std::uint8_t*>(from);
+		serialised.insert(serialised.end(), bytes, bytes + size);
+	};
+	const std::uint32_t entries = std::uint32_t(directory.size());
+	put(&entries, sizeof(entries));
+	for (auto &[name, entry] : directory) {
+		const std::uint16_t nameLength = std::uint16_t(name.size());
+		const std::uint32_t extents = std::uint32_t(entry.extents.size());
+		put(&nameLength, sizeof(nameLength));
+		put(name.data(), name.size());
+		put(&entry.size, sizeof(entry.size));
+		put(&extents, sizeof(extents));
+		for (const Extent &extent : entry.extents) {
+			put(&extent.offset, sizeof(extent.offset));
+			put(&extent.capacity, sizeof(extent.capacity));
+		}
+	}
+	writeAt(descriptor, at, serialised.data(), serialised.size());
+
+	// The header is changed only after the directory is written, so that an interruption leaves the previous one
+	std::uint8_t header[PACK_HEADER_SIZE] = {};
+	const std::uint64_t size = serialised.size();
+	memcpy(header, PACK_MAGIC, sizeof(PACK_MAGIC));
+	memcpy(header + 8, &at, sizeof(at));
+	memcpy(header + 16, &size, sizeof(size));
+	writeAt(descriptor, 0, header, PACK_HEADER_SIZE);
+	return size;
+}
+
+void MemoryMappedFilePack::saveDirectory()
+{
+	if (!directoryModified_)
+		return;
+	directorySize_ = writeDirectory(descriptor_, end_, directory_);
+	end_ += directorySize_;
+	directoryModified_ = false;
+}
+
+void MemoryMappedFilePack::reserve(Entry &entry, int size)
+{
+	std::uint64_t capacity = 0;
+	for (const Extent &extent : entry.extents)
+		capacity += extent.capacity;
+	if (std::uint64_t(size) <= capacity)
+		return;
+	// Growing files get more than they need, so that appending often doesn't split them into many extents
+	const std::uint64_t added = alignExtent(std::max<std::uint64_t>(std::uint64_t(size) - capacity, capacity / 2));
+	if (!entry.extents.empty() && entry.extents.back().offset + entry.extents.back().capacity == end_
+			&& entry.extents.back().capacity + added <= UINT32_MAX)
+		entry.extents.back().capacity += std::uint32_t(added); // It's the last thing in the pack, so it can grow in place
+	else
+		entry.extents.push_back({ end_, std::uint32_t(added) });
+	end_ += added;
+	liveBytes_ += added;
+	directoryModified_ = true;
+}
+
+void MemoryMappedFilePack::readExtents(const Entry &entry, int from, int size, std::uint8_t* into) const
+{
+	std::uint64_t extentStart = 0;
+	for (const Extent &extent : entry.extents) {
+		if (size <= 0)
+			break;
+		const std::uint64_t extentEnd = extentStart + extent.capacity;
+		if (std::uint64_t(from) < extentEnd) {
+			const int part = int(std::min<std::uint64_t>(std::uint64_t(size), extentEnd - std::uint64_t(from)));
+			readAt(descriptor_, extent.offset + (std::uint64_t(from) - extentStart), into, std::size_t(part));
+			from += part;
+			into += part;
+			size -= part;
+		}
+		extentStart = extentEnd;
+	}
+}
+
+void MemoryMappedFilePack::writeExtents(const Entry &entry, int from, int size, const std::uint8_t* data)
+{
+	std::uint64_t extentStart = 0;
+	for (const Extent &extent : entry.extents) {
+		if (size <= 0)
+			break;
+		const std::uint64_t extentEnd = extentStart + extent.capacity;
+		if (std::uint64_t(from) < extentEnd) {
+			const int part = int(std::min<std::uint64_t>(std::uint64_t(size), extentEnd - std::uint64_t(from)));
+			writeAt(descriptor_, extent.offset + (std::uint64_t(from) - extentStart), data, std::size_t(part));
+			from += part;
+			data += part;
+			size -= part;
+		}
+		extentStart = extentEnd;
+	}
+}
+
+bool MemoryMappedFilePack::contains(const std::string &name) const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return directory_.find(name) != directory_.end();
+}
+
+int MemoryMappedFilePack::size(const std::string &name) const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto found = directory_.find(name);
+	return found == directory_.end() ? 0 : found->second.size;
+}
+
+std::vector<std::string> MemoryMappedFilePack::names() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	std::vector<std::string> retval;
+	for (auto &[name, entry] : directory_)
+		retval.push_back(name);
+	return retval;
+}
+
+void MemoryMappedFilePack::read(const std::string &name, int from, int size, std::uint8_t* into) const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto found = directory_.find(name);
+	if (from < 0 || size < 0 || (size > 0 && (found == directory_.end() || from + size > found->second.size)))
+		throw(std::logic_error("Reading behind the end of file " + name + " in pack " + path()));
+	if (size > 0)
+		readExtents(found->second, from, size, into);
+}
+
+void MemoryMappedFilePack::write(const std::string &name, int from, int size, const std::uint8_t* data)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto found = directory_.find(name);
+	if (found == directory_.end()) {
+		found = directory_.emplace(name, Entry()).first;
+		directoryModified_ = true;
+	}
+	Entry &entry = found->second;
+	if (from < 0 || size < 0 || from > entry.size)
+		throw(std::logic_error("Writing behind the end of file " + name + " in pack " + path()));
+	reserve(entry, from + size);
+	writeExtents(entry, from, size, data);
+	if (from + size > entry.size) {
+		entry.size = from + size;
+		directoryModified_ = true;
+	}
+	entry.version = ++changes_;
+}
+
+void MemoryMappedFilePack::resize(const std::string &name, int size)
+{
+	const int previous = this->size(name);
+	if (size > previous) {
+		const std::vector<std::uint8_t> zeros(std::size_t(std::min(size - previous, COPIED_PART_SIZE)), 0);
+		for (int from = previous; from < size; from += int(zeros.size()))
+			write(name, from, std::min(int(zeros.size()), size - from), zeros.data());
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto found = directory_.find(name);
+	if (found == directory_.end())
+		found = directory_.emplace(name, Entry()).first;
+	found->second.size = size;
+	found->second.version = ++changes_;
+	directoryModified_ = true;
+}
+
+void MemoryMappedFilePack::remove(const std::string &name)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto found = directory_.find(name);
+	if (found == directory_.end())
+		return;
+	for (const Extent &extent : found->second.extents)
+		liveBytes_ -= extent.capacity;
+	directory_.erase(found);
+	directoryModified_ = true;
+}
+
+void MemoryMappedFilePack::flush()
+{
+	bool wasteful = false;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		saveDirectory();
+		const std::uint64_t wasted = end_ - PACK_HEADER_SIZE - liveBytes_ - directorySize_;
+		wasteful = wasted > std::max(liveBytes_, COMPACTION_THRESHOLD);
+	}
+	if (wasteful)
+		compactInBackground();
+}
+
+std::int64_t MemoryMappedFilePack::wastedBytes() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return std::int64_t(end_ - PACK_HEADER_SIZE - liveBytes_ - directorySize_);
+}
+
+void MemoryMappedFilePack::compact()
+{
+#ifndef _WIN32
+	std::lock_guard<std::mutex> compacting(compactionMutex_);
+	Directory compacted;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		compacted = directory_;
+	}
+	const std::string compactedPath = path() + ".compacting";
+	const int descriptor = open(compactedPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (descriptor < 0)
+		throw(std::runtime_error("Could not open file " + compactedPath));
+
+	std::uint64_t position = PACK_HEADER_SIZE;
+	std::vector<std::uint8_t> buffer;
+	// Moves a file into a single extent behind the files moved so far
+	auto move = [&] (Entry &entry) {
+		const std::uint64_t capacity = alignExtent(std::uint64_t(entry.size));
+		for (int from = 0; from < entry.size; from += COPIED_PART_SIZE) {
+			const int part = std::min(COPIED_PART_SIZE, entry.size - from);
+			buffer.resize(std::size_t(part));
+			readExtents(entry, from, part, buffer.data());
+			writeAt(descriptor, position + std::uint64_t(from), buffer.data(), buffer.size());
+		}
+		entry.extents.clear();
+		if (capacity > 0)
+			entry.extents.push_back({ position, std::uint32_t(capacity) });
+		position += capacity;
+	};
+
+	try {
+		// Only this function replaces the descriptor, so the old pack can be read without locking while others write into it
+		for (auto &[name, entry] : compacted)
+			move(entry);
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (auto it = compacted.begin(); it != compacted.end(); ) {
+			auto current = directory_.find(it->first);
+			if (current == directory_.end()) {
+				it = compacted.erase(it);
+			} else {
+				if (current->second.version != it->second.version) {
+					it->second = current->second;
+					move(it->second);
+				}
+				++it;
+			}
+		}
+		for (auto &[name, entry] : directory_) {
+			if (compacted.find(name) == compacted.end()) {
+				Entry added = entry;
+				move(added);
+				compacted.emplace(name, std::move(added));
+			}
+		}
+		const std::uint64_t directorySize = writeDirectory(descriptor, position, compacted);
+		if (rename(compactedPath.c_str(), path().c_str()) != 0)
+			throw(std::runtime_error("Could not replace pack " + path()));
+		close(descriptor_);
+		descriptor_ = descriptor;
+		directory_ = std::move(compacted);
+		directorySize_ = directorySize;
+		end_ = position + directorySize;
+		liveBytes_ = position - PACK_HEADER_SIZE;
+		directoryModified_ = false;
+	} catch (...) {
+		close(descriptor);
+		std::remove(compactedPath.c_str());
+		throw;
+	}
+#endif
+}
+
+void MemoryMappedFilePack::compactInBackground()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (compacting_.valid() && compacting_.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		return;
+	compacting_ = std::async(std::launch::async, [this] { compact(); });
+}
+
+void MemoryMappedFilePack::waitForCompaction()
+{
+	std::future<void> compacting;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		compacting = std::move(compacting_);
+	}
+	if (compacting.valid())
+		compacting.get();
+}
+
+const std::string &MemoryMappedFilePack::standardExtension()
+{
+	static std::string retval = "pack";
+	return retval;
+}
+
+void MemoryMappedFilePacked::reset()
+{
+	stopWatching();
+	preserveAllPages();
+	data_.clear();
+	clearDirtyPages();
+	modified_ = false;
+	loadedUntil_ = 0;
+	fileSize_ = pack_.size(fileName_);
+	appendedFrom_ = fileSize_;
+}
+
+MemoryMappedFilePacked::MemoryMappedFilePacked(const std::string &fileName, MemoryMappedFilePack &pack, std::pmr::memory_resource* memory) :
+	MemoryMappedFileBase(fileName, memory),
+	pack_(pack)
+{
+	reset();
+}
+
+MemoryMappedFilePacked::~MemoryMappedFilePacked()
+{
+	try {
+		flush();
+	}
+	catch(std::exception &exception) {
+		std::cout << "Failed to flush: " << exception.what();
+	}
+}
+
+int MemoryMappedFilePacked::size() const
+{
+	if (modified_) return int(data_.size());
+	return std::max<int>(int(data_.size()), fileSize_);
+}
+
+void MemoryMappedFilePacked::load(int until) const
+{
+	if (fullyLoaded() || (until >= 0 && loadedUntil_ > until)) return;
+	MemoryMappedFileStopwatch stopwatch(statistics_, MemoryMappedFileTiming::LOAD);
+	const int stopAt = (until >= 0) ? std::min(fileSize_, std::max(int(until * PACKED_LOADED_PART_INCREMENT), until + PACKED_LOADED_PART_MIN_INCREMENT))
+			: fileSize_;
+	const int formerLoadedUntil = loadedUntil_;
+	reserveData(std::size_t(stopAt));
+	std::pmr::vector<std::uint8_t> &data = const_cast<std::pmr::vector<std::uint8_t>&>(data_);
+	data.resize(std::size_t(stopAt));
+	pack_.read(fileName_, formerLoadedUntil, stopAt - formerLoadedUntil, data.data() + formerLoadedUntil);
+	loadedUntil_ = stopAt;
+	statistics_.add(MemoryMappedFileCounter::LOADS);
+	statistics_.add(MemoryMappedFileCounter::BYTES_READ, stopAt - formerLoadedUntil);
+	updateResidentBytes();
+}
+
+void MemoryMappedFilePacked::load(const std::string &fileName, int until)
+{
+	if (fileName != fileName_) {
+		flush();
+		fileName_ = fileName;
+		reset();
+	}
+	load(until);
+}
+
+void MemoryMappedFilePacked::flush() const
+{
+	flush(fileName_);
+	modified_ = false;
+}
+
+void MemoryMappedFilePacked::flush(const std::string &fileName) const
+{
+	if (!modified_ && appendedFrom_ >= int(data_.size()))
+		return;
+	MemoryMappedFileStopwatch stopwatch(statistics_, MemoryMappedFileTiming::FLUSH);
+	if (fileName != fileName_) {
+		pack_.resize(fileName, 0);
+		pack_.write(fileName, 0, int(data_.size()), data_.data());
+		statistics_.add(MemoryMappedFileCounter::FULL_FLUSHES);
+		statistics_.add(MemoryMappedFileCounter::BYTES_WRITTEN, std::int64_t(data_.size()));
+		return;
+	}
+
+	// If modified, it must be fully loaded
+	std::int64_t written = 0;
+	if (modified_) {
+		const int stored = std::min(int(data_.size()), appendedFrom_);
+		pack_.resize(fileName_, stored);
+		for (int page = 0; page << PAGE_BITS < stored; page++) {
+			if (!isDirty(page))
+				continue;
+			// Neighbouring modified pages are written at once
+			int last = page;
+			while ((last + 1) << PAGE_BITS < stored && isDirty(last + 1))
+				last++;
+			const int from = page << PAGE_BITS;
+			const int to = std::min((last + 1) << PAGE_BITS, stored);
+			pack_.write(fileName_, from, to - from, data_.data() + from);
+			written += to - from;
+			page = last;
+		}
+	}
+	if (appendedFrom_ < int(data_.size())) {
+		pack_.write(fileName_, appendedFrom_, int(data_.size()) - appendedFrom_, data_.data() + appendedFrom_);
+		written += int(data_.size()) - appendedFrom_;
+	}
+	statistics_.add(modified_ ? MemoryMappedFileCounter::FULL_FLUSHES : MemoryMappedFileCounter::APPEND_FLUSHES);
+	statistics_.add(MemoryMappedFileCounter::BYTES_WRITTEN, written);
+	appendedFrom_ = int(data_.size());
+	loadedUntil_ = int(data_.size());
+	fileSize_ = int(data_.size());
+	clearDirtyPages();
+	updateResidentBytes();
+}
+
+void MemoryMappedFilePacked::read(int from, int size, std::uint8_t* into) const
+{
+	// Bytes that aren't loaded can't have been modified, so they're the same as in the pack
+	if (!modified_ && from >= 0 && size > 0 && std::size_t(from) + std::size_t(size) > data_.size() && from + size <= fileSize_) {
+		const int done = std::clamp<int>(int(data_.size()) - from, 0, size);
+		if (done > 0)
+			std::copy_n(data_.begin() + from, done, into);
+		pack_.read(fileName_, from + done, size - done, into + done);
+		statistics_.add(MemoryMappedFileCounter::BYTES_READ, size - done);
+		return;
+	}
+	MemoryMappedFileBase::read(from, size, into);
+}
+
+void MemoryMappedFilePacked::append(const std::vector<std::uint8_t> &added)
+{
+	append(added.data(), int(added.size()));
+}
+
+void MemoryMappedFilePacked::append(const std::uint8_t* added, int size)
+{
+	load();
+	reserveData(data_.size() + size);
+	data_.insert(data_.end(), added, added + size);
+}
+
+void MemoryMappedFilePacked::push_back(std::uint8_t added)
+{
+	load();
+	reserveData(data_.size() + 1);
+	data_.push_back(added);
+}
+
+void MemoryMappedFilePacked::clear()
+{
+	MemoryMappedFileBase::clear();
+	appendedFrom_ = 0;
+	clearDirtyPages();
+}
@@ -0,0 +1,282 @@
+/*!
+* \file memory_mapped_file_pack.hpp
+* \date 2026/10/18 23:30
+*
+* \author Ján Dugáček
+*
+* \brief Many small files stored in one large file
+*
+* A pack holds named files as lists of extents (ranges of the pack) and a directory saying where they are, so that opening a file in the pack
+* is only a lookup in the directory held in memory and a file can grow without moving it. A file that is the last thing in the pack grows in
+* place, other files get another extent behind the end. The directory is written behind the end as well and the header at the start of the
+* pack points to the newest one, so a pack interrupted while saving the directory still has the previous one. Space of removed files, shrunk
+* files and old directories is reclaimed by compaction, which copies the files into a new pack, possibly in the background.
+*
+* MemoryMappedFilePacked accesses a file in a pack with the same interface as other archivers. Only the modified pages and the appended bytes
+* are written into the pack when flushing.
+*
+* \note Available only on POSIX systems
+* \note The directory is saved when the pack is flushed or destroyed, files flushed after that are restored to their earlier sizes
+*/
+
+#ifndef MEMORY_MAPPED_FILE_PACK_H
+#define MEMORY_MAPPED_FILE_PACK_H
+
+#include <cstdint>
+#include <future>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "memory_mapped_file_base.hpp"
+
+class MemoryMappedFilePack {
+	struct Extent {
+		std::uint64_t offset;
+		std::uint32_t capacity;
+	};
+	struct Entry {
+		int size = 0;
+		std::vector<Extent> extents;
+		std::uint64_t version = 0; // Changed by every change, so that compaction notices files changed while it was copying them
+	};
+	using Directory = std::unordered_map<std::string, Entry>;
+
+	std::string fileName_;
+	int descriptor_;
+	std::uint64_t end_; // New extents and directories are placed here
+	std::uint64_t directorySize_;
+	std::uint64_t liveBytes_; // Total capacity of extents of all files
+	std::uint64_t changes_;
+	bool directoryModified_;
+	Directory directory_;
+	mutable std::mutex mutex_;
+	std::mutex compactionMutex_;
+	std::future<void> compacting_;
+
+	std::string path() const;
+	void readAt(int descriptor, std::uint64_t offset, std::uint8_t* into, std::size_t size) const;
+	void writeAt(int descriptor, std::uint64_t offset, const std::uint8_t* from, std::size_t size) const;
+	void readDirectory(std::uint64_t fileSize);
+	std::uint64_t writeDirectory(int descriptor, std::uint64_t at, const Directory &directory) const;
+	void saveDirectory();
+	void reserve(Entry &entry, int size);
+	void readExtents(const Entry &entry, int from, int size, std::uint8_t* into) const;
+	void writeExtents(const Entry &entry, int from, int size, const std::uint8_t* data);
+
+public:
+	/*!
+	* \brief Constructor, opens the pack or creates an empty one if it doesn't exist
+	*
+	* \param Name of the pack, without suffix
+	* \note Throws std::runtime_error if the file isn't a pack or its directory is damaged
+	*/
+	MemoryMappedFilePack(const std::string &fileName);
+	MemoryMappedFilePack(const MemoryMappedFilePack &other) = delete;
+	MemoryMappedFilePack &operator=(const MemoryMappedFilePack &other) = delete;
+
+	/*!
+	* \brief Destructor, waits for compaction and saves the directory
+	*/
+	~MemoryMappedFilePack();
+
+	/*!
+	* \brief Checks whether a file is in the pack
+	*
+	* \param Name of the file
+	* \return Whether it's there
+	*/
+	bool contains(const std::string &name) const;
+
+	/*!
+	* \brief Gets size of a file
+	*
+	* \param Name of the file
+	* \return Its size, zero if it's not in the pack
+	*/
+	int size(const std::string &name) const;
+
+	/*!
+	* \brief Lists the files in the pack
+	*
+	* \return Names of the files, in no particular order
+	*/
+	std::vector<std::string> names() const;
+
+	/*!
+	* \brief Copies bytes of a file
+	*
+	* \param Name of the file
+	* \param Index of the first byte
+	* \param Number of bytes
+	* \param Where to copy them
+	* \note Throws std::logic_error if the bytes are behind the end of the file
+	*/
+	void read(const std::string &name, int from, int size, std::uint8_t* into) const;
+
+	/*!
+	* \brief Overwrites bytes of a file or appends them, adds the file if it's not in the pack
+	*
+	* \param Name of the file
+	* \param Index of the first byte, at most the size of the file
+	* \param Number of bytes
+	* \param The bytes
+	*/
+	void write(const std::string &name, int from, int size, const std::uint8_t* data);
+
+	/*!
+	* \brief Changes the size of a file, adds the file if it's not in the pack
+	*
+	* \param Name of the file
+	* \param The new size, added bytes are zero
+	*/
+	void resize(const std::string &name, int size);
+
+	/*!
+	* \brief Removes a file from the pack, its space is reclaimed by compaction
+	*
+	* \param Name of the file
+	*/
+	void remove(const std::string &name);
+
+	/*!
+	* \brief Saves the directory, starts compacting in the background if most of the pack is unused
+	*/
+	void flush();
+
+	/*!
+	* \brief Gets the space that compaction would reclaim
+	*
+	* \return Bytes that don't belong to any file or to the directory
+	*/
+	std::int64_t wastedBytes() const;
+
+	/*!
+	* \brief Copies all files into a new pack without unused space between them, and replaces the pack with it
+	*
+	* \note Files can be read and written while it's running, changes made meanwhile are copied again at the end
+	*/
+	void compact();
+
+	/*!
+	* \brief Starts compacting on another thread, unless it's already running
+	*/
+	void compactInBackground();
+
+	/*!
+	* \brief Waits until compaction in the background finishes
+	*
+	* \note Rethrows the exception if it failed
+	*/
+	void waitForCompaction();
+
+	/*!
+	* \brief Returns the extension typical for packs
+	*
+	* \return The extension, without point
+	*/
+	static const std::string &standardExtension();
+};
+
+class MemoryMappedFilePacked final : public MemoryMappedFileBase {
+	MemoryMappedFilePack &pack_;
+	mutable int appendedFrom_; // Bytes from here to the end weren't written into the pack yet
+
+	virtual std::string fileNameExtension() const override
+	{
+		return "";
+	}
+
+	void reset();
+
+public:
+	/*!
+	* \brief Constructor: opens a file in a pack, or starts holding an empty string if it's not there
+	*
+	* \param Name of the file in the pack
+	* \param The pack, it must outlive this object
+	* \param Memory resource to allocate the contents from
+	*/
+	MemoryMappedFilePacked(const std::string &fileName, MemoryMappedFilePack &pack, std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+
+	/*!
+	* \brief Destructor, flushes changes
+	*/
+	virtual ~MemoryMappedFilePacked() override;
+
+	/*!
+	* \brief Gets size of the data
+	*
+	* \return Size of the data
+	* \note Obtained from the pack's directory, without accessing the disk
+	*/
+	virtual int size() const override;
+
+	/*!
+	* \brief Loads the file up to the given byte
+	*
+	* \param How many bytes have to be loaded, negative number means load all
+	*/
+	virtual void load(int until = -1) const override;
+
+	/*!
+	* \brief Flushes and abandons the old file if necessary, opens another file in the same pack and loads up to the given byte
+	*
+	* \param Name of the new file, initialises to empty string if it's not in the pack
+	* \param How many bytes have to be loaded, negative number means load all
+	*/
+	virtual void load(const std::string &fileName, int until = -1) override;
+
+	/*!
+	* \brief Writes the modified pages and appended bytes into the pack
+	*/
+	virtual void flush() const override;
+
+	/*!
+	* \brief Saves the contents if it was modified into another file in the same pack
+	*
+	* \param The name of the file to save to
+	*/
+	virtual void flush(const std::string &fileName) const override;
+
+	/*!
+	* \brief Copies bytes, those that aren't loaded are read from the pack without loading the bytes before them
+	*
+	* \param Index of the first byte
+	* \param Number of bytes
+	* \param Where to copy them
+	*/
+	virtual void read(int from, int size, std::uint8_t* into) const override;
+
+	/*!
+	* \brief Appends data at the end of the file
+	*
+	* \param Vector of bytes to append
+	* \note This overrides parent's method to write only the appended bytes when flushing
+	*/
+	virtual void append(const std::vector<std::uint8_t> &added) override;
+
+	/*!
+	* \brief Appends data at the end of the file
+	*
+	* \param Raw pointer to the data
+	* \param Size of the data in bytes
+	* \note This overrides parent's method to write only the appended bytes when flushing
+	*/
+	virtual void append(const std::uint8_t* added, int size) override;
+
+	/*!
+	* \brief Appends a byte at the end of the file
+	*
+	* \param The byte to append
+	* \note This overrides parent's method to write only the appended bytes when flushing
+	*/
+	virtual void push_back(std::uint8_t added) override;
+
+	/*!
+	* \brief Clears the contents
+	*/
+	virtual void clear() override;
+};
+
+#endif //MEMORY_MAPPED_FILE_PACK_H
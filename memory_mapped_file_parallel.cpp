@@ -0,0 +1,142 @@
+#include "memory_mapped_file_parallel.hpp"
+#include <algorithm>
+#include <cstdint>
+
+MemoryMappedFileThreadPool::MemoryMappedFileThreadPool(int workers) :
+	generation_(0), working_(0), stopping_(false), failed_(false), job_(nullptr)
+{
+	if (workers <= 0)
+		workers = std::max(1, int(std::thread::hardware_concurrency()));
+	shares_ = std::make_unique<Share[]>(static_cast<unsigned int>(workers));
+	for (int i = 0; i < workers; i++) {
+		shares_[i].begin = 0;
+		shares_[i].end = 0;
+	}
+	for (int i = 1; i < workers; i++)
+		threads_.emplace_back([this, i] { loop(i); });
+}
+
+MemoryMappedFileThreadPool::~MemoryMappedFileThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	wake_.notify_all();
+	for (std::thread &thread : threads_)
+		thread.join();
+}
+
+MemoryMappedFileThreadPool &MemoryMappedFileThreadPool::global()
+{
+	static MemoryMappedFileThreadPool retval;
+	return retval;
+}
+
+int MemoryMappedFileThreadPool::workers() const
+{
+	return int(threads_.size()) + 1;
+}
+
+bool MemoryMappedFileThreadPool::take(int worker, int &task)
+{
+	Share &share = shares_[worker];
+	std::lock_guard<std::mutex> lock(share.mutex);
+	if (share.begin >= share.end)
+		return false;
+	task = share.begin++;
+	return true;
+}
+
+bool MemoryMappedFileThreadPool::steal(int worker, int &task)
+{
+	const int workerCount = workers();
+	for (int i = 1; i < workerCount; i++) {
+		Share &victim = shares_[(worker + i) % workerCount];
+		int begin = 0;
+		int end = 0;
+		{
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			const int left = victim.end - victim.begin;
+			if (left <= 0)
+				continue;
+			// The victim keeps the chunks it will process soon, the thief takes the rest
+			begin = victim.end - (left + 1) / 2;
+			end = victim.end;
+			victim.end = begin;
+		}
+		task = begin;
+		Share &own = shares_[worker];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		own.begin = begin + 1;
+		own.end = end;
+		return true;
+	}
+	return false;
+}
+
+void MemoryMappedFileThreadPool::work(int worker)
+{
+	int task = 0;
+	while (!failed_ && (take(worker, task) || steal(worker, task))) {
+		try {
+			(*job_)(task, worker);
+		} catch (...) {
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (!failed_) {
+				failed_ = true;
+				exception_ = std::current_exception();
+			}
+		}
+	}
+}
+
+void MemoryMappedFileThreadPool::loop(int worker)
+{
+	int seen = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			wake_.wait(lock, [&] { return stopping_ || generation_ != seen; });
+			if (stopping_)
+				return;
+			seen = generation_;
+		}
+		work(worker);
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (--working_ == 0)
+			done_.notify_all();
+	}
+}
+
+void MemoryMappedFileThreadPool::run(int tasks, const std::function<void(int, int)> &function)
+{
+	std::lock_guard<std::mutex> running(running_);
+	const int workerCount = workers();
+	for (int i = 0; i < workerCount; i++) {
+		std::lock_guard<std::mutex> lock(shares_[i].mutex);
+		shares_[i].begin = int(std::int64_t(tasks) * i / workerCount);
+		shares_[i].end = int(std::int64_t(tasks) * (i + 1) / workerCount);
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		job_ = &function;
+		failed_ = false;
+		exception_ = nullptr;
+		working_ = workerCount - 1;
+		generation_++;
+	}
+	wake_.notify_all();
+	work(0);
+
+	std::exception_ptr exception;
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		done_.wait(lock, [this] { return working_ == 0; });
+		job_ = nullptr;
+		exception = std::move(exception_);
+		exception_ = nullptr;
+	}
+	if (exception)
+		std::rethrow_exception(exception);
+}
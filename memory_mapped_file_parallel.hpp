@@ -0,0 +1,160 @@
+/*!
+* \file memory_mapped_file_parallel.hpp
+* \date 2026/10/18 22:40
+*
+* \author Ján Dugáček
+*
+* \brief Scanning records stored in a MemoryMappedFile on all processor cores
+*
+* The file is split into chunks of records. Each worker of a thread pool starts with an equal share of the chunks and when it runs out of them,
+* it steals a half of the chunks left to another worker, so that slower parts of the file don't leave the other cores idle. Each worker reads
+* its chunks into its own buffer with MemoryMappedFile::read(), uncompressed files are read from disk without loading them, other files are
+* loaded before the workers start.
+*
+* \note The file must not be modified while it's being scanned
+*/
+
+#ifndef MEMORY_MAPPED_FILE_PARALLEL_H
+#define MEMORY_MAPPED_FILE_PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "memory_mapped_file.hpp"
+
+class MemoryMappedFileThreadPool {
+	struct alignas(64) Share {
+		std::mutex mutex;
+		int begin;
+		int end;
+	};
+
+	std::vector<std::thread> threads_;
+	std::unique_ptr<Share[]> shares_;
+	std::mutex running_;
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	std::condition_variable done_;
+	int generation_;
+	int working_;
+	bool stopping_;
+	std::atomic<bool> failed_;
+	std::exception_ptr exception_;
+	const std::function<void(int, int)>* job_;
+
+	bool take(int worker, int &task);
+	bool steal(int worker, int &task);
+	void work(int worker);
+	void loop(int worker);
+
+public:
+	/*!
+	* \brief Constructor, starts the threads
+	*
+	* \param Number of workers including the thread calling run(), zero means one per processor core
+	*/
+	MemoryMappedFileThreadPool(int workers = 0);
+	MemoryMappedFileThreadPool(const MemoryMappedFileThreadPool &other) = delete;
+	MemoryMappedFileThreadPool &operator=(const MemoryMappedFileThreadPool &other) = delete;
+
+	/*!
+	* \brief Destructor, stops the threads
+	*/
+	~MemoryMappedFileThreadPool();
+
+	/*!
+	* \brief Access to a pool with one worker per processor core, shared by the whole program
+	*
+	* \return The instance
+	*/
+	static MemoryMappedFileThreadPool &global();
+
+	/*!
+	* \brief Gets the number of workers
+	*
+	* \return The number of workers, including the thread calling run()
+	*/
+	int workers() const;
+
+	/*!
+	* \brief Calls a function for each task and waits until all are done, the calling thread works too
+	*
+	* \param Number of tasks
+	* \param The function, receiving the index of the task and the index of the worker
+	* \note If the function throws, the remaining tasks are skipped and the first exception is rethrown
+	* \note Calls from multiple threads take turns, calling it from a task would never end
+	*/
+	void run(int tasks, const std::function<void(int, int)> &function);
+};
+
+/*!
+* \brief Calls a function on every record of a file on all workers of a thread pool
+*
+* \param The file
+* \param The function, receiving the record and its index, it's called from multiple threads at once
+* \param The thread pool
+* \param Size of the parts read at once, in bytes
+*/
+template<typename T, typename Function>
+void parallelForEach(const MemoryMappedFile<T> &file, Function function, MemoryMappedFileThreadPool &pool = MemoryMappedFileThreadPool::global(),
+		int chunkBytes = 1 << 20)
+{
+	const int total = file.size();
+	const int chunkRecords = std::max(1, int(chunkBytes / sizeof(T)));
+	file.prepareConcurrentReading();
+	std::vector<std::vector<T>> buffers(static_cast<unsigned int>(pool.workers()));
+	pool.run((total + chunkRecords - 1) / chunkRecords, [&] (int chunk, int worker) {
+		std::vector<T> &buffer = buffers[static_cast<unsigned int>(worker)];
+		const int from = chunk * chunkRecords;
+		const int count = std::min(chunkRecords, total - from);
+		buffer.resize(static_cast<unsigned int>(count));
+		file.read(from, count, buffer.data());
+		for (int i = 0; i < count; i++)
+			function(buffer[static_cast<unsigned int>(i)], from + i);
+	});
+}
+
+/*!
+* \brief Accumulates all records of a file on all workers of a thread pool and combines the results of the workers
+*
+* \param The file
+* \param The initial value of each worker's result, combining it with anything must not change it (like zero for sums)
+* \param Function adding a record to a worker's result, receiving a reference to the result and the record
+* \param Function combining the results of two workers into one
+* \param The thread pool
+* \param Size of the parts read at once, in bytes
+* \return The combined result
+* \note The records are not accumulated in order, so the result of operations like adding floating point numbers may vary slightly
+*/
+template<typename T, typename Result, typename Accumulate, typename Combine>
+Result parallelReduce(const MemoryMappedFile<T> &file, const Result &initial, Accumulate accumulate, Combine combine,
+		MemoryMappedFileThreadPool &pool = MemoryMappedFileThreadPool::global(), int chunkBytes = 1 << 20)
+{
+	const int total = file.size();
+	const int chunkRecords = std::max(1, int(chunkBytes / sizeof(T)));
+	file.prepareConcurrentReading();
+	std::vector<std::vector<T>> buffers(static_cast<unsigned int>(pool.workers()));
+	std::vector<Result> results(static_cast<unsigned int>(pool.workers()), initial);
+	pool.run((total + chunkRecords - 1) / chunkRecords, [&] (int chunk, int worker) {
+		std::vector<T> &buffer = buffers[static_cast<unsigned int>(worker)];
+		Result &result = results[static_cast<unsigned int>(worker)];
+		const int from = chunk * chunkRecords;
+		const int count = std::min(chunkRecords, total - from);
+		buffer.resize(static_cast<unsigned int>(count));
+		file.read(from, count, buffer.data());
+		for (const T &record : buffer)
+			accumulate(result, record);
+	});
+	Result combined = initial;
+	for (const Result &result : results)
+		combined = combine(combined, result);
+	return combined;
+}
+
+#endif //MEMORY_MAPPED_FILE_PARALLEL_H
@@ -0,0 +1,200 @@
+#include "memory_mapped_file_shared.hpp"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <ctime>
+#endif
+
+constexpr std::uint32_t SHARED_MAGIC = 0x4d4d4653; // "SFMM"
+constexpr std::uint32_t SHARED_VERSION = 1;
+constexpr std::uint64_t HEADER_SIZE = 64;
+constexpr std::uint64_t MAXIMAL_SIZE = std::uint64_t(INT_MAX);
+constexpr std::uint64_t ALLOCATION_INCREMENT = (1 << 20);
+constexpr int SHARED_COMMIT_TIMEOUT = 10000;
+
+struct MemoryMappedFileShared::Control {
+	std::uint32_t magic;
+	std::uint32_t version;
+	std::atomic<std::uint64_t> reserved;
+	std::atomic<std::uint64_t> committed;
+	std::atomic<std::uint32_t> sequence; // Incremented on every commit, waited on with futex
+	std::atomic<std::uint32_t> waiters;
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "Atomics in shared memory must be lock free");
+
+#ifdef __linux__
+namespace {
+void raiseToAtLeast(std::atomic<std::uint64_t> &value, std::uint64_t least)
+{
+	std::uint64_t known = value.load(std::memory_order_relaxed);
+	while (known < least && !value.compare_exchange_weak(known, least, std::memory_order_relaxed)) {}
+}
+
+long futex(std::atomic<std::uint32_t>* address, int operation, std::uint32_t value, const timespec* timeout)
+{
+	return syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(address), operation, value, timeout, nullptr, 0);
+}
+}
+#endif
+
+MemoryMappedFileShared::MemoryMappedFileShared(const std::string &fileName) :
+	fileName_(fileName),
+	descriptor_(-1),
+	mapping_(nullptr),
+	control_(nullptr),
+	allocated_(0)
+{
+	static_assert(sizeof(Control) <= HEADER_SIZE, "The control block must fit into the header");
+#ifdef __linux__
+	const std::string path = fileName + "." + standardExtension();
+	descriptor_ = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (descriptor_ < 0)
+		throw(std::runtime_error("Could not open file " + path));
+
+	// The file is initialised by whichever process gets the lock first
+	flock(descriptor_, LOCK_EX);
+	struct stat status;
+	const bool initialise = (fstat(descriptor_, &status) == 0 && std::uint64_t(status.st_size) < HEADER_SIZE);
+	if (initialise && posix_fallocate(descriptor_, 0, HEADER_SIZE) != 0) {
+		flock(descriptor_, LOCK_UN);
+		close(descriptor_);
+		throw(std::runtime_error("Could not allocate space in file " + path));
+	}
+
+	void* mapped = mmap(nullptr, HEADER_SIZE + MAXIMAL_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor_, 0);
+	if (mapped == MAP_FAILED) {
+		flock(descriptor_, LOCK_UN);
+		close(descriptor_);
+		throw(std::runtime_error("Could not map file " + path));
+	}
+	mapping_ = static_cast<std::uint8_t*>(mapped);
+	control_ = reinterpret_cast<Control*>(mapping_);
+	if (initialise) {
+		control_->version = SHARED_VERSION;
+		control_->magic = SHARED_MAGIC;
+	}
+	flock(descriptor_, LOCK_UN);
+
+	if (control_->magic != SHARED_MAGIC || control_->version != SHARED_VERSION) {
+		munmap(mapping_, HEADER_SIZE + MAXIMAL_SIZE);
+		close(descriptor_);
+		throw(std::runtime_error("File " + path + " is not a shared archive"));
+	}
+#else
+	throw(std::runtime_error("Shared archives are supported only on Linux"));
+#endif
+}
+
+MemoryMappedFileShared::~MemoryMappedFileShared()
+{
+#ifdef __linux__
+	munmap(mapping_, HEADER_SIZE + MAXIMAL_SIZE);
+	close(descriptor_);
+#endif
+}
+
+void MemoryMappedFileShared::ensureAllocated(std::uint64_t size) const
+{
+#ifdef __linux__
+	if (size <= allocated_.load(std::memory_order_relaxed))
+		return;
+	struct stat status;
+	if (fstat(descriptor_, &status) == 0)
+		raiseToAtLeast(allocated_, std::uint64_t(status.st_size));
+	const std::uint64_t allocated = allocated_.load(std::memory_order_relaxed);
+	if (size <= allocated)
+		return;
+
+	// Unlike truncating, allocation never shrinks the file if another process has already extended it more
+	const std::uint64_t increment = std::max<std::uint64_t>(ALLOCATION_INCREMENT, allocated / 8);
+	const std::uint64_t target = std::min<std::uint64_t>((size + increment - 1) / increment * increment, HEADER_SIZE + MAXIMAL_SIZE);
+	if (posix_fallocate(descriptor_, 0, off_t(target)) != 0)
+		throw(std::runtime_error("Could not allocate space in file " + fileName_));
+	raiseToAtLeast(allocated_, target);
+#else
+	(void)size;
+#endif
+}
+
+int MemoryMappedFileShared::append(const std::uint8_t* added, int size)
+{
+	// Space is allocated before reserving, because a reserved range that is never committed would block all following appends
+	std::uint64_t start = control_->reserved.load(std::memory_order_relaxed);
+	do {
+		if (start + std::uint64_t(size) > MAXIMAL_SIZE)
+			throw(std::runtime_error("Shared archive " + fileName_ + " is full"));
+		ensureAllocated(HEADER_SIZE + start + std::uint64_t(size));
+	} while (!control_->reserved.compare_exchange_weak(start, start + std::uint64_t(size), std::memory_order_relaxed));
+
+	std::copy(added, added + size, mapping_ + HEADER_SIZE + start);
+
+	// Appends are committed in the order they were reserved, so that readers never see gaps, appends that take longer are waited for like readers do
+	for (int attempt = 0; control_->committed.load(std::memory_order_acquire) != start; attempt++) {
+		if (attempt > 64 && !waitForSize(int(start) - 1, SHARED_COMMIT_TIMEOUT))
+			throw(std::runtime_error("An earlier append to shared archive " + fileName_ + " was never committed, its process probably died"));
+	}
+	control_->committed.store(start + std::uint64_t(size), std::memory_order_release);
+	// Must not be reordered with loading the number of waiters, or a waiter that came in between would sleep through the commit
+	control_->sequence.fetch_add(1, std::memory_order_seq_cst);
+#ifdef __linux__
+	if (control_->waiters.load(std::memory_order_seq_cst) > 0)
+		futex(&control_->sequence, FUTEX_WAKE, INT_MAX, nullptr);
+#endif
+	return int(start);
+}
+
+int MemoryMappedFileShared::size() const
+{
+	return int(control_->committed.load(std::memory_order_acquire));
+}
+
+bool MemoryMappedFileShared::waitForSize(int known, int timeout) const
+{
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+	while (true) {
+		const std::uint32_t sequence = control_->sequence.load(std::memory_order_acquire);
+		if (size() > known)
+			return true;
+#ifdef __linux__
+		timespec left = { 0, 0 };
+		if (timeout >= 0) {
+			const auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now()).count();
+			if (nanoseconds <= 0)
+				return false;
+			left = { time_t(nanoseconds / 1000000000), long(nanoseconds % 1000000000) };
+		}
+		control_->waiters.fetch_add(1, std::memory_order_seq_cst);
+		futex(&control_->sequence, FUTEX_WAIT, sequence, (timeout >= 0) ? &left : nullptr);
+		control_->waiters.fetch_sub(1, std::memory_order_seq_cst);
+#else
+		(void)sequence;
+		(void)deadline;
+		return false;
+#endif
+	}
+}
+
+const std::uint8_t* MemoryMappedFileShared::data() const
+{
+	return mapping_ + HEADER_SIZE;
+}
+
+const std::string &MemoryMappedFileShared::fileName() const
+{
+	return fileName_;
+}
+
+const std::string &MemoryMappedFileShared::standardExtension()
+{
+	static std::string retval = "shared";
+	return retval;
+}
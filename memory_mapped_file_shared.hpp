@@ -0,0 +1,197 @@
+/*!
+* \file memory_mapped_file_shared.hpp
+* \date 2026/10/18 16:05
+*
+* \author Ján Dugáček
+*
+* \brief Append-only file shared by multiple processes through a shared memory mapping
+*
+* Unlike the other archivers, the contents are not copied into the process' memory, all processes access the same pages. A small header at
+* the start of the file holds the number of bytes reserved by appenders and the number of bytes that were completely written, so that any
+* number of processes can append and read concurrently without losing anything. Readers can sleep until something is appended.
+*
+* \note Available only on Linux. If a process dies while appending, the following appends are never committed, they throw after waiting
+* for it for a few seconds.
+*/
+
+#ifndef MEMORY_MAPPED_FILE_SHARED_H
+#define MEMORY_MAPPED_FILE_SHARED_H
+
+#include <atomic>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+
+class MemoryMappedFileShared {
+	struct Control;
+
+	std::string fileName_;
+	int descriptor_;
+	std::uint8_t* mapping_;
+	Control* control_;
+	mutable std::atomic<std::uint64_t> allocated_; // Appends from multiple threads may extend it
+
+	void ensureAllocated(std::uint64_t size) const;
+
+public:
+	/*!
+	* \brief Constructor: opens the file and maps it, creates it if it doesn't exist
+	*
+	* \param Name of the file, without suffix
+	*/
+	MemoryMappedFileShared(const std::string &fileName);
+
+	MemoryMappedFileShared(const MemoryMappedFileShared &other) = delete;
+	MemoryMappedFileShared &operator=(const MemoryMappedFileShared &other) = delete;
+
+	/*!
+	* \brief Destructor, unmaps the file, everything committed is already visible to other processes
+	*/
+	~MemoryMappedFileShared();
+
+	/*!
+	* \brief Appends data at the end of the file, safe to call from multiple threads and processes
+	*
+	* \param Raw pointer to the data
+	* \param Size of the data in bytes
+	* \return The position where the data was written
+	* \note Data appended in one call is never split or interleaved with data appended by others
+	* \note It sleeps until all earlier appends are committed, if that doesn't happen within ten seconds (a process
+	* died while appending), it throws and the archive can't be appended to anymore
+	*/
+	int append(const std::uint8_t* added, int size);
+
+	/*!
+	* \brief Gets the number of bytes that were completely written
+	*
+	* \return Size of the data
+	*/
+	int size() const;
+
+	/*!
+	* \brief Waits until more bytes are completely written
+	*
+	* \param The size known to the caller
+	* \param Maximal time to wait in milliseconds, negative number means forever
+	* \return Whether the size is now larger
+	*/
+	bool waitForSize(int known, int timeout = -1) const;
+
+	/*!
+	* \brief Access to the data, the address doesn't change when the file grows
+	*
+	* \return Pointer to the first byte, only bytes below size() can be read
+	*/
+	const std::uint8_t* data() const;
+
+	/*!
+	* \brief Byte acccess, modification not possible
+	*
+	* \param Index of the byte, must be below size()
+	* \return Const reference to the byte
+	*/
+	inline const std::uint8_t &operator[](int at) const
+	{
+		return data()[at];
+	}
+
+	/*!
+	* \brief Returns the file name without extension
+	*
+	* \return The name of the file
+	*/
+	const std::string &fileName() const;
+
+	/*!
+	* \brief Returns the extension typical for this type of archive
+	*
+	* \return The extension, without point
+	*/
+	static const std::string &standardExtension();
+};
+
+template<typename T>
+class MemoryMappedSharedFile {
+	MemoryMappedFileShared archiver_;
+
+public:
+	/*!
+	* \brief Constructor
+	*
+	* \param The name of the file
+	*/
+	MemoryMappedSharedFile(const std::string &fileName) : archiver_(fileName) {}
+
+	/*!
+	* \brief Record access, modification not possible
+	*
+	* \param Index of the record
+	* \return Const reference to the record
+	*/
+	const T &operator[](int at) const
+	{
+		if (at < 0 || at >= size())
+			throw(std::logic_error("Reading behind the end of an archive"));
+		return reinterpret_cast<const T*>(archiver_.data())[at];
+	}
+
+	/*!
+	* \brief Appends a record, safe to call from multiple threads and processes
+	*
+	* \param The record
+	* \return Index of the record
+	*/
+	int push_back(const T &added)
+	{
+		return archiver_.append(reinterpret_cast<const std::uint8_t*>(&added), sizeof(T)) / int(sizeof(T));
+	}
+
+	/*!
+	* \brief Gets the number of completely written records
+	*
+	* \return The number of records
+	*/
+	int size() const
+	{
+		return archiver_.size() / int(sizeof(T));
+	}
+
+	/*!
+	* \brief Waits until more records are written
+	*
+	* \param The number of records known to the caller
+	* \param Maximal time to wait in milliseconds, negative number means forever
+	* \return Whether there are more records
+	*/
+	bool waitForSize(int known, int timeout = -1) const
+	{
+		return archiver_.waitForSize((known + 1) * int(sizeof(T)) - 1, timeout);
+	}
+
+	/*!
+	* \brief Access to the records that were already written
+	*
+	* \param Index of the first record
+	* \return The records from the given one to the last one
+	*/
+	std::span<const T> records(int from = 0) const
+	{
+		const int available = size();
+		if (from > available)
+			throw(std::logic_error("Reading behind the end of an archive"));
+		return { reinterpret_cast<const T*>(archiver_.data()) + from, static_cast<std::size_t>(available - from) };
+	}
+
+	/*!
+	* \brief Returns the file name without extension
+	*
+	* \return The name of the file
+	*/
+	const std::string &fileName() const
+	{
+		return archiver_.fileName();
+	}
+};
+
+#endif //MEMORY_MAPPED_FILE_SHARED_H
@@ -0,0 +1,48 @@
+#include "memory_mapped_file_snapshot.hpp"
+#include "memory_mapped_file_base.hpp"
+#include <algorithm>
+#include <cstring>
+
+MemoryMappedFileSnapshotPages::MemoryMappedFileSnapshotPages(std::shared_ptr<MemoryMappedFileSnapshotRegistry> registry, int size) :
+	registry_(std::move(registry)),
+	size_(size),
+	preserved_((std::size_t(size) + (1 << MemoryMappedFileBase::PAGE_BITS) - 1) >> MemoryMappedFileBase::PAGE_BITS)
+{
+	std::lock_guard<std::mutex> guard(registry_->mutex);
+	version_ = ++registry_->versions;
+	registry_->snapshots.push_back(this);
+}
+
+MemoryMappedFileSnapshotPages::~MemoryMappedFileSnapshotPages()
+{
+	std::lock_guard<std::mutex> guard(registry_->mutex);
+	std::vector<MemoryMappedFileSnapshotPages*> &snapshots = registry_->snapshots;
+	snapshots.erase(std::remove(snapshots.begin(), snapshots.end(), this), snapshots.end());
+}
+
+void MemoryMappedFileSnapshotPages::read(int from, int size, std::uint8_t* into) const
+{
+	if (from < 0 || size < 0 || from + size > size_)
+		throw(std::logic_error("Reading behind the end of a snapshot"));
+	constexpr int PAGE_SIZE = 1 << MemoryMappedFileBase::PAGE_BITS;
+	while (size > 0) {
+		// Locked separately for every page, so that the file doesn't wait long if it needs to copy a page
+		const int page = from >> MemoryMappedFileBase::PAGE_BITS;
+		const int offset = from & (PAGE_SIZE - 1);
+		const int copied = std::min(size, PAGE_SIZE - offset);
+		{
+			std::lock_guard<std::mutex> guard(registry_->mutex);
+			const std::uint8_t* source = preserved_[page] ? preserved_[page]->data() : registry_->data->data() + (page << MemoryMappedFileBase::PAGE_BITS);
+			std::memcpy(into, source + offset, copied);
+		}
+		from += copied;
+		into += copied;
+		size -= copied;
+	}
+}
+
+int MemoryMappedFileSnapshotPages::copiedPages() const
+{
+	std::lock_guard<std::mutex> guard(registry_->mutex);
+	return int(std::count_if(preserved_.begin(), preserved_.end(), [] (const auto &page) { return bool(page); }));
+}
@@ -0,0 +1,176 @@
+/*!
+* \file memory_mapped_file_snapshot.hpp
+* \date 2026/10/18 20:25
+*
+* \author Ján Dugáček
+*
+* \brief Read-only views of contents of files as they were at some moment
+*
+* A snapshot shares the contents with the file. When the file is about to modify a page that some snapshots still share, the page is copied
+* for them first, so taking a snapshot costs nothing and memory grows only with modifications made while the snapshot exists.
+*
+* Snapshots can be read from any thread while the file is being modified, but they have to be taken by the thread that modifies the file.
+*/
+
+#ifndef MEMORY_MAPPED_FILE_SNAPSHOT_H
+#define MEMORY_MAPPED_FILE_SNAPSHOT_H
+
+#include <vector>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <cstdint>
+#include <stdexcept>
+
+class MemoryMappedFileSnapshotPages;
+
+struct MemoryMappedFileSnapshotRegistry {
+	std::mutex mutex;
+	const std::pmr::vector<std::uint8_t>* data = nullptr; // Contents of the file, the mutex must be locked to read them
+	std::vector<MemoryMappedFileSnapshotPages*> snapshots;
+	std::uint64_t versions = 0;
+};
+
+class MemoryMappedFileSnapshotPages {
+	std::shared_ptr<MemoryMappedFileSnapshotRegistry> registry_;
+	int size_;
+	std::uint64_t version_;
+	std::vector<std::shared_ptr<const std::vector<std::uint8_t>>> preserved_; // Pages modified since the snapshot, guarded by registry's mutex
+
+	friend class MemoryMappedFileBase;
+public:
+	/*!
+	* \brief Constructor, registers the snapshot so that the file copies pages for it before modifying them
+	*
+	* \param The registry of the file's snapshots
+	* \param Size of the file at the moment
+	*/
+	MemoryMappedFileSnapshotPages(std::shared_ptr<MemoryMappedFileSnapshotRegistry> registry, int size);
+
+	MemoryMappedFileSnapshotPages(const MemoryMappedFileSnapshotPages &other) = delete;
+	MemoryMappedFileSnapshotPages &operator=(const MemoryMappedFileSnapshotPages &other) = delete;
+
+	/*!
+	* \brief Destructor, the file stops copying pages for this snapshot
+	*/
+	~MemoryMappedFileSnapshotPages();
+
+	/*!
+	* \brief Copies bytes as they were when the snapshot was taken
+	*
+	* \param Index of the first byte
+	* \param Number of bytes
+	* \param Where to copy them
+	*/
+	void read(int from, int size, std::uint8_t* into) const;
+
+	/*!
+	* \brief Returns the size of the file when the snapshot was taken
+	*
+	* \return The size in bytes
+	*/
+	int size() const
+	{
+		return size_;
+	}
+
+	/*!
+	* \brief Returns the order of the snapshot among snapshots of the same file
+	*
+	* \return The version, starting from 1
+	*/
+	std::uint64_t version() const
+	{
+		return version_;
+	}
+
+	/*!
+	* \brief Counts the pages that had to be copied because the file modified them
+	*
+	* \return The number of pages
+	*/
+	int copiedPages() const;
+};
+
+template<typename T>
+class MemoryMappedFileSnapshot {
+	std::shared_ptr<const MemoryMappedFileSnapshotPages> pages_;
+
+	template<typename U>
+	friend class MemoryMappedFileSnapshot;
+public:
+	/*!
+	* \brief Constructor, use MemoryMappedFile::snapshot() to obtain it
+	*
+	* \param The contents
+	*/
+	MemoryMappedFileSnapshot(std::shared_ptr<const MemoryMappedFileSnapshotPages> pages) : pages_(std::move(pages)) {}
+
+	/*!
+	* \brief Constructor, views the same contents as records of another type
+	*
+	* \param Another snapshot of the same file
+	*/
+	template<typename U>
+	explicit MemoryMappedFileSnapshot(const MemoryMappedFileSnapshot<U> &other) : pages_(other.pages_) {}
+
+	/*!
+	* \brief Returns the number of records when the snapshot was taken
+	*
+	* \return The number of records
+	*/
+	int size() const
+	{
+		return pages_->size() / int(sizeof(T));
+	}
+
+	/*!
+	* \brief Copies records as they were when the snapshot was taken
+	*
+	* \param Index of the first record
+	* \param Number of records
+	* \param Where to copy them
+	* \note Much faster than reading them one by one with operator[]
+	*/
+	void read(int from, int count, T* into) const
+	{
+		if (from < 0 || count < 0 || from + count > size())
+			throw(std::logic_error("Reading behind the end of a snapshot"));
+		pages_->read(from * int(sizeof(T)), count * int(sizeof(T)), reinterpret_cast<std::uint8_t*>(into));
+	}
+
+	/*!
+	* \brief Record access
+	*
+	* \param Index of the record
+	* \return Copy of the record as it was when the snapshot was taken
+	*/
+	T operator[](int at) const
+	{
+		T retval;
+		read(at, 1, &retval);
+		return retval;
+	}
+
+	/*!
+	* \brief Returns the order of the snapshot among snapshots of the same file
+	*
+	* \return The version, starting from 1
+	*/
+	std::uint64_t version() const
+	{
+		return pages_->version();
+	}
+
+	/*!
+	* \brief Returns how much memory the snapshot occupies
+	*
+	* \return The number of pages that had to be copied because the file modified them
+	*/
+	int copiedPages() const
+	{
+		return pages_->copiedPages();
+	}
+};
+
+#endif //MEMORY_MAPPED_FILE_SNAPSHOT_H
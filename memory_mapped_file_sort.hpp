@@ -0,0 +1,169 @@
+/*!
+* \file memory_mapped_file_sort.hpp
+* \date 2026/10/18 21:55
+*
+* \author Ján Dugáček
+*
+* \brief Sorting of records stored in a MemoryMappedFile that don't have to fit into memory
+*
+* The records are read in runs that fit into memory, each run is sorted on another thread and written into a temporary uncompressed file while
+* the next runs are read. Then all runs are merged at once, reading each of them in large sequential parts, and the result is appended to the
+* output file. Only a few runs and the buffers for merging are held in memory at any time.
+*
+* \note The input should be an uncompressed file, other archivers have to decode the whole file to read its last run
+* \note The output should be opened in append-only mode, otherwise it holds all records in memory until flushed
+*/
+
+#ifndef MEMORY_MAPPED_FILE_SORT_H
+#define MEMORY_MAPPED_FILE_SORT_H
+
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <future>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "memory_mapped_file.hpp"
+#include "memory_mapped_file_uncompressed.hpp"
+
+struct MemoryMappedFileSortOptions {
+	int runBytes = 64 << 20; // Size of the parts of the input that are sorted in memory
+	int bufferBytes = 1 << 20; // Size of the parts of the runs read at once while merging, and of the output written at once
+	int threads = 0; // Number of runs sorted at the same time, zero means one per processor core
+	std::string temporaryName; // Prefix of names of the temporary files, the output's name is used if empty
+};
+
+/*!
+* \brief Sorts records of a file into another file
+*
+* \param The file with the records, it's not modified
+* \param The file to put the sorted records into, its contents are replaced
+* \param Function returning whether the first record belongs before the second one
+* \param Sizes of buffers and number of threads
+* \note The order of equal records is not preserved
+*/
+template<typename T, typename Compare = std::less<T>>
+void sortMemoryMappedFile(const MemoryMappedFile<T> &input, MemoryMappedFile<T> &output, Compare compare = Compare(),
+		const MemoryMappedFileSortOptions &options = MemoryMappedFileSortOptions())
+{
+	if (&input == &output || input.extendedFileName() == output.extendedFileName())
+		throw(std::logic_error("File " + input.fileName() + " can't be sorted into itself"));
+	const int runRecords = std::max(1, int(options.runBytes / sizeof(T)));
+	const int bufferRecords = std::max(1, int(options.bufferBytes / sizeof(T)));
+	const int threads = options.threads > 0 ? options.threads : std::max(1, int(std::thread::hardware_concurrency()));
+	const std::string temporaryName = options.temporaryName.empty() ? output.fileName() + "_run" : options.temporaryName;
+	const int total = input.size();
+	output.clear();
+
+	if (total <= runRecords) {
+		std::vector<T> records(static_cast<unsigned int>(total));
+		input.read(0, total, records.data());
+		std::sort(records.begin(), records.end(), compare);
+		output.append(records.data(), total);
+		return;
+	}
+
+	// The temporary files are removed even if sorting fails, it's declared first so that the threads writing them are waited for before that
+	struct RunFiles {
+		std::vector<std::string> names;
+		~RunFiles()
+		{
+			for (const std::string &name : names)
+				std::remove((name + "." + MemoryMappedFileUncompressed::standardExtension()).c_str());
+		}
+	} runFiles;
+	std::vector<std::string> &runNames = runFiles.names;
+
+	// Runs are read on this thread, because reading is sequential anyway, and sorted and written on others
+	std::deque<std::future<void>> sorting;
+	for (int from = 0; from < total; from += runRecords) {
+		if (int(sorting.size()) >= threads) {
+			sorting.front().get();
+			sorting.pop_front();
+		}
+		const int count = std::min(runRecords, total - from);
+		std::vector<T> records(static_cast<unsigned int>(count));
+		input.read(from, count, records.data());
+		runNames.push_back(temporaryName + "_" + std::to_string(runNames.size()));
+		sorting.push_back(std::async(std::launch::async, [records = std::move(records), compare, name = runNames.back()] () mutable {
+			std::sort(records.begin(), records.end(), compare);
+			MemoryMappedFileUncompressed run(name, MemoryMappedFileOptions{ .appendOnly = true });
+			run.clear();
+			run.append(reinterpret_cast<const std::uint8_t*>(records.data()), int(records.size() * sizeof(T)));
+		}));
+	}
+	while (!sorting.empty()) {
+		sorting.front().get();
+		sorting.pop_front();
+	}
+
+	struct Run {
+		std::unique_ptr<MemoryMappedFileUncompressed> file;
+		std::vector<T> buffer;
+		int position;
+		int read;
+		int size;
+	};
+	std::vector<Run> runs(runNames.size());
+	auto refill = [&] (Run &run) {
+		const int count = std::min(bufferRecords, run.size - run.read);
+		run.buffer.resize(static_cast<unsigned int>(count));
+		run.file->read(int(run.read * sizeof(T)), int(count * sizeof(T)), reinterpret_cast<std::uint8_t*>(run.buffer.data()));
+		run.read += count;
+		run.position = 0;
+		if (run.read < run.size)
+			run.file->prefetch(int(run.read * sizeof(T)), int(std::min(bufferRecords, run.size - run.read) * sizeof(T)));
+	};
+	auto later = [&] (int first, int second) {
+		return compare(runs[second].buffer[runs[second].position], runs[first].buffer[runs[first].position]);
+	};
+	std::priority_queue<int, std::vector<int>, decltype(later)> heads(later);
+	for (int i = 0; i < int(runs.size()); i++) {
+		runs[i].file = std::make_unique<MemoryMappedFileUncompressed>(runNames[i]);
+		runs[i].file->adviseSequential();
+		runs[i].read = 0;
+		runs[i].size = int(runs[i].file->size() / sizeof(T));
+		refill(runs[i]);
+		heads.push(i);
+	}
+
+	std::vector<T> merged;
+	merged.reserve(static_cast<unsigned int>(bufferRecords));
+	while (!heads.empty()) {
+		const int taken = heads.top();
+		heads.pop();
+		Run &run = runs[taken];
+		merged.push_back(run.buffer[run.position]);
+		if (int(merged.size()) == bufferRecords) {
+			output.append(merged.data(), int(merged.size()));
+			merged.clear();
+		}
+		run.position++;
+		if (run.position == int(run.buffer.size()) && run.read < run.size)
+			refill(run);
+		if (run.position < int(run.buffer.size()))
+			heads.push(taken);
+	}
+	output.append(merged.data(), int(merged.size()));
+}
+
+/*!
+* \brief Sorts records of a file into another file by a key obtained from them
+*
+* \param The file with the records, it's not modified
+* \param The file to put the sorted records into, its contents are replaced
+* \param Function obtaining the key from a record, the keys are compared through operator<
+* \param Sizes of buffers and number of threads
+* \note The order of records with equal keys is not preserved
+*/
+template<typename T, typename KeyFunction>
+void sortMemoryMappedFileBy(const MemoryMappedFile<T> &input, MemoryMappedFile<T> &output, KeyFunction key,
+		const MemoryMappedFileSortOptions &options = MemoryMappedFileSortOptions())
+{
+	sortMemoryMappedFile(input, output, [&key] (const T &first, const T &second) { return key(first) < key(second); }, options);
+}
+
+#endif //MEMORY_MAPPED_FILE_SORT_H
@@ -0,0 +1,74 @@
+#include "memory_mapped_file_statistics.hpp"
+#include <algorithm>
+#include <bit>
+#include <limits>
+
+double MemoryMappedFileHistogram::upperBound(int bucket)
+{
+	return (bucket < BUCKETS - 1) ? double(std::uint64_t(1) << bucket) : std::numeric_limits<double>::infinity();
+}
+
+const std::string &MemoryMappedFileStatisticsSnapshot::name(MemoryMappedFileCounter counter)
+{
+	static const std::array<std::string, int(MemoryMappedFileCounter::COUNTERS)> names = { "bytes_read", "bytes_written", "loads",
+			"lazy_loads", "full_flushes", "append_flushes", "resident_bytes", "preallocations" };
+	return names[int(counter)];
+}
+
+const std::string &MemoryMappedFileStatisticsSnapshot::name(MemoryMappedFileTiming timing)
+{
+	static const std::array<std::string, int(MemoryMappedFileTiming::TIMINGS)> names = { "load", "decode", "flush", "encode", "write" };
+	return names[int(timing)];
+}
+
+MemoryMappedFileStatistics::MemoryMappedFileStatistics(MemoryMappedFileStatistics* parent) :
+	parent_(parent)
+{
+	for (auto &counter : counters_)
+		counter.store(0, std::memory_order_relaxed);
+	for (auto &histogram : buckets_)
+		for (auto &bucket : histogram)
+			bucket.store(0, std::memory_order_relaxed);
+	for (auto &total : totalNanoseconds_)
+		total.store(0, std::memory_order_relaxed);
+}
+
+MemoryMappedFileStatistics &MemoryMappedFileStatistics::global()
+{
+	static MemoryMappedFileStatistics retval(nullptr);
+	return retval;
+}
+
+void MemoryMappedFileStatistics::add(MemoryMappedFileCounter counter, std::int64_t amount)
+{
+	counters_[int(counter)].fetch_add(amount, std::memory_order_relaxed);
+	if (parent_)
+		parent_->add(counter, amount);
+}
+
+void MemoryMappedFileStatistics::record(MemoryMappedFileTiming timing, std::chrono::steady_clock::duration duration)
+{
+	const std::uint64_t nanoseconds = std::uint64_t(std::max<std::int64_t>(0,
+			std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()));
+	const int bucket = std::min<int>(std::bit_width(nanoseconds / 1000), MemoryMappedFileHistogram::BUCKETS - 1);
+	buckets_[int(timing)][bucket].fetch_add(1, std::memory_order_relaxed);
+	totalNanoseconds_[int(timing)].fetch_add(nanoseconds, std::memory_order_relaxed);
+	if (parent_)
+		parent_->record(timing, duration);
+}
+
+MemoryMappedFileStatisticsSnapshot MemoryMappedFileStatistics::snapshot() const
+{
+	MemoryMappedFileStatisticsSnapshot retval;
+	for (int i = 0; i < int(MemoryMappedFileCounter::COUNTERS); i++)
+		retval.counters[i] = counters_[i].load(std::memory_order_relaxed);
+	for (int i = 0; i < int(MemoryMappedFileTiming::TIMINGS); i++) {
+		MemoryMappedFileHistogram &histogram = retval.timings[i];
+		for (int j = 0; j < MemoryMappedFileHistogram::BUCKETS; j++) {
+			histogram.buckets[j] = buckets_[i][j].load(std::memory_order_relaxed);
+			histogram.count += histogram.buckets[j];
+		}
+		histogram.totalNanoseconds = totalNanoseconds_[i].load(std::memory_order_relaxed);
+	}
+	return retval;
+}
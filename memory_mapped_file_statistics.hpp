@@ -0,0 +1,162 @@
+/*!
+* \file memory_mapped_file_statistics.hpp
+* \date 2026/10/18 17:55
+*
+* \author Ján Dugáček
+*
+* \brief Counters and latency histograms of file accesses
+*
+* Every file counts what it has done and adds the same numbers to global counters shared by all files. Counting costs a few relaxed atomic
+* additions per load or flush, not per access. Snapshots of the counters are plain values that can be exported anywhere.
+*/
+
+#ifndef MEMORY_MAPPED_FILE_STATISTICS_H
+#define MEMORY_MAPPED_FILE_STATISTICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+enum class MemoryMappedFileCounter {
+	BYTES_READ, // Bytes read from disk
+	BYTES_WRITTEN, // Bytes written to disk
+	LOADS, // Calls of load() that had to read something
+	LAZY_LOADS, // Accesses that had to load more of the file
+	FULL_FLUSHES, // Flushes that rewrote the whole file
+	APPEND_FLUSHES, // Flushes that only appended to the file
+	RESIDENT_BYTES, // Bytes held in memory
+	PREALLOCATIONS, // Reservations of disk space for appending
+	COUNTERS
+};
+
+enum class MemoryMappedFileTiming {
+	LOAD, // Whole load() calls
+	DECODE, // Decompression while loading
+	FLUSH, // Whole flush() calls
+	ENCODE, // Compression while flushing, without writing
+	WRITE, // Writing compressed data while flushing
+	TIMINGS
+};
+
+struct MemoryMappedFileHistogram {
+	constexpr static int BUCKETS = 32;
+
+	std::array<std::uint64_t, BUCKETS> buckets = {}; // Bucket i counts durations shorter than 2^i microseconds that didn't fit into bucket i - 1
+	std::uint64_t count = 0;
+	std::uint64_t totalNanoseconds = 0;
+
+	/*!
+	* \brief Returns the longest duration counted in a bucket
+	*
+	* \param Index of the bucket
+	* \return The duration in microseconds, the last bucket has no limit
+	*/
+	static double upperBound(int bucket);
+};
+
+struct MemoryMappedFileStatisticsSnapshot {
+	std::array<std::int64_t, int(MemoryMappedFileCounter::COUNTERS)> counters = {};
+	std::array<MemoryMappedFileHistogram, int(MemoryMappedFileTiming::TIMINGS)> timings = {};
+
+	std::int64_t operator[](MemoryMappedFileCounter counter) const
+	{
+		return counters[int(counter)];
+	}
+
+	const MemoryMappedFileHistogram &operator[](MemoryMappedFileTiming timing) const
+	{
+		return timings[int(timing)];
+	}
+
+	/*!
+	* \brief Returns a name of a counter usable in exported metrics
+	*
+	* \param The counter
+	* \return Its name, in snake case
+	*/
+	static const std::string &name(MemoryMappedFileCounter counter);
+
+	/*!
+	* \brief Returns a name of a timing usable in exported metrics
+	*
+	* \param The timing
+	* \return Its name, in snake case
+	*/
+	static const std::string &name(MemoryMappedFileTiming timing);
+};
+
+class MemoryMappedFileStatistics {
+	std::array<std::atomic<std::int64_t>, int(MemoryMappedFileCounter::COUNTERS)> counters_;
+	std::array<std::array<std::atomic<std::uint64_t>, MemoryMappedFileHistogram::BUCKETS>, int(MemoryMappedFileTiming::TIMINGS)> buckets_;
+	std::array<std::atomic<std::uint64_t>, int(MemoryMappedFileTiming::TIMINGS)> totalNanoseconds_;
+	MemoryMappedFileStatistics* parent_;
+
+public:
+	/*!
+	* \brief Constructor
+	*
+	* \param Statistics that receive everything counted by these too, the global ones by default
+	*/
+	MemoryMappedFileStatistics(MemoryMappedFileStatistics* parent = &global());
+
+	MemoryMappedFileStatistics(const MemoryMappedFileStatistics &other) = delete;
+	MemoryMappedFileStatistics &operator=(const MemoryMappedFileStatistics &other) = delete;
+
+	/*!
+	* \brief Access to the statistics of all files together
+	*
+	* \return The global statistics
+	*/
+	static MemoryMappedFileStatistics &global();
+
+	/*!
+	* \brief Increases a counter
+	*
+	* \param The counter
+	* \param The amount, can be negative
+	*/
+	void add(MemoryMappedFileCounter counter, std::int64_t amount = 1);
+
+	/*!
+	* \brief Adds a duration into a histogram
+	*
+	* \param The histogram
+	* \param The duration
+	*/
+	void record(MemoryMappedFileTiming timing, std::chrono::steady_clock::duration duration);
+
+	/*!
+	* \brief Copies the current values, the copy is not atomic as a whole
+	*
+	* \return The values
+	*/
+	MemoryMappedFileStatisticsSnapshot snapshot() const;
+};
+
+class MemoryMappedFileStopwatch {
+	MemoryMappedFileStatistics &statistics_;
+	MemoryMappedFileTiming timing_;
+	std::chrono::steady_clock::time_point start_;
+
+public:
+	/*!
+	* \brief Constructor, starts measuring the time, it's recorded when destroyed
+	*
+	* \param Where to record the time
+	* \param The histogram to record it into
+	*/
+	MemoryMappedFileStopwatch(MemoryMappedFileStatistics &statistics, MemoryMappedFileTiming timing) :
+		statistics_(statistics), timing_(timing), start_(std::chrono::steady_clock::now()) {}
+
+	MemoryMappedFileStopwatch(const MemoryMappedFileStopwatch &other) = delete;
+	MemoryMappedFileStopwatch &operator=(const MemoryMappedFileStopwatch &other) = delete;
+
+	~MemoryMappedFileStopwatch()
+	{
+		statistics_.record(timing_, std::chrono::steady_clock::now() - start_);
+	}
+};
+
+#endif //MEMORY_MAPPED_FILE_STATISTICS_H
@@ -0,0 +1,109 @@
+/*!
+* \file memory_mapped_file_tail.hpp
+* \date 2026/10/18 16:40
+*
+* \author Ján Dugáček
+*
+* \brief Delivery of records appended to a file by another process
+*
+* Instead of polling size(), the reader sleeps until the file is changed (MemoryMappedFile is woken by inotify, MemoryMappedSharedFile by
+* a futex) and then receives all records it hasn't seen yet at once. The position of the first record not delivered yet (the cursor) can be
+* kept in a small file, so that reading can continue where it stopped after a restart.
+*
+* \note Records delivered since the last commit() may be delivered again after a restart
+*/
+
+#ifndef MEMORY_MAPPED_FILE_TAIL_H
+#define MEMORY_MAPPED_FILE_TAIL_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <span>
+#include "memory_mapped_file.hpp"
+#include "memory_mapped_file_uncompressed.hpp"
+
+template<typename T, typename FileType = MemoryMappedFile<T>>
+class MemoryMappedFileTail {
+	const FileType &file_;
+	int cursor_;
+	std::unique_ptr<MemoryMappedFile<std::int32_t, MemoryMappedFileUncompressed>> storedCursor_;
+
+public:
+	/*!
+	* \brief Constructor, the cursor is not stored anywhere
+	*
+	* \param The file whose records are read, must outlive this object
+	* \param Index of the first record to deliver
+	*/
+	MemoryMappedFileTail(const FileType &file, int from = 0) : file_(file), cursor_(from) {}
+
+	/*!
+	* \brief Constructor, the cursor is loaded from a file if it exists and stored into it by commit() or when destroyed
+	*
+	* \param The file whose records are read, must outlive this object
+	* \param The name of the file holding the cursor
+	* \param Index of the first record to deliver if the cursor wasn't stored yet
+	*/
+	MemoryMappedFileTail(const FileType &file, const std::string &cursorFileName, int from = 0) :
+		file_(file),
+		storedCursor_(std::make_unique<MemoryMappedFile<std::int32_t, MemoryMappedFileUncompressed>>(cursorFileName))
+	{
+		if (storedCursor_->size() == 0)
+			storedCursor_->push_back(from);
+		cursor_ = (*storedCursor_)[0];
+	}
+
+	/*!
+	* \brief Returns the index of the first record that wasn't delivered yet
+	*
+	* \return The cursor
+	*/
+	int cursor() const
+	{
+		return cursor_;
+	}
+
+	/*!
+	* \brief Waits until there are records that weren't delivered yet and delivers all of them
+	*
+	* \param Function called with the new records, it must not keep the span after returning
+	* \param Maximal time to wait in milliseconds, negative number means forever
+	* \return Whether any records were delivered
+	*/
+	bool next(const std::function<void(std::span<const T>)> &callback, int timeout = -1)
+	{
+		if (!file_.waitForSize(cursor_, timeout))
+			return false;
+		std::span<const T> records = file_.records(cursor_);
+		callback(records);
+		cursor_ += int(records.size());
+		if (storedCursor_)
+			(*storedCursor_)[0] = cursor_;
+		return true;
+	}
+
+	/*!
+	* \brief Keeps delivering records until stopped from another thread
+	*
+	* \param Function called with the new records, it must not keep the span after returning
+	* \param Set to true to stop
+	* \param How often to check if it should stop, in milliseconds
+	*/
+	void follow(const std::function<void(std::span<const T>)> &callback, const std::atomic<bool> &stop, int checkInterval = 100)
+	{
+		while (!stop)
+			next(callback, checkInterval);
+	}
+
+	/*!
+	* \brief Saves the cursor, if it's stored in a file
+	*/
+	void commit()
+	{
+		if (storedCursor_)
+			storedCursor_->flush();
+	}
+};
+
+#endif //MEMORY_MAPPED_FILE_TAIL_H
@@ -1,13 +1,64 @@
 #include <iostream>
 #include <functional>
 #include <memory>
+#include <span>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <cstdio>
+#include <coroutine>
+#include <future>
+#include <fstream>
+#include <utility>
+#include <cstddef>
 #include "memory_mapped_file_base.hpp"
 #include "memory_mapped_file_uncompressed.hpp"
 #include "memory_mapped_file_compressed.hpp"
 #include "memory_mapped_file.hpp"
+#include "memory_mapped_file_index.hpp"
+#include "memory_mapped_blob_file.hpp"
+#include "memory_mapped_segmented_file.hpp"
+#include "memory_mapped_file_memory.hpp"
+#include "memory_mapped_file_shared.hpp"
+#include "memory_mapped_file_tail.hpp"
+#include "memory_mapped_file_async.hpp"
+#include "memory_mapped_file_checksum.hpp"
+#include "memory_mapped_file_encoded.hpp"
+#include "memory_mapped_file_snapshot.hpp"
+#include "memory_mapped_file_zone_map.hpp"
+#include "memory_mapped_file_sort.hpp"
+#include "memory_mapped_file_parallel.hpp"
+#include "memory_mapped_file_pack.hpp"
+#include "memory_mapped_file_change_log.hpp"
+#ifndef _WIN32
+#include <csignal>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 bool flawless = true;
 
+#ifdef MEMORY_MAPPED_FILE_LZMA
+constexpr int ARCHIVE_TYPES = 2;
+using CompressedIfAvailable = MemoryMappedFileCompressed;
+#else
+constexpr int ARCHIVE_TYPES = 1; // Compressed archives can't be tested without LZMA SDK
+using CompressedIfAvailable = MemoryMappedFileUncompressed;
+#endif
+
+struct DetachedCoroutine {
+	struct promise_type {
+		DetachedCoroutine get_return_object() { return {}; }
+		std::suspend_never initial_suspend() { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+	};
+};
+
 template<typename retType>
 void makeTest(retType expected, std::function<retType()> action, const std::string &failureComment)
 {
@@ -25,7 +76,7 @@ void makeTest(retType expected, std::function<retType()> action, const std::stri
 	}
 }
 
-inline std::string vec2string(const std::vector<unsigned char> &str)
+inline std::string vec2string(std::span<const unsigned char> str)
 {
 	std::string retVal;
 	for (unsigned char c : str)
@@ -37,7 +88,7 @@ inline std::string vec2string(const std::vector<unsigned char> &str)
 int main()
 {
 
-	for (int i = 0; i < 2; i++) {
+	for (int i = 0; i < ARCHIVE_TYPES; i++) {
 		if (i) std::cout << "Starting tests of archivation" << std::endl;
 		else std::cout << "Starting tests of plaintext storage" << std::endl;
 
@@ -51,8 +102,10 @@ int main()
 			longData.push_back(sample[i]);
 
 		auto getTheRightArchive = [&](const std::string& name) -> std::unique_ptr<MemoryMappedFileBase> {
+#ifdef MEMORY_MAPPED_FILE_LZMA
 			if (i) return std::make_unique<MemoryMappedFileCompressed>(name);
-			else return std::make_unique<MemoryMappedFileUncompressed>(name);
+#endif
+			return std::make_unique<MemoryMappedFileUncompressed>(name);
 		};
 		try {
 			{
@@ -162,25 +215,25 @@ int main()
 
 		std::vector<entry> entries{{1, "Gary"},{ 2, "Johnny" },{ 4, "Tim" },{ 6, "Mark" },{ 7, "Tony" }};
 		{
-			MemoryMappedFile<entry> file = MemoryMappedFile<entry, MemoryMappedFileCompressed>("struct_test");
+			MemoryMappedFile<entry> file = MemoryMappedFile<entry, CompressedIfAvailable>("struct_test");
 			file.clear();
 		}
 		{
-			MemoryMappedFile<entry> file = MemoryMappedFile<entry, MemoryMappedFileCompressed>("struct_test");
+			MemoryMappedFile<entry> file = MemoryMappedFile<entry, CompressedIfAvailable>("struct_test");
 			file.push_back(entries[3]);
 			makeTest<uint64_t>(entries[3].number, [&] { return file[0].number; }, "Test of append failed");
 			file.clear();
 			makeTest<uint64_t>(0, [&] { return file.size(); }, "Test of clear failed");
 		}
 		{
-			MemoryMappedFile<entry> file = MemoryMappedFile<entry, MemoryMappedFileCompressed>("struct_test");
+			MemoryMappedFile<entry> file = MemoryMappedFile<entry, CompressedIfAvailable>("struct_test");
 			file.push_back(entries[0]);
 			file.push_back(entries[1]);
 			file.push_back(entries[1]);
 			file[2] = entries[2];
 		}
 		{
-			MemoryMappedFile<entry> file = MemoryMappedFile<entry, MemoryMappedFileCompressed>("struct_test");
+			MemoryMappedFile<entry> file = MemoryMappedFile<entry, CompressedIfAvailable>("struct_test");
 			const entry* ptr = file.data();
 
 			for (int i = 0; i < 3; i++) {
@@ -200,6 +253,1460 @@ int main()
 		flawless = false;
 	}
 
+	try {
+		std::cout << "Starting tests of indexes" << std::endl;
+		struct measurement {
+			int32_t sensor;
+			int32_t value;
+		};
+		auto sensorOf = [] (const measurement &record) { return record.sensor; };
+
+		{
+			MemoryMappedFile<measurement, MemoryMappedFileUncompressed> records("index_records");
+			records.clear();
+			MemoryMappedFileIndex<measurement, int32_t> index(records, "index_tree", sensorOf);
+			for (int i = 0; i < 1000; i++)
+				index.push_back(measurement{ (i * 37) % 7, i });
+			makeTest<int>(1000, [&] { return index.size(); }, "Test of index size failed");
+			makeTest<int>(143, [&] { return int(index.find(3).size()); }, "Test of index search failed");
+			makeTest<bool>(true, [&] {
+				std::vector<int> found = index.find(3);
+				return std::is_sorted(found.begin(), found.end()) && records[found[5]].sensor == 3;
+			}, "Test of index search order failed");
+		}
+		{
+			MemoryMappedFile<measurement, MemoryMappedFileUncompressed> records("index_records");
+			MemoryMappedFileIndex<measurement, int32_t> index(records, "index_tree", sensorOf);
+			makeTest<int>(143, [&] { return int(index.find(3).size()); }, "Test of index re-read failed");
+			records.push_back(measurement{ 3, 1000 });
+			index.update();
+			makeTest<int>(144, [&] { return int(index.find(3).size()); }, "Test of index update failed");
+			index.rebuild();
+			makeTest<int>(144, [&] { return int(index.find(3).size()); }, "Test of index rebuild failed");
+			int inRange = 0;
+			index.forEach(2, 4, [&] (int32_t, int) { inRange++; });
+			makeTest<int>(144 + 143 + 143, [&] { return inRange; }, "Test of index range search failed");
+		}
+	}
+	catch(std::exception &e) {
+		std::cout << "A test failed with exception: " << e.what() << std::endl;
+		flawless = false;
+	}
+
+	try {
+		std::cout << "Starting tests of variable length records" << std::endl;
+		std::vector<std::string> messages{ "Short", "", "A considerably longer message that doesn't fit anywhere else", "X" };
+		auto asString = [] (std::span<const std::uint8_t> bytes) { return std::string(bytes.begin(), bytes.end()); };
+		{
+			MemoryMappedBlobFile<MemoryMappedFileUncompressed> file("blob_test");
+			file.clear();
+			for (const std::string &message : messages)
+				file.push_back(std::span<const std::uint8_t>(reinterpret_cast<const std::uint8_t*>(message.data()), message.size()));
+			makeTest<std::string>(messages[2], [&] { return asString(file[2]); }, "Test of variable length record append failed");
+		}
+		{
+			MemoryMappedBlobFile<MemoryMappedFileUncompressed> file("blob_test");
+			makeTest<int>(int(messages.size()), [&] { return file.size(); }, "Test of variable length record count failed");
+			for (unsigned int i = 0; i < messages.size(); i++)
+				makeTest<std::string>(messages[i], [&] { return asString(file[i]); }, "Test of variable length record re-read failed");
+			makeTest<int>(int(messages[0].size() + messages[2].size() + messages[3].size()), [&] { return file.dataSize(); },
+					"Test of variable length record size failed");
+		}
+	}
+	catch(std::exception &e) {
+		std::cout << "A test failed with exception: " << e.what() << std::endl;
+		flawless = false;
+	}
+
+	try {
+		std::cout << "Starting tests of segmented files" << std::endl;
+		{
+			MemoryMappedSegmentedFile<int32_t> file("segmented_test", 10);
+			file.expire(std::chrono::system_clock::now() + std::chrono::hours(1));
+			const int start = file.size();
+			for (int i = 0; i < 35; i++)
+				file.push_back(start + i);
+			makeTest<int>(start + 35, [&] { return file.size(); }, "Test of segmented file append failed");
+			makeTest<int>(start + 23, [&] { return file[start + 23]; }, "Test of segmented file access failed");
+			file.expire(std::chrono::system_clock::now() + std::chrono::hours(1));
+			makeTest<int>(1, [&] { return int(file.segments().size()); }, "Test of segment removal failed");
+		}
+		{
+			MemoryMappedSegmentedFile<int32_t> file("segmented_test", 10);
+			makeTest<int>(file.size() - 2, [&] { return file[file.size() - 2]; }, "Test of segmented file re-read failed");
+			makeTest<bool>(true, [&] { return file.size() - file.firstIndex() <= 10; }, "Test of segmented file retention failed");
+		}
+	}
+	catch(std::exception &e) {
+		std::cout << "A test failed with exception: " << e.what() << std::endl;
+		flawless = false;
+	}
+
+	try {
+		std::cout << "Starting tests of memory resources" << std::endl;
+		MemoryMappedFileArena arena(1 << 16);
+		MemoryMappedFileHugePages hugePages;
+		MemoryMappedFileNumaLocal numaLocal;
+		std::vector<std::pair<std::string, std::pmr::memory_resource*>> resources{ { "arena", &arena }, { "huge pages", &hugePages },
+				{ "NUMA", &numaLocal } };
+		for (auto &resource : resources) {
+			std::vector<std::uint8_t> testData;
+			for (int i = 0; i < 100000; i++)
+				testData.push_back(std::uint8_t(i * 7));
+			{
+				MemoryMappedFileUncompressed archive("resource_test", resource.second);
+				archive.clear();
+				archive.append(testData);
+				makeTest<bool>(true, [&] { return archive.memoryResource() == resource.second; }, "Test of memory resource " + resource.first + " failed");
+			}
+			MemoryMappedFileUncompressed archive("resource_test", resource.second);
+			makeTest<int>(testData[77777], [&] { return archive[77777]; }, "Test of reading with memory resource " + resource.first + " failed");
+		}
+	}
+	catch(std::exception &e) {
+		std::cout << "A test failed with exception: " << e.what() << std::endl;
+		flawless = false;
+	}
+
+	try {
+		std::cout << "Starting tests of size caching" << std::endl;
+		{
+			MemoryMappedFileUncompressed writer("size_test");
+			writer.clear();
+			writer.append(std::vector<std::uint8_t>(100, 13));
+		}
+		MemoryMappedFileUncompressed readerFile("size_test");
+		const MemoryMappedFileBase &reader = readerFile; // Reading through the non-const operator[] would make it modified
+		makeTest<int>(100, [&] { return reader.size(); }, "Test of size of an unloaded file failed");
+		makeTest<int>(100, [&] { return reader.size(); }, "Test of cached size failed");
+		{
+			MemoryMappedFileUncompressed writer("size_test");
+			writer.append(std::vector<std::uint8_t>(50, 14));
+		}
+		makeTest<int>(150, [&] { return reader.size(); }, "Test of noticing an append by another writer failed");
+		makeTest<int>(14, [&] { return reader[140]; }, "Test of reading an append by another writer failed");
+
+		MemoryMappedFileUncompressed appender("size_test");
+		appender.append(std::vector<std::uint8_t>(10, 15));
+		{
+			MemoryMappedFileUncompressed writer("size_test");
+			writer.append(std::vector<std::uint8_t>(20, 16));
+		}
+		makeTest<int>(160, [&] { return appender.size(); }, "Test of size with appends waiting to be flushed failed");
+		appender.flush();
+		makeTest<int>(180, [&] { return appender.size(); }, "Test of noticing an append by another writer after flushing failed");
+		makeTest<int>(16, [&] { return appender[150]; }, "Test of reading an append by another writer after flushing failed");
+		makeTest<int>(15, [&] { return appender[170]; }, "Test of reading a flushed append behind another writer's failed");
+#ifdef __linux__
+		// The watcher's thread notices the append a moment later, size() only checks what it has counted
+		makeTest<int>(180, [&] { return reader.size(); }, "Test of noticing appends of another file object failed");
+		const pid_t appendingProcess = fork();
+		if (appendingProcess == 0) {
+			std::ofstream file("size_test." + MemoryMappedFileUncompressed::standardExtension(), std::fstream::app | std::fstream::binary);
+			file << std::string(20, char(17));
+			file.close();
+			_exit(file.good() ? 0 : 1);
+		}
+		if (appendingProcess > 0)
+			waitpid(appendingProcess, nullptr, 0);
+		for (int waited = 0; waited < 100 && reader.size() != 200; waited++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		makeTest<int>(200, [&] { return reader.size(); }, "Test of noticing an append by another process failed");
+#endif
+	}
+	catch(std::exception &e) {
+		std::cout << "A test failed with exception: " << e.what() << std::endl;
+		flawless = false;
+	}
+
+	try {
+		std::cout << "Starting tests of shared files" << std::endl;
+		std::remove(("shared_test." + MemoryMappedFileShared::standardExtension()).c_str());
+		MemoryMappedSharedFile<int64_t> reader("shared_test");
+#ifdef __linux__
+		// The third writer is another process, appending through the same control block
+		const pid_t writingProcess = fork();
+		if (writingProcess == 0) {
+			MemoryMappedSharedFile<int64_t> writer("shared_test");
+			for (int j = 0; j < 1000; j++)
+				writer.push_back(2000 + j);
+			_exit(0);
+		}
+		const int writerCount = writingProcess > 0 ? 3 : 2;
+#else
+		const int writerCount = 2;
+#endif
+		std::vector<std::thread> writers;
+		for (int i = 0; i < 2; i++) {
+			writers.emplace_back([i] {
+				MemoryMappedSharedFile<int64_t> writer("shared_test");
+				for (int j = 0; j < 1000; j++)
+					writer.push_back(i * 1000 + j);
+			});
+		}
+		int64_t sum = 0;
+		int read = 0;
+		while (read < writerCount * 1000 && reader.waitForSize(read, 5000)) {
+			std::span<const int64_t> records = reader.records(read);
+			for (int64_t value : records)
+				sum += value;
+			read += int(records.size());
+		}
+		for (std::thread &writer : writers)
+			writer.join();
+#ifdef __linux__
+		int status = 0;
+		if (writingProcess > 0)
+			waitpid(writingProcess, &status, 0);
+		makeTest<bool>(true, [&] { return WIFEXITED(status) && WEXITSTATUS(status) == 0; }, "Test of appending to a shared file from another process failed");
+#endif
+		makeTest<int>(writerCount * 1000, [&] { return reader.size(); }, "Test of concurrent appends to a shared file failed");
+		makeTest<int64_t>(int64_t(writerCount * 1000 - 1) * (writerCount * 1000) / 2, [&] { return sum; },
+				"Test of reading a shared file while appending failed");
+#ifdef __linux__
+		// A process whose file size limit stops the allocation fails to append, but the following append must not wait for it
+		const pid_t failingProcess = fork();
+		if (failingProcess == 0) {
+			signal(SIGXFSZ, SIG_IGN);
+			rlimit limit;
+			getrlimit(RLIMIT_FSIZE, &limit);
+			rlimit lowered = limit;
+			lowered.rlim_cur = 1 << 21;
+			setrlimit(RLIMIT_FSIZE, &lowered);
+			MemoryMappedFileShared writer("shared_test");
+			const std::vector<std::uint8_t> large(1 << 22);
+			bool failed = false;
+			try {
+				writer.append(large.data(), int(large.size()));
+			} catch (std::runtime_error&) {
+				failed = true;
+			}
+			setrlimit(RLIMIT_FSIZE, &limit);
+			const int64_t value = -1;
+			writer.append(reinterpret_cast<const std::uint8_t*>(&value), sizeof(value));
+			_exit(failed ? 0 : 1);
+		}
+		int failingStatus = -1;
+		for (int waited = 0; waited < 500 && failingProcess > 0; waited++) {
+			if (waitpid(failingProcess, &failingStatus, WNOHANG) == failingProcess)
+				break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		if (failingProcess > 0 && waitpid(failingProcess, nullptr, WNOHANG) == 0) {
+			kill(failingProcess, SIGKILL);
+			waitpid(failingProcess, nullptr, 0);
+		}
+		makeTest<bool>(true, [&] { return WIFEXITED(failingStatus) && WEXITSTATUS(failingStatus) == 0; },
+				"Test of appending to a shared file after a failed append failed");
+		makeTest<int64_t>(-1, [&] { return reader[reader.size() - 1]; }, "Test of contents after a failed append failed");
+#endif
+	}
+	catch(std::exception &e) {
+		std::cout << "A test failed with exception: " << e.what() << std::endl;
+		flawless = false;
+	}
+
+	try {
+		std::cout << "Starting tests of tailing" << std::endl;
+		std::remove("tail_test_cursor.dat");
+		{
+			MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> writer("tail_test");
+			writer.clear();
+		}
+		MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> reader("tail_test");
+		std::thread writing([] {
+			MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> writer("tail_test");
+			for (int i = 0; i < 10; i++) {
+				for (int j = 0; j < 10; j++)
+					writer.push_back(i * 10 + j);
+				writer.flush();
+				std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			}
+		});
+		int sum = 0;
+		int delivered = 0;
+		{
+			MemoryMappedFileTail<int32_t> tail(reader, "tail_test_cursor");
+			while (tail.cursor() < 100 && tail.next([&] (std::span<const int32_t> records) {
+				for (int32_t record : records)
+					sum += record;
+				delivered += int(records.size());
+			}, 5000));
+		}
+		writing.join();
+		makeTest<int>(100, [&] { return delivered; }, "Test of delivering appended records failed");
+		makeTest<int>(4950, [&] { return sum; }, "Test of contents of delivered records failed");
+		MemoryMappedFileTail<int32_t> resumed(reader, "tail_test_cursor");
+		makeTest<int>(100, [&] { return resumed.cursor(); }, "Test of resuming from a stored cursor failed");
+		makeTest<bool>(false, [&] { return resumed.next([] (std::span<const int32_t>) {}, 10); }, "Test of waiting for nothing failed");
+
+		MemoryMappedSharedFile<int64_t> shared("shared_test");
+		MemoryMappedFileTail<int64_t, MemoryMappedSharedFile<int64_t>> sharedTail(shared, shared.size() - 10);
+		int sharedDelivered = 0;
+		sharedTail.next([&] (std::span<const int64_t> records) { sharedDelivered += int(records.size()); }, 0);
+		makeTest<int>(10, [&] { return sharedDelivered; }, "Test of tailing a shared file failed");
+	}
+	catch(std::exception &e) {
+		std::cout << "A test failed with exception: " << e.what() << std::endl;
+		flawless = false;
+	}
+
+	try {
+		std::cout << "Starting tests of asynchronous loading" << std::endl;
+		{
+			MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> writer("async_test");
+			writer.clear();
+			for (int i = 0; i < 100000; i++)
+				writer.push_back(i);
+		}
+		MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> file("async_test");
+		std::promise<std::pair<int, bool>> result;
+		[] (const MemoryMappedFile<int32_t> &file, std::promise<std::pair<int, bool>> &result) -> DetachedCoroutine {
+			try {
+				std::span<const int32_t> records = co_await file.readAsync(50000, 3);
+				const std::thread::id loadedOn = std::this_thread::get_id();
+				std::span<const int32_t> again = co_await file.readAsync(10, 2);
+				result.set_value({ records[2] + again[1], loadedOn == std::this_thread::get_id() });
+			}
+			catch(...) {
+				result.set_exception(std::current_exception());
+			}
+		}(file, result);
+		const std::pair<int, bool> obtained = result.get_future().get();
+		makeTest<int>(50013, [&] { return obtained.first; }, "Test of reading asynchronously failed");
+		makeTest<bool>(true, [&] { return obtained.second; }, "Test of not suspending when the records are loaded failed");
+
+		std::promise<void> failure;
+		[] (const MemoryMappedFile<int32_t> &file, std::promise<void> &failure) -> DetachedCoroutine {
+			try {
+				co_await file.readAsync(99999, 2);
+				failure.set_value();
+			}
+			catch(...) {
+				failure.set_exception(std::current_exception());
+			}
+		}(file, failure);
+		makeTest<bool>(true, [&] {
+			try {
+				failure.get_future().get();
+			}
+			catch(std::logic_error&) {
+				return true;
+			}
+			return false;
+		}, "Test of reading asynchronously behind the end failed");
+
+		MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> partial("async_test");
+		std::promise<void> loaded;
+		[] (const MemoryMappedFile<int32_t> &file, std::promise<void> &loaded) -> DetachedCoroutine {
+			co_await file.loadAsync(1000);
+			loaded.set_value();
+		}(partial, loaded);
+		loaded.get_future().get();
+		const std::int64_t partlyRead = partial.statistics()[MemoryMappedFileCounter::BYTES_READ];
+		makeTest<bool>(true, [&] { return partlyRead >= std::int64_t(1000 * sizeof(int32_t)) && partlyRead < std::int64_t(100000 * sizeof(int32_t)); },
+				"Test of loading a part of a file asynchronously failed");
+		makeTest<int>(999, [&] { return partial.records()[999]; }, "Test of contents loaded asynchronously failed");
+	}
+	catch(std::exception &e) {
+		std::cout << "A test failed with exception: " << e.what() << std::endl;
+		flawless = false;
+	}
+
+	try {
+		std::cout << "Starting tests of access hints" << std::endl;
+		for (int i = 0; i < ARCHIVE_TYPES; i++) {
+			auto makeFile = [&] () -> MemoryMappedFile<int32_t> {
+#ifdef MEMORY_MAPPED_FILE_LZMA
+				if (i) return MemoryMappedFile<int32_t, MemoryMappedFileCompressed>("hint_test");
+#endif
+				return MemoryMappedFile<int32_t, MemoryMappedFileUncompressed>("hint_test");
+			};
+			{
+				MemoryMappedFile<int32_t> writer = makeFile();
+				writer.clear();
+				for (int j = 0; j < 100000; j++)
+					writer.push_back(j);
+			}
+			MemoryMappedFile<int32_t> file = makeFile();
+			file.prefetch(60000, 1000);
+			makeTest<int>(60500, [&] { return file[60500]; }, "Test of reading prefetched records failed");
+			file.dropCache(0, 60000);
+			file.adviseSequential();
+			int sum = 0;
+			for (int j = 60000; j < 100000; j++)
+				sum += file[j] - 60000;
+			makeTest<int>(39999 * 40000 / 2, [&] { return sum; }, "Test of reading sequentially failed");
+			file.adviseRandom();
+			file.prefetch(0, 10);
+			makeTest<int>(7, [&] { return file[7]; }, "Test of prefetching a loaded part failed");
+		}
+		{
+			// The advice is given to the descriptor the file is loaded through, also when it's opened again because the file was replaced
+			const MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> advised("hint_test");
+			advised.adviseRandom();
+			makeTest<int>(500, [&] { return advised[500]; }, "Test of loading a part after advising random access failed");
+			{
+				MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> replacement("hint_test_replacement");
+				replacement.clear();
+				for (int j = 0; j < 100000; j++)
+					replacement.push_back(-j);
+			}
+			std::rename("hint_test_replacement.dat", "hint_test.dat");
+			advised.adviseSequential();
+			makeTest<int>(-90000, [&] { return advised[90000]; }, "Test of loading a replaced file after advising sequential access failed");
+		}
+	}
+	catch(std::exception &e) {
+		std::cout << "A test failed with exception: " << e.what() << std::endl;
+		flawless = false;
+	}
+
+	try {
+		std::cout << "Starting tests of statistics" << std::endl;
+		const MemoryMappedFileStatisticsSnapshot globalBefore = MemoryMappedFileStatistics::global().snapshot();
+		{
+			MemoryMappedFileUncompressed writer("statistics_test");
+			writer.clear();
+			writer.append(std::vector<std::uint8_t>(1000, 13));
+			writer.flush();
+			writer.append(std::vector<std::uint8_t>(500, 14));
+			writer.flush();
+			const MemoryMappedFileStatisticsSnapshot written = writer.statistics();
+			makeTest<std::int64_t>(1, [&] { return written[MemoryMappedFileCounter::FULL_FLUSHES]; }, "Test of counting full flushes failed");
+			makeTest<std::int64_t>(1, [&] { return written[MemoryMappedFileCounter::APPEND_FLUSHES]; }, "Test of counting appending flushes failed");
+			makeTest<std::int64_t>(1500, [&] { return written[MemoryMappedFileCounter::BYTES_WRITTEN]; }, "Test of counting written bytes failed");
+			makeTest<std::uint64_t>(2, [&] { return written[MemoryMappedFileTiming::FLUSH].count; }, "Test of measuring flushes failed");
+		}
+		const MemoryMappedFileBase &reader = MemoryMappedFileUncompressed("statistics_test");
+		makeTest<int>(14, [&] { return reader[1200]; }, "Test of reading with statistics failed");
+		const MemoryMappedFileStatisticsSnapshot read = reader.statistics();
+		makeTest<bool>(true, [&] { return read[MemoryMappedFileCounter::BYTES_READ] > 1200; }, "Test of counting read bytes failed");
+		makeTest<std::int64_t>(1, [&] { return read[MemoryMappedFileCounter::LAZY_LOADS]; }, "Test of counting lazy loads failed");
+		makeTest<bool>(true, [&] { return read[MemoryMappedFileCounter::RESIDENT_BYTES] >= read[MemoryMappedFileCounter::BYTES_READ]; },
+				"Test of counting resident bytes failed");
+		const MemoryMappedFileStatisticsSnapshot globalAfter = MemoryMappedFileStatistics::global().snapshot();
+		makeTest<std::int64_t>(1500, [&] { return globalAfter[MemoryMappedFileCounter::BYTES_WRITTEN] - globalBefore[MemoryMappedFileCounter::BYTES_WRITTEN]; },
+				"Test of global statistics failed");
+		makeTest<std::string>("lazy_loads", [&] { return MemoryMappedFileStatisticsSnapshot::name(MemoryMappedFileCounter::LAZY_LOADS); },
+				"Test of names of counters failed");
+		MemoryMappedFileUncompressed appending("statistics_test");
+		appending.append(std::vector<std::uint8_t>(10, 15));
+		const MemoryMappedFileBase &appended = appending;
+		makeTest<int>(15, [&] { return appended[1505]; }, "Test of reading appended bytes with statistics failed");
+		makeTest<std::int64_t>(0, [&] { return appended.statistics()[MemoryMappedFileCounter::LAZY_LOADS]; },
+				"Test of not counting reads of appended bytes as lazy loads failed");
+
+		{
+			MemoryMappedFileUncompressed modified("partial_flush_test");
+			modified.clear();
+			modified.append(std::vector<std::uint8_t>(10000, 16));
+			modified.flush();
+			const std::int64_t writtenBefore = modified.statistics()[MemoryMappedFileCounter::BYTES_WRITTEN];
+			modified[5000] = 17;
+			modified.push_back(18);
+			modified.flush();
+			makeTest<std::int64_t>(4097, [&] { // The modified page and the appended byte
+				return modified.statistics()[MemoryMappedFileCounter::BYTES_WRITTEN] - writtenBefore;
+			}, "Test of writing only modified pages failed");
+		}
+		const MemoryMappedFileBase &partiallyWritten = MemoryMappedFileUncompressed("partial_flush_test");
+		makeTest<int>(10001, [&] { return partiallyWritten.size(); }, "Test of size after writing only modified pages failed");
+		makeTest<int>(17, [&] { return partiallyWritten[5000]; }, "Test of reading a page written in place failed");
+		makeTest<int>(16, [&] { return partiallyWritten[9999]; }, "Test of reading a page that wasn't written again failed");
+		makeTest<int>(18, [&] { return partiallyWritten[10000]; }, "Test of reading a byte appended with modifications failed");
+	}
+	catch(std::exception &e) {
+		std::cout << "A test failed with exception: " << e.what() << std::endl;
+		flawless = false;
+	}
+
+	try {
+		std::cout << "Starting tests of checksums" << std::endl;
+		const std::string digits = "123456789";
+		makeTest<std::uint32_t>(0xe3069283, [&] { return crc32c(reinterpret_cast<const std::uint8_t*>(digits.data()), digits.size()); },
+				"Test of CRC32C failed");
+		makeTest<std::uint32_t>(0xe3069283, [&] {
+			return crc32c(reinterpret_cast<const std::uint8_t*>(digits.data()) + 4, 5, crc32c(reinterpret_cast<const std::uint8_t*>(digits.data()), 4));
+		}, "Test of CRC32C in parts failed");
+
+		const MemoryMappedFileOptions checked{ .checksums = true };
+		{
+			MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> file("checksum_test", checked);
+			file.clear();
+			for (int i = 0; i < 10000; i++)
+				file.push_back(i);
+		}
+		{
+			MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> file("checksum_test", checked);
+			makeTest<int>(5000, [&] { return file[5000]; }, "Test of reading a checked file failed");
+			file[5000] = -1;
+		}
+		{
+			MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> file("checksum_test", checked);
+			for (int i = 0; i < 100; i++)
+				file.push_back(10000 + i);
+		}
+		{
+			const MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> file("checksum_test", checked);
+			makeTest<int>(-1, [&] { return file[5000]; }, "Test of checksums after modification failed");
+			makeTest<int>(10099, [&] { return file[10099]; }, "Test of checksums after appending failed");
+		}
+		{
+			std::fstream damaging("checksum_test.dat", std::fstream::in | std::fstream::out | std::fstream::binary);
+			damaging.seekp(30000);
+			damaging.put(13);
+		}
+		const MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> damaged("checksum_test", checked);
+		makeTest<int>(10, [&] { return damaged[10]; }, "Test of reading before a damaged page failed");
+		makeTest<bool>(true, [&] {
+			try {
+				damaged[9000];
+			}
+			catch(std::runtime_error&) {
+				return true;
+			}
+			return false;
+		}, "Test of detecting a damaged page failed");
+	}
+	catch(std::exception &e) {
+		std::cout << "A test failed with exception: " << e.what() << std::endl;
+		flawless = false;
+	}
+
+	try {
+		std::cout << "Starting tests of encoded files" << std::endl;
+		struct Measurement {
+			std::int64_t timestamp;
+			std::int32_t value;
+			std::int16_t sensor;
+			std::int16_t padding;
+		};
+		const MemoryMappedFileLayout layout(sizeof(Measurement), {
+				{ offsetof(Measurement, timestamp), sizeof(Measurement::timestamp), MemoryMappedFileTransform::DELTA_OF_DELTA },
+				{ offsetof(Measurement, value), sizeof(Measurement::value), MemoryMappedFileTransform::DELTA },
+				{ offsetof(Measurement, sensor), sizeof(Measurement::sensor), MemoryMappedFileTransform::DICTIONARY } });
+		makeTest<int>(4, [&] { return int(layout.fields().size()); }, "Test of filling gaps in a layout failed");
+		auto measurement = [] (int i) {
+			return Measurement{ 1700000000000 + i * 1000 + (i % 7 == 0), 20000 + (i % 50) - (i % 13) * 3, std::int16_t(i % 3), 0 };
+		};
+		{
+			MemoryMappedFile<Measurement, MemoryMappedFileEncoded> file("encoded_test", layout);
+			file.clear();
+			for (int i = 0; i < 5000; i++)
+				file.push_back(measurement(i));
+		}
+		makeTest<bool>(true, [&] { return std::ifstream("encoded_test.enc", std::ifstream::ate | std::ifstream::binary).tellg() < 5000 * 5; },
+				"Test of encoding efficiency failed");
+		{
+			MemoryMappedFile<Measurement, MemoryMappedFileEncoded> file("encoded_test", layout);
+			makeTest<int>(5000, [&] { return file.size(); }, "Test of size of an encoded file failed");
+			makeTest<bool>(true, [&] {
+				for (int i = 0; i < file.size(); i++) {
+					const Measurement expected = measurement(i);
+					const Measurement &read = std::as_const(file)[i];
+					if (read.timestamp != expected.timestamp || read.value != expected.value || read.sensor != expected.sensor)
+						return false;
+				}
+				return true;
+			}, "Test of decoding failed");
+			file[4500].value = -7;
+		}
+		{
+			MemoryMappedFile<Measurement, MemoryMappedFileEncoded> file("encoded_test", layout);
+			for (int i = 5000; i < 6000; i++)
+				file.push_back(measurement(i));
+			file.flush();
+			makeTest<std::int64_t>(1, [&] { return file.statistics()[MemoryMappedFileCounter::APPEND_FLUSHES]; },
+					"Test of rewriting only the last blocks failed");
+		}
+		{
+			MemoryMappedFileEncoded bytes("encoded_test", MemoryMappedFileLayout(sizeof(Measurement), {}));
+			bytes.push_back(13);
+		}
+		const MemoryMappedFile<Measurement, MemoryMappedFileEncoded> file("encoded_test", layout);
+		makeTest<int>(6000, [&] { return file.size(); }, "Test of size of an encoded file after appending failed");
+		makeTest<std::int64_t>(measurement(10).timestamp, [&] { return file[10].timestamp; }, "Test of reading the beginning of an encoded file failed");
+		makeTest<int>(-7, [&] { return file[4500].value; }, "Test of modifying an encoded file failed");
+		makeTest<int>(measurement(5999).value, [&] { return file[5999].value; }, "Test of appending to an encoded file failed");
+		makeTest<int>(13, [&] {
+			return int(MemoryMappedFileEncoded("encoded_test", MemoryMappedFileLayout(sizeof(Measurement), {})).data()[6000 * sizeof(Measurement)]);
+		}, "Test of a partial record in an encoded file failed");
+		makeTest<bool>(true, [&] {
+			try {
+				MemoryMappedFileEncoded("encoded_test", MemoryMappedFileLayout(4, {})).size();
+			}
+			catch(std::runtime_error&) {
+				return true;
+			}
+			return false;
+		}, "Test of detecting a wrong layout failed");
+	}
+	catch(std::exception &e) {
+		std::cout << "A test failed with exception: " << e.what() << std::endl;
+		flawless = false;
+	}
+
+	try {
+		std::cout << "Starting tests of snapshots" << std::endl;
+		MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> file("snapshot_test");
+		file.clear();
+		for (int i = 0; i < 10000; i++)
+			file.push_back(i);
+		{
+			const MemoryMappedFileSnapshot<int32_t> before = file.snapshot();
+			file[5000] = -1;
+			file[5001] = -2;
+			for (int i = 0; i < 10000; i++)
+				file.push_back(i);
+			const MemoryMappedFileSnapshot<int32_t> after = file.snapshot();
+			file[20] = -3;
+			makeTest<int>(10000, [&] { return before.size(); }, "Test of size of a snapshot failed");
+			makeTest<int>(5000, [&] { return before[5000]; }, "Test of reading a snapshot after modification failed");
+			makeTest<int>(-2, [&] { return after[5001]; }, "Test of reading a later snapshot failed");
+			makeTest<int>(20, [&] { return after[20]; }, "Test of reading a later snapshot after modification failed");
+			makeTest<int>(9999, [&] { return after[19999]; }, "Test of reading appended records from a snapshot failed");
+			makeTest<int>(2, [&] { return before.copiedPages(); }, "Test of copying only modified pages failed");
+			makeTest<bool>(true, [&] { return after.version() > before.version(); }, "Test of versions of snapshots failed");
+			file.clear();
+			std::vector<int32_t> read(3);
+			before.read(4999, 3, read.data());
+			makeTest<int>(5001, [&] { return read[2]; }, "Test of reading a snapshot after clearing the file failed");
+		}
+		{
+			struct Triple {
+				int32_t a, b, c;
+			};
+			MemoryMappedFile<Triple, MemoryMappedFileUncompressed> triples("snapshot_triple_test");
+			triples.clear();
+			for (int i = 0; i < 1000; i++)
+				triples.push_back({ i, i, i });
+			// Record 341 begins in the first page and ends in the second one
+			const MemoryMappedFileSnapshot<Triple> snapshot = triples.snapshot();
+			triples[341] = { -1, -2, -3 };
+			makeTest<int>(341, [&] { return snapshot[341].c; }, "Test of modifying a record spanning two pages failed");
+			triples.clear();
+		}
+
+		for (int i = 0; i < 10000; i++)
+			file.push_back(0);
+		std::atomic<bool> consistent = true;
+		std::thread reading;
+		{
+			// Every write keeps the sum zero, so a snapshot with a different sum is torn
+			MemoryMappedFileSnapshot<int32_t> snapshot = file.snapshot();
+			std::mutex handover;
+			reading = std::thread([&] {
+				std::vector<int32_t> records(10000);
+				for (int round = 0; round < 50; round++) {
+					std::unique_lock<std::mutex> lock(handover);
+					const MemoryMappedFileSnapshot<int32_t> current = snapshot;
+					lock.unlock();
+					current.read(0, 10000, records.data());
+					std::int64_t sum = 0;
+					for (int32_t record : records)
+						sum += record;
+					if (sum != 0)
+						consistent = false;
+				}
+			});
+			for (int i = 0; i < 200000; i++) {
+				file[(i * 7919) % 10000] += 1;
+				file[(i * 1031) % 10000] -= 1;
+				if (i % 10000 == 0) {
+					std::lock_guard<std::mutex> lock(handover);
+					snapshot = file.snapshot();
+				}
+			}
+			reading.join();
+		}
+		makeTest<bool>(true, [&] { return consistent.load(); }, "Test of consistency of snapshots read during modifications failed");
+	}
+	catch(std::exception &e) {
+		std::cout << "A test failed with exception: " << e.what() << std::endl;
+		flawless = false;
+	}
+
+	try {
+		std::cout << "Starting tests of statically dispatched access" << std::endl;
+		struct Triple {
+			int32_t a, b, c;
+		};
+		{
+			MemoryMappedFile<Triple, MemoryMappedFileUncompressed> file("static_test");
+			file.clear();
+			for (int i = 0; i < 1000; i++)
+				file.push_back({ i, i * 2, i * 3 });
+		}
+		{
+			const MemoryMappedFile<Triple, MemoryMappedFileUncompressed> file("static_test");
+			makeTest<int>(1998, [&] { return file[999].b; }, "Test of lazy loading through statically dispatched access failed");
+			makeTest<int>(1000, [&] { return file.size(); }, "Test of size of statically dispatched file failed");
+			makeTest<bool>(true, [&] {
+				try {
+					file[1000];
+					return false;
+				} catch (std::logic_error&) {
+					return true;
+				}
+			}, "Test of boundary check of statically dispatched access failed");
+		}
+		{
+			MemoryMappedFile<Triple, MemoryMappedFileUncompressed> file("static_test");
+			// Record 341 begins in the first page and ends in the second one
+			const MemoryMappedFileSnapshot<Triple> snapshot = file.snapshot();
+			file[341] = { -1, -2, -3 };
+			makeTest<int>(1023, [&] { return snapshot[341].c; }, "Test of modifying a record spanning two pages failed");
+			makeTest<int>(-3, [&] { return file[341].c; }, "Test of statically dispatched modification failed");
+			int64_t sum = 0;
+			for (const Triple &triple : file.records())
+				sum += triple.a;
+			makeTest<int64_t>(999 * 1000 / 2 - 341 - 1, [&] { return sum; }, "Test of records of statically dispatched file failed");
+		}
+		{
+			MemoryMappedFile<Triple> file = MemoryMappedFile<Triple, MemoryMappedFileUncompressed>("static_test");
+			makeTest<int>(-2, [&] { return file[341].b; }, "Test of converting a statically dispatched file failed");
+			const MemoryMappedFileSnapshot<Triple> snapshot = file.snapshot();
+			file[682] = { 0, 0, 0 };
+			makeTest<int>(2046, [&] { return snapshot[682].c; }, "Test of modifying a record spanning two pages through the parent class failed");
+		}
+	}
+	catch(std::exception &e) {
+		std::cout << "A test failed with exception: " << e.what() << std::endl;
+		flawless = false;
+	}
+
+	for (int type = 0; type < ARCHIVE_TYPES; type++) {
+		try {
+			std::cout << "Starting tests of append-only mode" << (type ? " of archives" : "") << std::endl;
+			auto open = [&] (bool appendOnly) -> std::unique_ptr<MemoryMappedFileBase> {
+				const MemoryMappedFileOptions options{ .appendOnly = appendOnly };
+#ifdef MEMORY_MAPPED_FILE_LZMA
+				if (type) return std::make_unique<MemoryMappedFileCompressed>("append_test", options);
+#endif
+				return std::make_unique<MemoryMappedFileUncompressed>("append_test", options);
+			};
+			auto appendNumbers = [] (MemoryMappedFileBase &file, int from, int to) {
+				for (int i = from; i < to; i++)
+					file.append(reinterpret_cast<const std::uint8_t*>(&i), sizeof(i));
+			};
+			auto numberAt = [] (const MemoryMappedFileBase &file, int index) {
+				int number = 0;
+				for (int i = 0; i < int(sizeof(number)); i++)
+					number |= file[index * int(sizeof(number)) + i] << (i * 8);
+				return number;
+			};
+			{
+				std::unique_ptr<MemoryMappedFileBase> file = open(false);
+				file->clear();
+				appendNumbers(*file, 0, 1000);
+			}
+			{
+				std::unique_ptr<MemoryMappedFileBase> file = open(true);
+				makeTest<int>(4000, [&] { return file->size(); }, "Test of size in append-only mode failed");
+				appendNumbers(*file, 1000, 2000);
+				file->flush();
+				appendNumbers(*file, 2000, 2500);
+				makeTest<int>(10000, [&] { return file->size(); }, "Test of size after appending in append-only mode failed");
+				makeTest<std::int64_t>(0, [&] { return file->statistics()[MemoryMappedFileCounter::BYTES_READ]; },
+						"Test of not loading in append-only mode failed");
+				makeTest<bool>(true, [&] {
+					try {
+						numberAt(*file, 0);
+						return false;
+					} catch (std::logic_error&) {
+						return true;
+					}
+				}, "Test of preventing access in append-only mode failed");
+			}
+			{
+				const std::unique_ptr<MemoryMappedFileBase> file = open(false);
+				makeTest<int>(10000, [&] { return file->size(); }, "Test of size of file appended in append-only mode failed");
+				makeTest<int>(1999, [&] { return numberAt(*file, 1999); }, "Test of reading bytes appended in append-only mode failed");
+				makeTest<int>(2499, [&] { return numberAt(*file, 2499); }, "Test of reading bytes appended in append-only mode later failed");
+			}
+			if (type) {
+				// Bytes of an unfinished frame must be ignored
+				std::ofstream("append_test.lzma", std::ios::app | std::ios::binary) << "unfinished";
+				const std::unique_ptr<MemoryMappedFileBase> file = open(false);
+				makeTest<int>(2499, [&] { return numberAt(*file, 2499); }, "Test of ignoring an unfinished frame failed");
+			}
+			{
+				std::unique_ptr<MemoryMappedFileBase> file = open(true);
+				file->clear();
+				appendNumbers(*file, 7, 8);
+			}
+			{
+				const std::unique_ptr<MemoryMappedFileBase> file = open(false);
+				makeTest<int>(4, [&] { return file->size(); }, "Test of clearing in append-only mode failed");
+				makeTest<int>(7, [&] { return numberAt(*file, 0); }, "Test of appending after clearing in append-only mode failed");
+			}
+		}
+		catch(std::exception &e) {
+			std::cout << "A test failed with exception: " << e.what() << std::endl;
+			flawless = false;
+		}
+	}
+
+	try {
+		std::cout << "Starting tests of zone maps" << std::endl;
+		struct Reading {
+			int32_t time;
+			int32_t sensor;
+		};
+		auto byTime = [] (const Reading &reading) { return reading.time; };
+		auto bySensor = [] (const Reading &reading) { return reading.sensor; };
+		using TimeZones = MemoryMappedFileZoneMap<Reading, int32_t, MemoryMappedFileUncompressed, 1000>;
+		using SensorZones = MemoryMappedFileZoneMap<Reading, int32_t, MemoryMappedFileUncompressed, 1000, 512>;
+		{
+			MemoryMappedFile<Reading, MemoryMappedFileUncompressed> file("zone_test");
+			file.clear();
+			for (int i = 0; i < 10000; i++)
+				file.push_back({ i, (i / 1000) * 100 + i % 7 });
+			file.flush();
+			TimeZones times(file, "zone_test_by_time", byTime);
+			times.rebuild();
+			SensorZones sensors(file, "zone_test_by_sensor", bySensor);
+			sensors.rebuild();
+			makeTest<int>(10, [&] { return times.blocks(); }, "Test of number of zones failed");
+			makeTest<int>(4999, [&] { return times.zone(4).max; }, "Test of maximum of a zone failed");
+		}
+		{
+			MemoryMappedFile<Reading, MemoryMappedFileUncompressed> file("zone_test");
+			TimeZones times(file, "zone_test_by_time", byTime);
+			int found = 0;
+			times.forEach(5500, 5509, [&] (const Reading &reading, int index) {
+				if (reading.time == index)
+					found++;
+			});
+			makeTest<int>(10, [&] { return found; }, "Test of scanning a range of keys failed");
+			makeTest<std::int64_t>(1000 * sizeof(Reading), [&] { return file.statistics()[MemoryMappedFileCounter::BYTES_READ]; },
+					"Test of skipping blocks outside the range failed");
+
+			SensorZones sensors(file, "zone_test_by_sensor", bySensor);
+			const std::int64_t readBefore = file.statistics()[MemoryMappedFileCounter::BYTES_READ];
+			makeTest<int>(143, [&] { return int(sensors.find(703).size()); }, "Test of finding records by a key failed");
+			makeTest<int>(0, [&] { return int(sensors.find(650).size()); }, "Test of finding a missing key failed");
+			makeTest<bool>(true, [&] { return file.statistics()[MemoryMappedFileCounter::BYTES_READ] - readBefore < 3000 * std::int64_t(sizeof(Reading)); },
+					"Test of skipping blocks through the bloom filter failed");
+		}
+		{
+			MemoryMappedFile<Reading, MemoryMappedFileUncompressed> file("zone_test");
+			TimeZones times(file, "zone_test_by_time", byTime);
+			times.push_back({ -5, 0 });
+			file.push_back({ 20000, 0 });
+			times.flush();
+			makeTest<int>(-5, [&] { return times.zone(10).min; }, "Test of updating a zone when appending failed");
+			makeTest<int>(10001, [&] { return times.find(20000).front(); }, "Test of updating zones of records appended in other ways failed");
+			file.clear();
+			file.push_back({ 3, 0 });
+			times.update();
+			makeTest<int>(1, [&] { return times.blocks(); }, "Test of rebuilding zones of a shrunk file failed");
+		}
+		{
+			MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> file("read_test");
+			file.clear();
+			for (int i = 0; i < 100; i++)
+				file.push_back(i);
+		}
+		MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> cleared("read_test");
+		int32_t records[2] = {};
+		cleared.read(90, 2, records);
+		makeTest<int>(91, [&] { return records[1]; }, "Test of reading records that aren't loaded failed");
+		cleared.clear();
+		bool refused = false;
+		try {
+			cleared.read(10, 1, records);
+		} catch (std::logic_error&) {
+			refused = true;
+		}
+		makeTest<bool>(true, [&] { return refused; }, "Test of refusing to read a cleared file failed");
+		cleared.push_back(-1);
+		cleared.push_back(-2);
+		cleared.read(0, 2, records);
+		makeTest<int>(-3, [&] { return records[0] + records[1]; }, "Test of reading a cleared file that was appended to failed");
+		refused = false;
+		try {
+			cleared.read(1, 2, records);
+		} catch (std::logic_error&) {
+			refused = true;
+		}
+		makeTest<bool>(true, [&] { return refused; }, "Test of refusing to read behind the end of a cleared file failed");
+	}
+	catch(std::exception &e) {
+		std::cout << "A test failed with exception: " << e.what() << std::endl;
+		flawless = false;
+	}
+
+	try {
+		std::cout << "Starting tests of external sorting" << std::endl;
+		struct Order {
+			int32_t customer;
+			int32_t number;
+		};
+		{
+			MemoryMappedFile<Order, MemoryMappedFileUncompressed> file("sort_test");
+			file.clear();
+			for (int i = 0; i < 10000; i++)
+				file.push_back({ (i * 7919) % 1000, i });
+		}
+		const MemoryMappedFile<Order, MemoryMappedFileUncompressed> input("sort_test");
+		MemoryMappedFile<Order, MemoryMappedFileUncompressed> output("sort_test_sorted", MemoryMappedFileOptions{ .appendOnly = true });
+		MemoryMappedFileSortOptions options;
+		options.runBytes = 1000 * sizeof(Order);
+		options.bufferBytes = 64 * sizeof(Order);
+		options.threads = 3;
+		sortMemoryMappedFileBy(input, output, [] (const Order &order) { return order.customer; }, options);
+		output.flush();
+		makeTest<bool>(true, [&] {
+			return input.statistics()[MemoryMappedFileCounter::LAZY_LOADS] == 0;
+		}, "Test of reading runs without loading the input failed");
+		{
+			const MemoryMappedFile<Order, MemoryMappedFileUncompressed> sorted("sort_test_sorted");
+			makeTest<int>(10000, [&] { return sorted.size(); }, "Test of size of sorted file failed");
+			makeTest<bool>(true, [&] {
+				std::vector<int> seen(10000, 0);
+				for (int i = 0; i < sorted.size(); i++) {
+					if (i > 0 && sorted[i].customer < sorted[i - 1].customer)
+						return false;
+					if (sorted[i].customer != (sorted[i].number * 7919) % 1000)
+						return false;
+					seen[sorted[i].number]++;
+				}
+				return std::all_of(seen.begin(), seen.end(), [] (int count) { return count == 1; });
+			}, "Test of order of sorted records failed");
+			makeTest<bool>(false, [&] {
+				return std::ifstream("sort_test_sorted_run_0." + MemoryMappedFileUncompressed::standardExtension()).good();
+			}, "Test of removing temporary files failed");
+		}
+		MemoryMappedFile<Order, MemoryMappedFileUncompressed> small("sort_test_small");
+		sortMemoryMappedFile(input, small, [] (const Order &first, const Order &second) { return first.number > second.number; });
+		makeTest<int>(9999, [&] { return small[0].number; }, "Test of sorting in memory failed");
+		makeTest<int>(0, [&] { return small[9999].number; }, "Test of sorting in memory failed");
+		bool refused = false;
+		try {
+			MemoryMappedFile<Order, MemoryMappedFileUncompressed> same("sort_test");
+			sortMemoryMappedFile(input, same, [] (const Order &first, const Order &second) { return first.number < second.number; });
+		} catch (std::logic_error&) {
+			refused = true;
+		}
+		makeTest<bool>(true, [&] { return refused; }, "Test of refusing to sort a file into itself failed");
+
+		// Runs are sorted on other threads and merged on this one, the first runs are written before the others fail
+		for (bool failMerging : { false, true }) {
+			const std::thread::id merging = std::this_thread::get_id();
+			bool failed = false;
+			try {
+				sortMemoryMappedFileBy(input, output, [&] (const Order &order) {
+					if (failMerging ? std::this_thread::get_id() == merging : order.number >= 5000)
+						throw(std::runtime_error("Comparison failed"));
+					return order.customer;
+				}, options);
+			} catch (std::runtime_error&) {
+				failed = true;
+			}
+			makeTest<bool>(true, [&] { return failed; }, std::string("Test of failing to ") + (failMerging ? "merge" : "sort") + " runs failed");
+			makeTest<bool>(false, [&] {
+				return std::ifstream("sort_test_sorted_run_0." + MemoryMappedFileUncompressed::standardExtension()).good();
+			}, std::string("Test of removing temporary files after failing to ") + (failMerging ? "merge" : "sort") + " runs failed");
+		}
+	}
+	catch(std::exception &e) {
+		std::cout << "A test failed with exception: " << e.what() << std::endl;
+		flawless = false;
+	}
+
+	try {
+		std::cout << "Starting tests of parallel scanning" << std::endl;
+		MemoryMappedFileThreadPool pool(4);
+		makeTest<int>(4, [&] { return pool.workers(); }, "Test of number of workers failed");
+		std::vector<std::atomic<int>> done(1000);
+		pool.run(1000, [&] (int task, int) {
+			if (task % 100 == 0)
+				std::this_thread::sleep_for(std::chrono::milliseconds(2)); // Uneven tasks make the workers steal
+			done[static_cast<unsigned int>(task)]++;
+		});
+		makeTest<bool>(true, [&] {
+			return std::all_of(done.begin(), done.end(), [] (const std::atomic<int> &count) { return count == 1; });
+		}, "Test of running every task once failed");
+		bool rethrown = false;
+		try {
+			pool.run(100, [] (int task, int) {
+				if (task == 57)
+					throw(std::runtime_error("Failed task"));
+			});
+		} catch (std::runtime_error&) {
+			rethrown = true;
+		}
+		makeTest<bool>(true, [&] { return rethrown; }, "Test of rethrowing exceptions of tasks failed");
+
+		for (int i = 0; i <= ARCHIVE_TYPES; i++) {
+			const std::string type = i == 0 ? "uncompressed" : i == 1 ? "encoded" : "compressed";
+			auto makeFile = [&] () -> MemoryMappedFile<int64_t> {
+#ifdef MEMORY_MAPPED_FILE_LZMA
+				if (i == 2) return MemoryMappedFile<int64_t, MemoryMappedFileCompressed>("parallel_test");
+#endif
+				if (i == 1) return MemoryMappedFile<int64_t, MemoryMappedFileEncoded>("parallel_test",
+						MemoryMappedFileLayout(sizeof(int64_t), { { 0, sizeof(int64_t), MemoryMappedFileTransform::DELTA } }));
+				return MemoryMappedFile<int64_t, MemoryMappedFileUncompressed>("parallel_test");
+			};
+			{
+				MemoryMappedFile<int64_t> writer = makeFile();
+				writer.clear();
+				for (int j = 0; j < 100000; j++)
+					writer.push_back(j);
+			}
+			const MemoryMappedFile<int64_t> file = makeFile();
+			makeTest<int64_t>(int64_t(99999) * 100000 / 2, [&] {
+				return parallelReduce(file, int64_t(0), [] (int64_t &sum, int64_t value) { sum += value; },
+						[] (int64_t first, int64_t second) { return first + second; }, pool, 4096);
+			}, "Test of parallel reduction of " + type + " file failed");
+			std::vector<int> indexes(100000, -1);
+			parallelForEach(file, [&] (int64_t value, int index) {
+				indexes[static_cast<unsigned int>(index)] = int(value);
+			}, pool, 4096);
+			makeTest<bool>(true, [&] {
+				for (int j = 0; j < int(indexes.size()); j++)
+					if (indexes[static_cast<unsigned int>(j)] != j)
+						return false;
+				return true;
+			}, "Test of visiting every record of " + type + " file in parallel failed");
+			if (i == 0)
+				makeTest<std::int64_t>(0, [&] { return file.statistics()[MemoryMappedFileCounter::LAZY_LOADS]; },
+						"Test of scanning without loading failed");
+		}
+	}
+	catch(std::exception &e) {
+		std::cout << "A test failed with exception: " << e.what() << std::endl;
+		flawless = false;
+	}
+
+	try {
+		std::cout << "Starting tests of packs" << std::endl;
+		std::remove(("pack_test." + MemoryMappedFilePack::standardExtension()).c_str());
+		{
+			MemoryMappedFilePack pack("pack_test");
+			for (int i = 0; i < 1000; i++) {
+				MemoryMappedFile<int32_t, MemoryMappedFilePacked> file("entity_" + std::to_string(i), pack);
+				for (int j = 0; j <= i % 10; j++)
+					file.push_back(i * 100 + j);
+			}
+			MemoryMappedFile<int32_t, MemoryMappedFilePacked> growing("growing", pack);
+			for (int round = 0; round < 5; round++) {
+				for (int j = 0; j < 3000; j++)
+					growing.push_back(round * 3000 + j);
+				growing.flush();
+				MemoryMappedFile<int32_t, MemoryMappedFilePacked> other("other_" + std::to_string(round), pack);
+				other.push_back(round); // Something is placed behind the growing file, so that it can't always grow in place
+			}
+		}
+		{
+			MemoryMappedFilePack pack("pack_test");
+			makeTest<int>(1006, [&] { return int(pack.names().size()); }, "Test of listing files in a pack failed");
+			makeTest<int>(8 * sizeof(int32_t), [&] { return pack.size("entity_517"); }, "Test of size of a file in a pack failed");
+			const MemoryMappedFile<int32_t, MemoryMappedFilePacked> entity("entity_517", pack);
+			makeTest<int>(51707, [&] { return entity[7]; }, "Test of reading a file in a pack failed");
+			const MemoryMappedFile<int32_t, MemoryMappedFilePacked> growing("growing", pack);
+			makeTest<bool>(true, [&] {
+				for (int i = 0; i < growing.size(); i++)
+					if (growing[i] != i)
+						return false;
+				return growing.size() == 15000;
+			}, "Test of a file grown in multiple extents failed");
+
+			MemoryMappedFile<int32_t, MemoryMappedFilePacked> modified("entity_999", pack);
+			modified[3] = -3;
+			modified.push_back(-10);
+			modified.flush();
+			makeTest<std::int64_t>(11 * sizeof(int32_t), [&] { // The modified page is the whole file and one record is appended
+				return modified.statistics()[MemoryMappedFileCounter::BYTES_WRITTEN];
+			}, "Test of writing only modified parts into a pack failed");
+			MemoryMappedFile<int32_t, MemoryMappedFilePacked> cleared("entity_998", pack);
+			cleared.clear();
+			cleared.push_back(7);
+			pack.remove("entity_0");
+			pack.flush();
+		}
+		{
+			MemoryMappedFilePack pack("pack_test");
+			const MemoryMappedFile<int32_t, MemoryMappedFilePacked> modified("entity_999", pack);
+			makeTest<int>(-3, [&] { return modified[3]; }, "Test of modifying a file in a pack failed");
+			makeTest<int>(-10, [&] { return modified[10]; }, "Test of appending to a file in a pack failed");
+			makeTest<int>(1, [&] { return MemoryMappedFile<int32_t, MemoryMappedFilePacked>("entity_998", pack).size(); },
+					"Test of clearing a file in a pack failed");
+			makeTest<bool>(false, [&] { return pack.contains("entity_0"); }, "Test of removing a file from a pack failed");
+
+			const std::int64_t wasted = pack.wastedBytes();
+			pack.compactInBackground();
+			{
+				MemoryMappedFile<int32_t, MemoryMappedFilePacked> written("entity_500", pack);
+				written.push_back(-500); // Possibly while it's being compacted
+			}
+			pack.waitForCompaction();
+			makeTest<bool>(true, [&] { return wasted > 0 && pack.wastedBytes() < wasted; }, "Test of reclaiming space by compaction failed");
+			makeTest<int>(51707, [&] { return MemoryMappedFile<int32_t, MemoryMappedFilePacked>("entity_517", pack)[7]; },
+					"Test of reading a compacted pack failed");
+			makeTest<int>(-500, [&] { return MemoryMappedFile<int32_t, MemoryMappedFilePacked>("entity_500", pack)[1]; },
+					"Test of writing into a pack while compacting failed");
+			makeTest<int>(14999, [&] { return MemoryMappedFile<int32_t, MemoryMappedFilePacked>("growing", pack)[14999]; },
+					"Test of compacting a file with multiple extents failed");
+		}
+		{
+			MemoryMappedFilePack pack("pack_test");
+			makeTest<int>(-500, [&] { return MemoryMappedFile<int32_t, MemoryMappedFilePacked>("entity_500", pack)[1]; },
+					"Test of reopening a compacted pack failed");
+		}
+		{
+			std::ofstream damaged("pack_test_damaged." + MemoryMappedFilePack::standardExtension());
+			damaged << "This is not a pack, but it's long enough to have a header";
+		}
+		bool refused = false;
+		try {
+			MemoryMappedFilePack pack("pack_test_damaged");
+		} catch (std::runtime_error&) {
+			refused = true;
+		}
+		makeTest<bool>(true, [&] { return refused; }, "Test of refusing a file that isn't a pack failed");
+	}
+	catch(std::exception &e) {
+		std::cout << "A test failed with exception: " << e.what() << std::endl;
+		flawless = false;
+	}
+
+#ifndef _WIN32
+	try {
+		std::cout << "Starting tests of sending ranges" << std::endl;
+		auto receive = [] (int descriptor, int count) {
+			std::vector<int64_t> received(static_cast<unsigned int>(count));
+			std::size_t done = 0;
+			while (done < received.size() * sizeof(int64_t)) {
+				const ssize_t obtained = ::read(descriptor, reinterpret_cast<char*>(received.data()) + done, received.size() * sizeof(int64_t) - done);
+				if (obtained <= 0)
+					throw(std::runtime_error("Could not receive sent records"));
+				done += std::size_t(obtained);
+			}
+			return received;
+		};
+		int sockets[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0)
+			throw(std::runtime_error("Could not create sockets"));
+		for (int i = 0; i <= ARCHIVE_TYPES; i++) {
+			const std::string type = i == 0 ? "uncompressed" : i == 1 ? "encoded" : "compressed";
+			auto makeFile = [&] () -> MemoryMappedFile<int64_t> {
+#ifdef MEMORY_MAPPED_FILE_LZMA
+				if (i == 2) return MemoryMappedFile<int64_t, MemoryMappedFileCompressed>("send_test");
+#endif
+				if (i == 1) return MemoryMappedFile<int64_t, MemoryMappedFileEncoded>("send_test",
+						MemoryMappedFileLayout(sizeof(int64_t), { { 0, sizeof(int64_t), MemoryMappedFileTransform::DELTA } }));
+				return MemoryMappedFile<int64_t, MemoryMappedFileUncompressed>("send_test");
+			};
+			{
+				MemoryMappedFile<int64_t> writer = makeFile();
+				writer.clear();
+				for (int j = 0; j < 10000; j++)
+					writer.push_back(j);
+			}
+			const MemoryMappedFile<int64_t> file = makeFile();
+			file.sendRange(sockets[0], 5000, 1000);
+			makeTest<bool>(true, [&] {
+				std::vector<int64_t> received = receive(sockets[1], 1000);
+				for (int j = 0; j < 1000; j++)
+					if (received[static_cast<unsigned int>(j)] != 5000 + j)
+						return false;
+				return true;
+			}, "Test of sending a range of a " + type + " file failed");
+
+			MemoryMappedFile<int64_t> modified = makeFile();
+			modified[7000] = -1;
+			modified.push_back(10000);
+			modified.sendRange(sockets[0], 6999, 3002);
+			makeTest<bool>(true, [&] {
+				std::vector<int64_t> received = receive(sockets[1], 3002);
+				return received[0] == 6999 && received[1] == -1 && received[2] == 7001 && received[3001] == 10000;
+			}, "Test of sending modified records of a " + type + " file failed");
+
+			bool refused = false;
+			try {
+				file.sendRange(sockets[0], 10000, 2);
+			} catch (std::logic_error&) {
+				refused = true;
+			}
+			makeTest<bool>(true, [&] { return refused; }, "Test of refusing to send records behind the end of a " + type + " file failed");
+		}
+
+		{
+			MemoryMappedFile<int64_t, MemoryMappedFileUncompressed> writer("send_change_test");
+			writer.clear();
+			for (int j = 0; j < 10000; j++)
+				writer.push_back(j);
+		}
+		MemoryMappedFile<int64_t, MemoryMappedFileUncompressed> unflushed("send_change_test");
+		unflushed[100] = -1;
+		unflushed.sendRange(sockets[0], 5000, 10);
+		makeTest<bool>(true, [&] { return receive(sockets[1], 10)[9] == 5009; }, "Test of sending unmodified records of a modified file failed");
+		makeTest<std::int64_t>(0, [&] { return unflushed.statistics()[MemoryMappedFileCounter::FULL_FLUSHES]; },
+				"Test of not flushing modifications outside of the sent range failed");
+		unflushed.clear();
+		unflushed.push_back(-2);
+		unflushed.push_back(-3);
+		unflushed.sendRange(sockets[0], 0, 2);
+		makeTest<bool>(true, [&] {
+			std::vector<int64_t> received = receive(sockets[1], 2);
+			return received[0] == -2 && received[1] == -3;
+		}, "Test of sending records of a cleared file failed");
+		close(sockets[0]);
+		close(sockets[1]);
+
+		int pipeEnds[2];
+		if (pipe(pipeEnds) != 0)
+			throw(std::runtime_error("Could not create a pipe"));
+		MemoryMappedFile<int64_t, MemoryMappedFileUncompressed> appendOnly("send_test", MemoryMappedFileOptions{ .appendOnly = true });
+		appendOnly.push_back(10001);
+		appendOnly.sendRange(pipeEnds[1], 10000, 2);
+		makeTest<bool>(true, [&] {
+			std::vector<int64_t> received = receive(pipeEnds[0], 2);
+			return received[0] == 10000 && received[1] == 10001;
+		}, "Test of sending appended records into a pipe failed");
+		close(pipeEnds[0]);
+		close(pipeEnds[1]);
+	}
+	catch(std::exception &e) {
+		std::cout << "A test failed with exception: " << e.what() << std::endl;
+		flawless = false;
+	}
+#endif
+
+	try {
+		std::cout << "Starting tests of change logs" << std::endl;
+		std::remove(MemoryMappedFileChangeLog::logFileName("change_log_test." + MemoryMappedFileUncompressed::standardExtension()).c_str());
+		MemoryMappedFileUncompressed("change_log_replica").clear();
+		MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> primary("change_log_test", MemoryMappedFileOptions{ .changeLog = true });
+		primary.clear();
+		for (int i = 0; i < 10000; i++)
+			primary.push_back(i);
+		primary.flush();
+		MemoryMappedFileChangeLog log(primary.extendedFileName());
+		MemoryMappedFileUncompressed replica("change_log_replica");
+		auto record = [&] (int index) {
+			int32_t value = 0;
+			replica.read(index * int(sizeof(int32_t)), sizeof(int32_t), reinterpret_cast<uint8_t*>(&value));
+			return value;
+		};
+		MemoryMappedFileDelta delta;
+		while (log.next(delta))
+			replica.apply(delta);
+		makeTest<bool>(true, [&] {
+			replica.load();
+			for (int i = 0; i < 10000; i++)
+				if (record(i) != i)
+					return false;
+			return replica.size() == 10000 * sizeof(int32_t);
+		}, "Test of applying appended records failed");
+
+		primary[5000] = -1;
+		primary.push_back(10000);
+		primary.flush();
+		makeTest<bool>(true, [&] { return log.next(delta); }, "Test of logging modifications failed");
+		makeTest<int>(4096 + int(sizeof(int32_t)), [&] {
+			int bytes = 0;
+			for (const MemoryMappedFileDelta::Range &range : delta.ranges)
+				bytes += int(range.bytes.size());
+			return bytes;
+		}, "Test of logging only modified pages failed");
+		const std::vector<std::uint8_t> serialised = delta.serialise();
+		const MemoryMappedFileDelta received = MemoryMappedFileDelta::deserialise(serialised.data(), int(serialised.size()));
+		replica.apply(received);
+		makeTest<int>(-1, [&] { return record(5000); }, "Test of applying modified records failed");
+		makeTest<int>(10000, [&] { return record(10000); }, "Test of applying appended records to a loaded file failed");
+		makeTest<int>(2, [&] { return int(log.sequence()); }, "Test of sequence numbers of deltas failed");
+
+		primary.clear();
+		primary.push_back(7);
+		primary.flush();
+		{
+			MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> appended("change_log_test",
+					MemoryMappedFileOptions{ .appendOnly = true, .changeLog = true });
+			appended.push_back(8);
+		}
+		makeTest<int>(4, [&] { return int(MemoryMappedFileChangeLog::lastSequence(primary.extendedFileName())); },
+				"Test of finding the last sequence number failed");
+		MemoryMappedFileChangeLog resumed(primary.extendedFileName());
+		resumed.seek(2); // Continues where the replica stopped
+		while (resumed.next(delta))
+			replica.apply(delta);
+		makeTest<bool>(true, [&] { return replica.size() == 2 * sizeof(int32_t) && record(0) == 7 && record(1) == 8; }, "Test of applying a cleared file failed");
+		makeTest<bool>(true, [&] {
+			const MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> reopened("change_log_replica");
+			return reopened.size() == 2 && reopened[0] == 7 && reopened[1] == 8;
+		}, "Test of writing deltas into the replica failed");
+
+		{
+			// A crash while writing a delta leaves only a part of it
+			std::ofstream torn(MemoryMappedFileChangeLog::logFileName(primary.extendedFileName()), std::fstream::app | std::fstream::binary);
+			const std::uint32_t length = 1000;
+			torn.write(reinterpret_cast<const char*>(&length), sizeof(length));
+			torn.write("damaged", 7);
+		}
+		makeTest<int>(4, [&] { return int(MemoryMappedFileChangeLog::lastSequence(primary.extendedFileName())); },
+				"Test of ignoring an incomplete delta failed");
+		makeTest<bool>(false, [&] { return resumed.next(delta); }, "Test of not reading an incomplete delta failed");
+		{
+			MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> continued("change_log_test", MemoryMappedFileOptions{ .changeLog = true });
+			continued.push_back(9);
+		}
+		makeTest<int>(5, [&] { return int(MemoryMappedFileChangeLog::lastSequence(primary.extendedFileName())); },
+				"Test of logging behind an incomplete delta failed");
+		makeTest<bool>(true, [&] { return resumed.next(delta) && delta.sequence == 5; }, "Test of reading a delta written behind an incomplete one failed");
+		replica.apply(delta);
+		makeTest<bool>(true, [&] { return replica.size() == 3 * sizeof(int32_t) && record(2) == 9; }, "Test of applying a delta written behind an incomplete one failed");
+#ifndef _WIN32
+		{
+			// If the file can't be written, the log must not claim it was
+			MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> failing("change_log_test", MemoryMappedFileOptions{ .changeLog = true });
+			failing.push_back(10);
+			std::remove(failing.extendedFileName().c_str());
+			mkdir(failing.extendedFileName().c_str(), 0755);
+			bool failed = false;
+			try {
+				failing.flush();
+			} catch (std::runtime_error&) {
+				failed = true;
+			}
+			makeTest<bool>(true, [&] { return failed; }, "Test of failing to flush into a directory failed");
+			makeTest<int>(5, [&] { return int(MemoryMappedFileChangeLog::lastSequence(primary.extendedFileName())); },
+					"Test of not logging a failed flush failed");
+			rmdir(failing.extendedFileName().c_str());
+		}
+#endif
+	}
+	catch(std::exception &e) {
+		std::cout << "A test failed with exception: " << e.what() << std::endl;
+		flawless = false;
+	}
+
+	try {
+		std::cout << "Starting tests of preallocation" << std::endl;
+		const std::string name = "preallocation_test." + MemoryMappedFileUncompressed::standardExtension();
+		const MemoryMappedFileOptions options = { .preallocation = 1 << 20 };
+		{
+			MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> file("preallocation_test", options);
+			file.clear();
+			file.flush();
+			for (int i = 0; i < 10000; i++) {
+				file.push_back(i);
+				if (i % 100 == 99)
+					file.flush();
+			}
+			makeTest<int>(1, [&] { return int(file.statistics()[MemoryMappedFileCounter::PREALLOCATIONS]); },
+					"Test of reserving space in large steps failed");
+		}
+		makeTest<int>(10000 * sizeof(int32_t), [&] { return int(std::ifstream(name, std::ifstream::ate | std::ifstream::binary).tellg()); },
+				"Test of keeping the size of a file with reserved space failed");
+#ifdef __linux__
+		makeTest<bool>(true, [&] {
+			struct stat status;
+			// Filesystems that can't reserve space allocate only what was written
+			return stat(name.c_str(), &status) == 0 && (status.st_blocks * 512 >= (1 << 20) || status.st_blocks * 512 < 10000 * 4 + 4096);
+		}, "Test of reserving space on disk failed");
+#endif
+		{
+			MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> appended("preallocation_test", MemoryMappedFileOptions{ .appendOnly = true, .preallocation = 1 << 20 });
+			for (int i = 10000; i < 20000; i++) {
+				appended.push_back(i);
+				if (i % 1000 == 999)
+					appended.flush();
+			}
+		}
+		const MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> reopened("preallocation_test");
+		makeTest<bool>(true, [&] {
+			for (int i = 0; i < 20000; i++)
+				if (reopened[i] != i)
+					return false;
+			return reopened.size() == 20000;
+		}, "Test of appending into reserved space failed");
+		{
+			MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> rewritten("preallocation_test", options);
+			rewritten[0] = -1;
+			rewritten.flush();
+			rewritten.push_back(20000);
+		}
+		makeTest<bool>(true, [&] {
+			const MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> file("preallocation_test");
+			return file.size() == 20001 && file[0] == -1 && file[19999] == 19999 && file[20000] == 20000;
+		}, "Test of appending with reserved space after rewriting failed");
+	}
+	catch(std::exception &e) {
+		std::cout << "A test failed with exception: " << e.what() << std::endl;
+		flawless = false;
+	}
+
+	try {
+		std::cout << "Starting tests of direct access" << std::endl;
+		const MemoryMappedFileOptions options = { .directIo = true };
+		{
+			MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> file("direct_test", options);
+			file.clear();
+			for (int i = 0; i < 1000001; i++) // The size isn't a multiple of the block size
+				file.push_back(i);
+		}
+		auto check = [] (const MemoryMappedFile<int32_t> &file, int size) {
+			for (int i = 0; i < size; i++)
+				if (file[i] != i)
+					return false;
+			return file.size() == size;
+		};
+		makeTest<bool>(true, [&] {
+			return check(MemoryMappedFile<int32_t, MemoryMappedFileUncompressed>("direct_test"), 1000001);
+		}, "Test of writing directly failed");
+		makeTest<bool>(true, [&] {
+			return check(MemoryMappedFile<int32_t, MemoryMappedFileUncompressed>("direct_test", options), 1000001);
+		}, "Test of reading directly failed");
+		{
+			MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> file("direct_test", options);
+			for (int i = 1000001; i < 3000001; i++)
+				file.push_back(i);
+		}
+		makeTest<bool>(true, [&] {
+			return check(MemoryMappedFile<int32_t, MemoryMappedFileUncompressed>("direct_test", options), 3000001);
+		}, "Test of appending directly behind an unaligned end failed");
+		{
+			MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> file("direct_test", MemoryMappedFileOptions{ .appendOnly = true, .directIo = true });
+			for (int i = 3000001; i < 3000100; i++)
+				file.push_back(i);
+		}
+		makeTest<bool>(true, [&] {
+			return check(MemoryMappedFile<int32_t, MemoryMappedFileUncompressed>("direct_test"), 3000100);
+		}, "Test of appending directly in append-only mode failed");
+		{
+			MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> file("direct_test", options);
+			file[2000000] = -1;
+		}
+		makeTest<int>(-1, [&] {
+			const MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> file("direct_test", options);
+			return file[2000000] + (file[2999999] == 2999999 && file.size() == 3000100 ? 0 : 1);
+		}, "Test of rewriting directly failed");
+		{
+			MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> file("direct_test", MemoryMappedFileOptions{ .checksums = true, .directIo = true });
+			file.clear();
+			for (int i = 0; i < 5000; i++)
+				file.push_back(i);
+		}
+		makeTest<bool>(true, [&] {
+			return check(MemoryMappedFile<int32_t, MemoryMappedFileUncompressed>("direct_test", MemoryMappedFileOptions{ .checksums = true, .directIo = true }), 5000);
+		}, "Test of checksums with direct access failed");
+		bool refused = false;
+		try {
+			MemoryMappedFile<int32_t, MemoryMappedFileUncompressed> file("direct_test", MemoryMappedFileOptions{ .preallocation = 1 << 20, .directIo = true });
+		} catch (std::logic_error&) {
+			refused = true;
+		}
+		makeTest<bool>(true, [&] { return refused; }, "Test of refusing to preallocate space for direct access failed");
+	}
+	catch(std::exception &e) {
+		std::cout << "A test failed with exception: " << e.what() << std::endl;
+		flawless = false;
+	}
+
 	if (flawless) {
 		std::cout << "All tests finished successfully." << std::endl;
 	}
@@ -207,6 +1714,6 @@ int main()
 		std::cout << "There were errors." << std::endl;
 	}
 
-	return 0;
+	return flawless ? 0 : 1;
 }
 
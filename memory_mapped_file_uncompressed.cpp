@@ -1,11 +1,29 @@
 #include "memory_mapped_file_uncompressed.hpp"
+#include "memory_mapped_file_checksum.hpp"
 #include <fstream>
 #include <iostream>
 #include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#endif
 
 constexpr float LOADED_PART_INCREMENT = 1.5;
 constexpr int LOADED_PART_MAX_INCREMENT = (1 << 15);
 constexpr int LOADED_PART_MIN_INCREMENT = (1 << 11);
+constexpr int LOADED_PART_SEQUENTIAL_INCREMENT = (1 << 21);
+constexpr int APPEND_ONLY_TAIL_LIMIT = (1 << 20);
+constexpr int DIRECT_IO_ALIGNMENT = (1 << 12);
+constexpr int DIRECT_IO_PART = (1 << 23); // Also the minimum read ahead, because the system doesn't read ahead for direct access
 
 inline std::string vec2string(const std::vector<unsigned char> &str)
 {
@@ -17,16 +35,41 @@ inline std::string vec2string(const std::vector<unsigned char> &str)
 
 void MemoryMappedFileUncompressed::reset()
 {
+	closeDescriptor();
+	stopWatching();
+	preserveAllPages();
 	data_.clear();
+	tail_.clear();
+	clearDirtyPages();
+	checksums_.clear();
+	checksumsLoaded_ = false;
+	verifiedUntil_ = 0;
 	modified_ = false;
 	appendedFrom_ = 0;
 	loadedUntil_ = 0;
 	fileSize_ = -1;
 }
 
-MemoryMappedFileUncompressed::MemoryMappedFileUncompressed(const std::string &fileName) :
-	MemoryMappedFileBase(fileName)
+MemoryMappedFileUncompressed::MemoryMappedFileUncompressed(const std::string &fileName, std::pmr::memory_resource* memory) :
+	MemoryMappedFileUncompressed(fileName, MemoryMappedFileOptions(), memory)
 {
+}
+
+MemoryMappedFileUncompressed::MemoryMappedFileUncompressed(const std::string &fileName, const MemoryMappedFileOptions &options,
+		std::pmr::memory_resource* memory) :
+	MemoryMappedFileBase(fileName, memory),
+	options_(options),
+	descriptor_(-1),
+	advice_(0), // POSIX_FADV_NORMAL
+	writingDescriptor_(-1),
+	preallocatedUntil_(0),
+	tail_(memory)
+{
+	if (options_.checksums && options_.appendOnly)
+		throw(std::logic_error("Checksums can't be kept for file " + extendedFileName(fileName) + " in append-only mode"));
+	// Direct writes pad the last block and cut the file back, which releases any space reserved behind its end
+	if (options_.directIo && options_.preallocation > 0)
+		throw(std::logic_error("Space can't be preallocated for file " + extendedFileName(fileName) + " accessed directly"));
 	reset();
 }
 
@@ -38,45 +81,109 @@ MemoryMappedFileUncompressed::~MemoryMappedFileUncompressed()
 	catch(std::exception &exception) {
 		std::cout << "Failed to flush: " << exception.what();
 	}
+	closeDescriptor();
 }
 
-int MemoryMappedFileUncompressed::size() const
+void MemoryMappedFileUncompressed::closeDescriptor() const
 {
-	if (modified_) return int(data_.size());
-	
-	if (fileSize_ >= 0) {
-		return std::max<int>(int(data_.size()), fileSize_);
+#ifndef _WIN32
+	if (descriptor_ >= 0)
+		close(descriptor_);
+	if (writingDescriptor_ >= 0)
+		close(writingDescriptor_);
+#endif
+	descriptor_ = -1;
+	writingDescriptor_ = -1;
+	preallocatedUntil_ = 0;
+}
+
+int MemoryMappedFileUncompressed::readingDescriptor() const
+{
+#ifndef _WIN32
+	if (descriptor_ < 0) {
+		descriptor_ = open(extendedFileName(fileName_).c_str(), O_RDONLY | O_CLOEXEC);
+		if (descriptor_ >= 0 && advice_ != POSIX_FADV_NORMAL)
+			posix_fadvise(descriptor_, 0, 0, advice_);
 	}
-	
+#endif
+	return descriptor_;
+}
+
+int MemoryMappedFileUncompressed::fileSizeOnDisk() const
+{
+#ifndef _WIN32
+	for (int attempt = 0; attempt < 2; attempt++) {
+		if (readingDescriptor() < 0)
+			return 0;
+		struct stat status;
+		if (fstat(descriptor_, &status) != 0)
+			return 0;
+		if (status.st_nlink > 0)
+			return int(status.st_size);
+		closeDescriptor(); // The file was deleted or replaced, open it again
+	}
+	return 0;
+#else
 	std::ifstream file(extendedFileName(fileName_), std::ifstream::ate | std::ifstream::binary);
-	fileSize_ = file.good() ? int(file.tellg()) : 0;
-	return fileSize_;
+	return file.good() ? int(file.tellg()) : 0;
+#endif
+}
+
+int MemoryMappedFileUncompressed::size() const
+{
+	if (options_.appendOnly) {
+		if (!modified_ && (fileSize_ < 0 || changedOnDisk()))
+			fileSize_ = fileSizeOnDisk();
+		return fileSize_ + int(tail_.size());
+	}
+	if (modified_) return int(data_.size());
+
+	// Appends by other processes are noticed only if this one has no appends waiting to be flushed, until then the change stays unseen
+	if (int(data_.size()) <= loadedUntil_ && (fileSize_ < 0 || changedOnDisk()))
+		fileSize_ = fileSizeOnDisk();
+	return std::max<int>(int(data_.size()), fileSize_);
 }
 
 void MemoryMappedFileUncompressed::load(int until) const
 {
+	if (options_.appendOnly)
+		throw(std::logic_error("File " + extendedFileName(fileName_) + " was opened only for appending"));
 	if (fullyLoaded() || (until >= 0 && loadedUntil_ > until)) return;
+	MemoryMappedFileStopwatch stopwatch(statistics_, MemoryMappedFileTiming::LOAD);
 	
-	const int stopAt = (until >= 0) ? std::max<int>(std::min<int>(int(until * LOADED_PART_INCREMENT), until + LOADED_PART_MAX_INCREMENT),
+	const int maxIncrement = sequential_ ? LOADED_PART_SEQUENTIAL_INCREMENT : LOADED_PART_MAX_INCREMENT;
+	int stopAt = (until >= 0) ? std::max<int>(std::min<int>(int(until * LOADED_PART_INCREMENT), until + maxIncrement),
 			until + LOADED_PART_MIN_INCREMENT) : INT_MAX;
+	if (options_.directIo && stopAt < INT_MAX)
+		stopAt = std::max<int>(stopAt, std::min<int>(loadedUntil_, INT_MAX - DIRECT_IO_PART) + DIRECT_IO_PART);
+	if (options_.checksums && stopAt < INT_MAX - (1 << PAGE_BITS))
+		stopAt = ((stopAt >> PAGE_BITS) + 1) << PAGE_BITS; // Only whole pages can be checked
 
-	std::ifstream file(extendedFileName(fileName_), std::fstream::binary);
-	file.seekg(loadedUntil_);
-	
 	auto formerLoadedUntil = loadedUntil_;
-	while (file.good() && loadedUntil_ < stopAt) {
-		const_cast<std::vector<std::uint8_t>&>(data_).push_back(uint8_t(file.get()));
-		loadedUntil_++;
-	}
-	if (loadedUntil_ != formerLoadedUntil) {
-		const_cast<std::vector<std::uint8_t>&>(data_).pop_back();  // The previous cycle reads an extra symbol, we need to remove it
-		loadedUntil_--;
-	}
-	if (!file.good()) {
-		fileSize_ = loadedUntil_;
+	if (!loadDirect(stopAt) && !loadFromDescriptor(stopAt)) {
+		std::ifstream file(extendedFileName(fileName_), std::fstream::binary);
+		file.seekg(loadedUntil_);
+
+		while (file.good() && loadedUntil_ < stopAt) {
+			reserveData(data_.size() + 1);
+			const_cast<std::pmr::vector<std::uint8_t>&>(data_).push_back(uint8_t(file.get()));
+			loadedUntil_++;
+		}
+		if (loadedUntil_ != formerLoadedUntil) {
+			const_cast<std::pmr::vector<std::uint8_t>&>(data_).pop_back();  // The previous cycle reads an extra symbol, we need to remove it
+			loadedUntil_--;
+		}
+		if (!file.good()) {
+			fileSize_ = loadedUntil_;
+		}
 	}
 	
 	if (loadedUntil_ == fileSize_) appendedFrom_ = int(data_.size());
+	verifyLoaded();
+
+	statistics_.add(MemoryMappedFileCounter::LOADS);
+	statistics_.add(MemoryMappedFileCounter::BYTES_READ, loadedUntil_ - formerLoadedUntil);
+	updateResidentBytes();
 }
 
 void MemoryMappedFileUncompressed::load(const std::string &fileName, int until)
@@ -86,59 +193,701 @@ void MemoryMappedFileUncompressed::load(const std::string &fileName, int until)
 		reset();
 		fileName_ = fileName;
 	}
-	load(until);
+	if (!options_.appendOnly)
+		load(until);
 }
 
 void MemoryMappedFileUncompressed::flush() const
 {
 	flush(fileName_);
+	modified_ = false;
 }
 
 void MemoryMappedFileUncompressed::flush(const std::string &fileName) const
 {
+	if (options_.appendOnly) {
+		// The file was cleared if modified, otherwise the tail is written behind the existing contents
+		if (!modified_ && tail_.empty())
+			return;
+		MemoryMappedFileStopwatch stopwatch(statistics_, MemoryMappedFileTiming::FLUSH);
+		// The delta is logged only after the file is written, so that the log never has changes that aren't in the file
+		const bool logged = options_.changeLog && fileName == fileName_;
+		MemoryMappedFileDelta delta;
+		if (logged) {
+			const int offset = modified_ ? 0 : fileSizeOnDisk();
+			delta.size = offset + int(tail_.size());
+			delta.ranges.push_back({ offset, std::vector<std::uint8_t>(tail_.begin(), tail_.end()) });
+		}
+		if (!writeDirect(fileName, tail_.data(), int(tail_.size()), modified_)
+				&& (modified_ || !appendPreallocated(fileName, tail_.data(), int(tail_.size())))) {
+			std::ofstream file(extendedFileName(fileName), (modified_ ? std::fstream::trunc : std::fstream::app) | std::fstream::binary);
+			if (!file.good()) throw(std::runtime_error("Could not open file " + extendedFileName(fileName)));
+			file.write(reinterpret_cast<const char*>(tail_.data()), std::streamsize(tail_.size()));
+			if (!file.good()) throw(std::runtime_error("Could not write to file " + extendedFileName(fileName)));
+			file.close();
+		}
+		if (logged)
+			MemoryMappedFileChangeLog::write(extendedFileName(fileName_), delta);
+		if (modified_)
+			preallocatedUntil_ = 0; // Truncating released the reserved space
+		statistics_.add(modified_ ? MemoryMappedFileCounter::FULL_FLUSHES : MemoryMappedFileCounter::APPEND_FLUSHES);
+		statistics_.add(MemoryMappedFileCounter::BYTES_WRITTEN, std::int64_t(tail_.size()));
+		if (fileSize_ >= 0)
+			fileSize_ += int(tail_.size());
+		tail_.clear();
+		modified_ = false;
+		acknowledgeChanges();
+		return;
+	}
+
 	// If modified, it must be fully loaded
 	auto updateSizes = [this] {
 		appendedFrom_ = int(data_.size());
 		loadedUntil_ = int(data_.size());
 		fileSize_ = int(data_.size());
+		verifiedUntil_ = (int(data_.size()) >> PAGE_BITS) << PAGE_BITS;
+		clearDirtyPages();
 	};
 	if (modified_) {
-		std::ofstream file(extendedFileName(fileName), std::fstream::trunc | std::fstream::binary);
-		if (!file.good()) throw(std::runtime_error("Could not open file " + extendedFileName(fileName)));
-		for (uint8_t byte : data_)
-			file << byte;
-		if (!file.good()) throw(std::runtime_error("Could not write to file " + extendedFileName(fileName)));
+		MemoryMappedFileStopwatch stopwatch(statistics_, MemoryMappedFileTiming::FLUSH);
+		const bool logged = options_.changeLog && fileName == fileName_;
+		// Unless it was cleared or shrunk, only the modified pages and the appended part are written into the file, in place
+		const bool inPlace = fileName == fileName_ && !options_.directIo && fileSize_ >= 0 && fileSize_ == appendedFrom_
+				&& int(data_.size()) >= appendedFrom_;
+		MemoryMappedFileDelta delta;
+		if (logged || inPlace)
+			delta = collectChanges(std::max(fileSize_, 0)); // Everything behind the previous size was appended, it's zero if cleared
+		std::int64_t written = std::int64_t(data_.size());
+		if (inPlace)
+			written = writeRanges(fileName, delta);
+		else if (!writeDirect(fileName, data_.data(), int(data_.size()), true)) {
+			std::ofstream file(extendedFileName(fileName), std::fstream::trunc | std::fstream::binary);
+			if (!file.good()) throw(std::runtime_error("Could not open file " + extendedFileName(fileName)));
+			for (uint8_t byte : data_)
+				file << byte;
+			if (!file.good()) throw(std::runtime_error("Could not write to file " + extendedFileName(fileName)));
+			file.close();
+		}
+		preallocatedUntil_ = 0; // Truncating released the reserved space
+		if (options_.checksums)
+			writeChecksums(fileName, true);
+		if (logged)
+			MemoryMappedFileChangeLog::write(extendedFileName(fileName_), delta);
+		statistics_.add(MemoryMappedFileCounter::FULL_FLUSHES);
+		statistics_.add(MemoryMappedFileCounter::BYTES_WRITTEN, written);
 		updateSizes();
+		updateResidentBytes();
+		acknowledgeChanges();
 	}
 	else if (loadedUntil_ == fileSize_ && appendedFrom_ < int(data_.size())) {
-		std::ofstream file(extendedFileName(fileName), std::fstream::app | std::fstream::ate | std::fstream::binary);
-		if (!file.good()) throw(std::runtime_error("Could not open file " + extendedFileName(fileName)));
-		for (unsigned int i = static_cast<unsigned int>(appendedFrom_); i < data_.size(); i++)
-			file << data_[i];
-		if (!file.good()) throw(std::runtime_error("Could not write to file " + extendedFileName(fileName)));
+		MemoryMappedFileStopwatch stopwatch(statistics_, MemoryMappedFileTiming::FLUSH);
+		// If another process appended meanwhile, these bytes end up behind its bytes, the notification may not have been seen yet
+		const int sizeOnDisk = (fileName == fileName_) ? fileSizeOnDisk() : fileSize_;
+		const bool appendedElsewhere = sizeOnDisk != fileSize_;
+		const bool logged = options_.changeLog && fileName == fileName_;
+		MemoryMappedFileDelta delta;
+		if (logged) {
+			delta = collectChanges(appendedFrom_);
+			delta.size += sizeOnDisk - appendedFrom_;
+			delta.ranges.back().offset = sizeOnDisk;
+		}
+		if (!writeDirect(fileName, data_.data() + appendedFrom_, int(data_.size()) - appendedFrom_, false)
+				&& !appendPreallocated(fileName, data_.data() + appendedFrom_, int(data_.size()) - appendedFrom_)) {
+			std::ofstream file(extendedFileName(fileName), std::fstream::app | std::fstream::ate | std::fstream::binary);
+			if (!file.good()) throw(std::runtime_error("Could not open file " + extendedFileName(fileName)));
+			for (unsigned int i = static_cast<unsigned int>(appendedFrom_); i < data_.size(); i++)
+				file << data_[i];
+			if (!file.good()) throw(std::runtime_error("Could not write to file " + extendedFileName(fileName)));
+			file.close();
+		}
+		if (options_.checksums)
+			writeChecksums(fileName, false);
+		if (logged)
+			MemoryMappedFileChangeLog::write(extendedFileName(fileName_), delta);
+		statistics_.add(MemoryMappedFileCounter::APPEND_FLUSHES);
+		statistics_.add(MemoryMappedFileCounter::BYTES_WRITTEN, std::int64_t(data_.size()) - appendedFrom_);
 		updateSizes();
+		if (appendedElsewhere) {
+			// The contents on disk are ordered differently, so they are read again
+			preserveAllPages();
+			const_cast<std::pmr::vector<std::uint8_t>&>(data_).clear();
+			appendedFrom_ = 0;
+			loadedUntil_ = 0;
+			fileSize_ = -1;
+			verifiedUntil_ = 0;
+		}
+		updateResidentBytes();
+		acknowledgeChanges();
 	} // else don't need to save
 }
 
+bool MemoryMappedFileUncompressed::appendPreallocated(const std::string &fileName, const std::uint8_t* added, int size) const
+{
+#ifdef __linux__
+	if (options_.preallocation <= 0 || fileName != fileName_)
+		return false;
+	if (writingDescriptor_ < 0) {
+		writingDescriptor_ = open(extendedFileName(fileName_).c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+		if (writingDescriptor_ < 0)
+			throw(std::runtime_error("Could not open file " + extendedFileName(fileName_)));
+	}
+	struct stat status;
+	if (fstat(writingDescriptor_, &status) != 0)
+		throw(std::runtime_error("Could not open file " + extendedFileName(fileName_)));
+	// The reserved space doesn't change the size, so readers don't see it and writes behind the end fill it
+	const std::int64_t end = std::int64_t(status.st_size) + size;
+	if (end > preallocatedUntil_) {
+		const std::int64_t increment = options_.preallocation;
+		const std::int64_t reserveUntil = (end + increment - 1) / increment * increment;
+		if (fallocate(writingDescriptor_, FALLOC_FL_KEEP_SIZE, off_t(status.st_size), off_t(reserveUntil - status.st_size)) == 0)
+			statistics_.add(MemoryMappedFileCounter::PREALLOCATIONS);
+		preallocatedUntil_ = reserveUntil; // If the filesystem can't do it, it's not tried again until then
+	}
+	for (int done = 0; done < size; ) {
+		const ssize_t written = write(writingDescriptor_, added + done, std::size_t(size - done));
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			throw(std::runtime_error("Could not write to file " + extendedFileName(fileName_)));
+		done += int(written);
+	}
+	return true;
+#else
+	(void)fileName;
+	(void)added;
+	(void)size;
+	return false;
+#endif
+}
+
+int MemoryMappedFileUncompressed::openDirect(const std::string &fileName, int flags, bool &direct) const
+{
+#ifdef __linux__
+	int descriptor = open(extendedFileName(fileName).c_str(), flags | O_DIRECT | O_CLOEXEC, 0644);
+	direct = descriptor >= 0;
+	if (descriptor < 0 && errno == EINVAL)
+		descriptor = open(extendedFileName(fileName).c_str(), flags | O_CLOEXEC, 0644); // The filesystem can't access it directly
+	return descriptor;
+#else
+	(void)fileName;
+	(void)flags;
+	direct = false;
+	return -1;
+#endif
+}
+
+bool MemoryMappedFileUncompressed::loadDirect(int stopAt) const
+{
+#ifdef __linux__
+	if (!options_.directIo)
+		return false;
+	bool direct = false;
+	const int descriptor = openDirect(fileName_, O_RDONLY, direct);
+	if (descriptor < 0) {
+		fileSize_ = loadedUntil_;
+		return true;
+	}
+	std::unique_ptr<std::uint8_t, decltype(&std::free)> buffer(static_cast<std::uint8_t*>(std::aligned_alloc(DIRECT_IO_ALIGNMENT, DIRECT_IO_PART)),
+			&std::free);
+	if (!buffer) {
+		close(descriptor);
+		throw(std::bad_alloc());
+	}
+	const std::int64_t firstRead = loadedUntil_ / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+	while (loadedUntil_ < stopAt) {
+		// Reading starts at the block containing the first byte that isn't loaded and ends behind a whole block
+		const std::int64_t offset = loadedUntil_ / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+		const int skipped = int(loadedUntil_ - offset);
+		const std::int64_t wanted = (std::int64_t(stopAt) - offset + DIRECT_IO_ALIGNMENT - 1) / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+		const std::size_t length = std::size_t(std::min<std::int64_t>(wanted, DIRECT_IO_PART));
+		ssize_t obtained = 0;
+		do {
+			obtained = pread(descriptor, buffer.get(), length, off_t(offset));
+		} while (obtained < 0 && errno == EINTR);
+		if (obtained < 0) {
+			close(descriptor);
+			throw(std::runtime_error("Could not read file " + extendedFileName(fileName_)));
+		}
+		const int usable = std::min<int>(int(obtained) - skipped, stopAt - loadedUntil_);
+		if (usable > 0) {
+			reserveData(data_.size() + std::size_t(usable));
+			const_cast<std::pmr::vector<std::uint8_t>&>(data_).insert(data_.end(), buffer.get() + skipped, buffer.get() + skipped + usable);
+			loadedUntil_ += usable;
+		}
+		if (std::size_t(obtained) < length) {
+			fileSize_ = int(offset + obtained);
+			break;
+		}
+	}
+	if (!direct)
+		posix_fadvise(descriptor, off_t(firstRead), off_t(loadedUntil_ - firstRead), POSIX_FADV_DONTNEED);
+	close(descriptor);
+	return true;
+#else
+	(void)stopAt;
+	return false;
+#endif
+}
+
+bool MemoryMappedFileUncompressed::loadFromDescriptor(int stopAt) const
+{
+#ifndef _WIN32
+	// The descriptor is opened again if the file was replaced
+	const int sizeOnDisk = fileSizeOnDisk();
+	if (descriptor_ < 0) {
+		fileSize_ = loadedUntil_;
+		return true;
+	}
+	std::pmr::vector<std::uint8_t> &data = const_cast<std::pmr::vector<std::uint8_t>&>(data_);
+	const int until = std::min(stopAt, sizeOnDisk);
+	if (until > loadedUntil_) {
+		reserveData(data.size() + std::size_t(until - loadedUntil_));
+		const std::size_t start = data.size();
+		data.resize(start + std::size_t(until - loadedUntil_));
+		int done = 0;
+		while (loadedUntil_ + done < until) {
+			const ssize_t obtained = pread(descriptor_, data.data() + start + done, std::size_t(until - loadedUntil_ - done), off_t(loadedUntil_ + done));
+			if (obtained < 0 && errno == EINTR)
+				continue;
+			if (obtained < 0) {
+				data.resize(start + std::size_t(done));
+				loadedUntil_ += done;
+				throw(std::runtime_error("Could not read file " + extendedFileName(fileName_)));
+			}
+			if (obtained == 0)
+				break; // It was shrunk meanwhile
+			done += int(obtained);
+		}
+		data.resize(start + std::size_t(done));
+		loadedUntil_ += done;
+	}
+	if (loadedUntil_ < stopAt)
+		fileSize_ = loadedUntil_;
+	return true;
+#else
+	(void)stopAt;
+	return false;
+#endif
+}
+
+bool MemoryMappedFileUncompressed::writeDirect(const std::string &fileName, const std::uint8_t* written, int size, bool rewrite) const
+{
+#ifdef __linux__
+	if (!options_.directIo)
+		return false;
+	bool direct = false;
+	const int descriptor = openDirect(fileName, O_RDWR | O_CREAT | (rewrite ? O_TRUNC : 0), direct);
+	if (descriptor < 0)
+		throw(std::runtime_error("Could not open file " + extendedFileName(fileName)));
+	try {
+		std::unique_ptr<std::uint8_t, decltype(&std::free)> buffer(static_cast<std::uint8_t*>(std::aligned_alloc(DIRECT_IO_ALIGNMENT, DIRECT_IO_PART)),
+				&std::free);
+		if (!buffer)
+			throw(std::bad_alloc());
+		struct stat status;
+		if (fstat(descriptor, &status) != 0)
+			throw(std::runtime_error("Could not open file " + extendedFileName(fileName)));
+		const std::int64_t end = std::int64_t(status.st_size) + size;
+		std::int64_t offset = status.st_size / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+		int filled = int(status.st_size - offset);
+		if (filled > 0) {
+			// Only whole blocks can be written, so the block being appended to is read first
+			ssize_t obtained = 0;
+			do {
+				obtained = pread(descriptor, buffer.get(), DIRECT_IO_ALIGNMENT, off_t(offset));
+			} while (obtained < 0 && errno == EINTR);
+			if (obtained < filled)
+				throw(std::runtime_error("Could not read file " + extendedFileName(fileName)));
+		}
+		int done = 0;
+		do {
+			const int part = std::min(size - done, DIRECT_IO_PART - filled);
+			std::copy_n(written + done, part, buffer.get() + filled);
+			filled += part;
+			done += part;
+			// The unaligned end is padded to a whole block and cut off by resizing the file afterwards
+			const int padded = (filled + DIRECT_IO_ALIGNMENT - 1) / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+			std::fill(buffer.get() + filled, buffer.get() + padded, 0);
+			for (int writtenPart = 0; writtenPart < padded; ) {
+				const ssize_t result = pwrite(descriptor, buffer.get() + writtenPart, std::size_t(padded - writtenPart), off_t(offset + writtenPart));
+				if (result < 0 && errno == EINTR)
+					continue;
+				if (result <= 0)
+					throw(std::runtime_error("Could not write to file " + extendedFileName(fileName)));
+				writtenPart += int(result);
+			}
+			offset += filled;
+			filled = 0;
+		} while (done < size);
+		if (ftruncate(descriptor, off_t(end)) != 0)
+			throw(std::runtime_error("Could not resize file " + extendedFileName(fileName)));
+		if (!direct && fdatasync(descriptor) == 0)
+			posix_fadvise(descriptor, 0, 0, POSIX_FADV_DONTNEED); // Written pages can be dropped only after they're on disk
+	} catch (...) {
+		close(descriptor);
+		throw;
+	}
+	close(descriptor);
+	return true;
+#else
+	(void)fileName;
+	(void)written;
+	(void)size;
+	(void)rewrite;
+	return false;
+#endif
+}
+
+MemoryMappedFileDelta MemoryMappedFileUncompressed::collectChanges(int changedFrom) const
+{
+	// Modified pages are stored only before the appended part, which is stored whole
+	MemoryMappedFileDelta delta;
+	delta.size = int(data_.size());
+	changedFrom = std::min(changedFrom, delta.size);
+	const int pages = ((changedFrom - 1) >> PAGE_BITS) + 1;
+	for (int page = 0; page < pages; page++) {
+		if (!isDirty(page))
+			continue;
+		const int begin = page << PAGE_BITS;
+		while (page + 1 < pages && isDirty(page + 1))
+			page++;
+		const int end = std::min((page + 1) << PAGE_BITS, changedFrom);
+		delta.ranges.push_back({ begin, std::vector<std::uint8_t>(data_.begin() + begin, data_.begin() + end) });
+	}
+	if (changedFrom < delta.size)
+		delta.ranges.push_back({ changedFrom, std::vector<std::uint8_t>(data_.begin() + changedFrom, data_.end()) });
+	return delta;
+}
+
+std::int64_t MemoryMappedFileUncompressed::writeRanges(const std::string &fileName, const MemoryMappedFileDelta &delta) const
+{
+	std::int64_t written = 0;
+#ifndef _WIN32
+	const int descriptor = open(extendedFileName(fileName).c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+	if (descriptor < 0) throw(std::runtime_error("Could not open file " + extendedFileName(fileName)));
+	try {
+		for (const MemoryMappedFileDelta::Range &range : delta.ranges) {
+			for (std::size_t done = 0; done < range.bytes.size(); ) {
+				const ssize_t part = pwrite(descriptor, range.bytes.data() + done, range.bytes.size() - done, off_t(range.offset) + off_t(done));
+				if (part < 0 && errno == EINTR)
+					continue;
+				if (part <= 0)
+					throw(std::runtime_error("Could not write to file " + extendedFileName(fileName)));
+				done += std::size_t(part);
+			}
+			written += std::int64_t(range.bytes.size());
+		}
+		if (ftruncate(descriptor, off_t(delta.size)) != 0)
+			throw(std::runtime_error("Could not resize file " + extendedFileName(fileName)));
+	} catch (...) {
+		close(descriptor);
+		throw;
+	}
+	close(descriptor);
+#else
+	{
+		std::fstream file(extendedFileName(fileName), std::fstream::in | std::fstream::out | std::fstream::binary);
+		if (!file.good())
+			file.open(extendedFileName(fileName), std::fstream::out | std::fstream::binary);
+		if (!file.good()) throw(std::runtime_error("Could not open file " + extendedFileName(fileName)));
+		for (const MemoryMappedFileDelta::Range &range : delta.ranges) {
+			file.seekp(range.offset);
+			file.write(reinterpret_cast<const char*>(range.bytes.data()), std::streamsize(range.bytes.size()));
+			written += std::int64_t(range.bytes.size());
+		}
+		if (!file.good()) throw(std::runtime_error("Could not write to file " + extendedFileName(fileName)));
+	}
+	std::filesystem::resize_file(extendedFileName(fileName), std::uintmax_t(delta.size));
+#endif
+	return written;
+}
+
+void MemoryMappedFileUncompressed::apply(const MemoryMappedFileDelta &delta)
+{
+	if (options_.appendOnly || options_.checksums)
+		throw(std::logic_error("Deltas can't be applied to file " + extendedFileName(fileName_) + " in append-only mode or with checksums"));
+	flush();
+	MemoryMappedFileStopwatch stopwatch(statistics_, MemoryMappedFileTiming::FLUSH);
+	const std::int64_t written = writeRanges(fileName_, delta);
+
+	// The loaded part is updated, so that it stays the same as the beginning of the file
+	preserveAllPages();
+	if (int(data_.size()) > delta.size)
+		data_.resize(std::size_t(delta.size));
+	for (const MemoryMappedFileDelta::Range &range : delta.ranges) {
+		const int end = std::min(range.offset + int(range.bytes.size()), int(data_.size()));
+		if (range.offset < end)
+			std::copy_n(range.bytes.begin(), end - range.offset, data_.begin() + range.offset);
+	}
+	loadedUntil_ = int(data_.size());
+	fileSize_ = delta.size;
+	appendedFrom_ = int(data_.size());
+	verifiedUntil_ = 0;
+	statistics_.add(MemoryMappedFileCounter::BYTES_WRITTEN, written);
+	updateResidentBytes();
+	acknowledgeChanges();
+}
+
 void MemoryMappedFileUncompressed::append(const std::vector<std::uint8_t>& added)
 {
+	if (options_.appendOnly) {
+		appendToTail(added.data(), int(added.size()));
+		return;
+	}
 	load();
+	reserveData(data_.size() + added.size());
 	data_.insert(data_.end(), added.begin(), added.end());
 }
 
 void MemoryMappedFileUncompressed::append(const std::uint8_t *added, int size)
 {
+	if (options_.appendOnly) {
+		appendToTail(added, size);
+		return;
+	}
 	load();
-	for (int i = 0; i < size; i++)
-		data_.push_back(added[i]);
+	reserveData(data_.size() + size);
+	data_.insert(data_.end(), added, added + size);
 }
 
 void MemoryMappedFileUncompressed::push_back(std::uint8_t added)
 {
+	if (options_.appendOnly) {
+		appendToTail(&added, 1);
+		return;
+	}
 	load();
+	reserveData(data_.size() + 1);
 	data_.push_back(added);
 }
 
+void MemoryMappedFileUncompressed::clear()
+{
+	tail_.clear();
+	MemoryMappedFileBase::clear();
+}
+
+void MemoryMappedFileUncompressed::appendToTail(const std::uint8_t* added, int size)
+{
+	tail_.insert(tail_.end(), added, added + size);
+	if (int(tail_.size()) >= APPEND_ONLY_TAIL_LIMIT)
+		flush(); // Keeps the memory bounded
+}
+
+std::string MemoryMappedFileUncompressed::checksumFileName(const std::string &fileName) const
+{
+	return extendedFileName(fileName) + ".crc";
+}
+
+void MemoryMappedFileUncompressed::loadChecksums() const
+{
+	std::vector<std::uint32_t> loaded;
+	std::ifstream file(checksumFileName(fileName_), std::ifstream::binary | std::ifstream::ate);
+	if (file.good()) {
+		loaded.resize(std::size_t(file.tellg()) / sizeof(std::uint32_t));
+		file.seekg(0);
+		file.read(reinterpret_cast<char*>(loaded.data()), std::streamsize(loaded.size() * sizeof(std::uint32_t)));
+	}
+	// Pages without stored checksums that were already checked keep the computed ones
+	const std::size_t verifiedPages = std::size_t(verifiedUntil_ >> PAGE_BITS);
+	for (std::size_t page = loaded.size(); page < verifiedPages && page < checksums_.size(); page++)
+		loaded.push_back(checksums_[page]);
+	checksums_.swap(loaded);
+	checksumsLoaded_ = true;
+}
+
+void MemoryMappedFileUncompressed::verifyLoaded() const
+{
+	if (!options_.checksums) return;
+	if (!checksumsLoaded_) loadChecksums();
+
+	constexpr int pageSize = 1 << PAGE_BITS;
+	const bool reachedEnd = (fileSize_ >= 0 && loadedUntil_ >= fileSize_);
+	while (verifiedUntil_ < loadedUntil_) {
+		const int end = std::min(verifiedUntil_ + pageSize, loadedUntil_);
+		const bool complete = (end - verifiedUntil_ == pageSize);
+		if (!complete && !reachedEnd)
+			break; // Checked when the rest of the page is loaded
+		const std::size_t page = std::size_t(verifiedUntil_ >> PAGE_BITS);
+		const std::uint32_t computed = crc32c(data_.data() + verifiedUntil_, std::size_t(end - verifiedUntil_));
+		if (page < checksums_.size() && checksums_[page] != computed) {
+			loadChecksums(); // Another process may have written into the file
+			if (page < checksums_.size() && checksums_[page] != computed) {
+				preserveAllPages();
+				const_cast<std::pmr::vector<std::uint8_t>&>(data_).resize(std::size_t(verifiedUntil_));
+				loadedUntil_ = verifiedUntil_;
+				fileSize_ = -1;
+				throw(std::runtime_error("Page " + std::to_string(page) + " of file " + extendedFileName(fileName_) + " is damaged"));
+			}
+		}
+		if (page >= checksums_.size())
+			checksums_.resize(page + 1); // No checksum was stored, the file was probably written without them
+		checksums_[page] = computed;
+		if (!complete)
+			break; // The last page may grow, so it's checked again
+		verifiedUntil_ = end;
+	}
+}
+
+void MemoryMappedFileUncompressed::writeChecksums(const std::string &fileName, bool rewrite) const
+{
+	// Pages that weren't modified were checked when loading, so their checksums are known
+	constexpr int pageSize = 1 << PAGE_BITS;
+	const int size = int(data_.size());
+	const std::size_t pages = std::size_t((size + pageSize - 1) >> PAGE_BITS);
+	const std::size_t firstAppended = std::size_t(appendedFrom_ >> PAGE_BITS);
+	const std::size_t known = std::min(checksums_.size(), pages);
+	checksums_.resize(pages);
+	for (std::size_t page = 0; page < pages; page++) {
+		if (page >= known || page >= firstAppended || isDirty(int(page))) {
+			const int from = int(page << PAGE_BITS);
+			checksums_[page] = crc32c(data_.data() + from, std::size_t(std::min(from + pageSize, size) - from));
+		}
+	}
+	checksumsLoaded_ = true;
+
+	const std::string name = checksumFileName(fileName);
+	std::fstream file(name, std::fstream::in | std::fstream::out | std::fstream::binary);
+	std::size_t from = std::min(firstAppended, pages);
+	if (rewrite || !file.good()) {
+		file = std::fstream(name, std::fstream::out | std::fstream::trunc | std::fstream::binary);
+		from = 0;
+	}
+	file.seekp(std::streamoff(from * sizeof(std::uint32_t)));
+	file.write(reinterpret_cast<const char*>(checksums_.data() + from), std::streamsize((pages - from) * sizeof(std::uint32_t)));
+	if (!file.good()) throw(std::runtime_error("Could not write to file " + name));
+}
+
+void MemoryMappedFileUncompressed::prefetch(int from, int size) const
+{
+	// Everything between the loaded part and the requested part will be read too
+	const int until = from + size;
+	if (size <= 0 || fullyLoaded() || until <= loadedUntil_ || options_.directIo)
+		return;
+#ifndef _WIN32
+	if (readingDescriptor() >= 0)
+		posix_fadvise(descriptor_, loadedUntil_, until - loadedUntil_, POSIX_FADV_WILLNEED);
+#endif
+}
+
+void MemoryMappedFileUncompressed::read(int from, int size, std::uint8_t* into) const
+{
+#ifndef _WIN32
+	// Bytes that aren't loaded can't have been modified, so they're the same as on disk, unless the contents were replaced or cleared
+	if (!options_.checksums && !options_.appendOnly && !options_.directIo && !modified_ && from >= 0 && size > 0
+			&& std::size_t(from) + std::size_t(size) > data_.size() && readingDescriptor() >= 0) {
+		if (fileSize_ < 0)
+			this->size();
+		if (std::int64_t(from) + size > std::max<int>(int(data_.size()), fileSize_))
+			throw(std::logic_error("Reading behind the end of an archive"));
+		int done = std::clamp<int>(int(data_.size()) - from, 0, size);
+		if (done > 0)
+			std::copy_n(data_.begin() + from, done, into);
+		while (done < size) {
+			const ssize_t obtained = pread(descriptor_, into + done, std::size_t(size - done), off_t(from) + done);
+			if (obtained < 0 && errno == EINTR)
+				continue;
+			if (obtained <= 0)
+				break;
+			done += int(obtained);
+		}
+		statistics_.add(MemoryMappedFileCounter::BYTES_READ, done);
+		if (done < size)
+			throw(std::logic_error("Reading behind the end of an archive"));
+		return;
+	}
+#endif
+	MemoryMappedFileBase::read(from, size, into);
+}
+
+void MemoryMappedFileUncompressed::send(int descriptor, int from, int size) const
+{
+#ifdef __linux__
+	if (!options_.checksums && from >= 0 && size > 0) {
+		if (std::int64_t(from) + size > this->size())
+			throw(std::logic_error("Reading behind the end of an archive"));
+		// The sent part of the file on disk must be the same as the contents in memory, other changes can wait
+		if (options_.appendOnly ? modified_ || (!tail_.empty() && from + size > fileSize_) : sendsChanges(from, size))
+			flush();
+		int sent = 0;
+		if (readingDescriptor() >= 0) {
+			off_t offset = from;
+			while (sent < size) {
+				const ssize_t done = sendfile(descriptor, descriptor_, &offset, std::size_t(size - sent));
+				if (done < 0 && errno == EINTR)
+					continue;
+				if (done < 0 && (errno == EINVAL || errno == ENOSYS) && sent == 0)
+					break; // The descriptor doesn't support it
+				if (done < 0)
+					throw(std::runtime_error("Could not write into descriptor " + std::to_string(descriptor)));
+				if (done == 0)
+					throw(std::logic_error("Reading behind the end of an archive"));
+				sent += int(done);
+			}
+			statistics_.add(MemoryMappedFileCounter::BYTES_READ, sent);
+		}
+		if (sent == size)
+			return;
+	}
+#endif
+	MemoryMappedFileBase::send(descriptor, from, size);
+}
+
+bool MemoryMappedFileUncompressed::sendsChanges(int from, int size) const
+{
+	if (appendedFrom_ < int(data_.size()) && from + size > appendedFrom_)
+		return true;
+	if (!modified_)
+		return false;
+	// If cleared or shrunk, the contents don't match the file even where they weren't modified
+	if (fileSize_ != appendedFrom_ || int(data_.size()) < appendedFrom_)
+		return true;
+	for (int page = from >> PAGE_BITS; page << PAGE_BITS < from + size; page++) {
+		if (isDirty(page))
+			return true;
+	}
+	return false;
+}
+
+void MemoryMappedFileUncompressed::prepareConcurrentReading() const
+{
+	if (options_.checksums || options_.directIo || modified_ || readingDescriptor() < 0)
+		load(); // read() falls back to the loaded contents
+	else
+		size(); // read() checks the size without updating it
+}
+
+void MemoryMappedFileUncompressed::adviseSequential() const
+{
+	MemoryMappedFileBase::adviseSequential();
+#ifndef _WIN32
+	advice_ = POSIX_FADV_SEQUENTIAL;
+	if (descriptor_ >= 0)
+		posix_fadvise(descriptor_, 0, 0, advice_);
+#endif
+}
+
+void MemoryMappedFileUncompressed::adviseRandom() const
+{
+	MemoryMappedFileBase::adviseRandom();
+#ifndef _WIN32
+	advice_ = POSIX_FADV_RANDOM;
+	if (descriptor_ >= 0)
+		posix_fadvise(descriptor_, 0, 0, advice_);
+#endif
+}
+
+void MemoryMappedFileUncompressed::dropCache(int from, int size) const
+{
+#ifndef _WIN32
+	if (size > 0 && readingDescriptor() >= 0)
+		posix_fadvise(descriptor_, from, size, POSIX_FADV_DONTNEED);
+#else
+	(void)from;
+	(void)size;
+#endif
+}
+
 const std::string &MemoryMappedFileUncompressed::standardExtension()
 {
 	static std::string retval = "dat";
@@ -18,23 +18,62 @@
 #include <vector>
 #include <cstdint>
 #include "memory_mapped_file_base.hpp"
+#include "memory_mapped_file_change_log.hpp"
 
-class MemoryMappedFileUncompressed : public MemoryMappedFileBase {
+class MemoryMappedFileUncompressed final : public MemoryMappedFileBase {
+	MemoryMappedFileOptions options_;
 	mutable int appendedFrom_;
+	mutable int descriptor_; // Used for loading and reading, so that it's the one given the access advice
+	mutable int advice_; // Access advice given to the system, given again when the file is opened again
+	mutable int writingDescriptor_; // Kept open for appending with preallocation
+	mutable std::int64_t preallocatedUntil_;
+	mutable std::vector<std::uint32_t> checksums_;
+	mutable bool checksumsLoaded_;
+	mutable int verifiedUntil_;
+	mutable std::pmr::vector<std::uint8_t> tail_; // Bytes appended in append-only mode that weren't flushed yet
 	virtual std::string fileNameExtension() const override
 	{
 		return ".dat";
 	}
 
 	void reset();
+	int readingDescriptor() const;
+	int fileSizeOnDisk() const;
+	void closeDescriptor() const;
+	std::string checksumFileName(const std::string &fileName) const;
+	void loadChecksums() const;
+	void verifyLoaded() const;
+	void writeChecksums(const std::string &fileName, bool rewrite) const;
+	void appendToTail(const std::uint8_t* added, int size);
+	MemoryMappedFileDelta collectChanges(int changedFrom) const;
+	std::int64_t writeRanges(const std::string &fileName, const MemoryMappedFileDelta &delta) const;
+	bool sendsChanges(int from, int size) const;
+	bool appendPreallocated(const std::string &fileName, const std::uint8_t* added, int size) const;
+	int openDirect(const std::string &fileName, int flags, bool &direct) const;
+	bool loadDirect(int stopAt) const;
+	bool loadFromDescriptor(int stopAt) const;
+	bool writeDirect(const std::string &fileName, const std::uint8_t* written, int size, bool rewrite) const;
 
 public:
 	/*!
 	* \brief Constructor: loads file if exists, or starts holding an empty string
 	*
 	* \param Name of the file, without suffix
+	* \param Memory resource to allocate the contents from
 	*/
-	MemoryMappedFileUncompressed(const std::string &fileName);
+	MemoryMappedFileUncompressed(const std::string &fileName, std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+
+	/*!
+	* \brief Constructor: loads file if exists, or starts holding an empty string
+	*
+	* \param Name of the file, without suffix
+	* \param Additional features
+	* \param Memory resource to allocate the contents from
+	* \note With checksums, pages are checked as they are loaded and std::runtime_error is thrown if any is damaged
+	* \note In append-only mode, the file can be only appended to, cleared and its size can be checked, accessing the contents throws std::logic_error
+	*/
+	MemoryMappedFileUncompressed(const std::string &fileName, const MemoryMappedFileOptions &options,
+			std::pmr::memory_resource* memory = std::pmr::get_default_resource());
 
 	/*!
 	* \brief Destructor, flushes changes
@@ -45,6 +84,7 @@ public:
 	* \brief Gets size of the data
 	*
 	* \return Size of the data
+	* \note The size on disk is obtained through a file descriptor that stays open and it's checked again only if another process has written into it
 	*/
 	virtual int size() const override;
 
@@ -75,6 +115,69 @@ public:
 	*/
 	virtual void flush(const std::string &fileName) const override;
 
+	/*!
+	* \brief Asks the system to read the bytes from disk in the background, so that loading them doesn't wait for the disk
+	*
+	* \param Index of the first byte that will be needed
+	* \param Number of bytes that will be needed
+	* \note Does nothing with direct access, which reads large parts at once instead
+	*/
+	virtual void prefetch(int from, int size) const override;
+
+	/*!
+	* \brief Loads the file in larger parts and lets the system read further ahead
+	*/
+	virtual void adviseSequential() const override;
+
+	/*!
+	* \brief Stops the system from reading ahead
+	*/
+	virtual void adviseRandom() const override;
+
+	/*!
+	* \brief Lets the system drop the bytes from its page cache
+	*
+	* \param Index of the first byte that won't be needed
+	* \param Number of bytes that won't be needed
+	*/
+	virtual void dropCache(int from, int size) const override;
+
+	/*!
+	* \brief Copies bytes, those that aren't loaded are read directly from the file without loading the bytes before them
+	*
+	* \param Index of the first byte
+	* \param Number of bytes
+	* \param Where to copy them
+	* \note With checksums or direct access, the bytes are loaded
+	*/
+	virtual void read(int from, int size, std::uint8_t* into) const override;
+
+	/*!
+	* \brief Writes bytes into a file descriptor, like a socket or a pipe, on Linux the kernel copies them directly from the file
+	*
+	* \param The descriptor, it must be blocking
+	* \param Index of the first byte
+	* \param Number of bytes
+	* \note Changes that weren't flushed are flushed first if the sent bytes might be affected by them
+	* \note With checksums, the bytes are loaded to be checked
+	*/
+	virtual void send(int descriptor, int from, int size) const override;
+
+	/*!
+	* \brief Applies a delta from the change log of another file, writing only the changed bytes into the file and the loaded contents
+	*
+	* \param The delta, deltas must be applied in the order of their sequence numbers
+	* \note Changes that weren't flushed are flushed first, throws std::logic_error in append-only mode or with checksums
+	*/
+	void apply(const MemoryMappedFileDelta &delta);
+
+	/*!
+	* \brief Makes read() safe to call from multiple threads at once, until the file is modified or loaded again
+	*
+	* \note Only opens the file for reading, unless checksums have to be checked or it's accessed directly
+	*/
+	virtual void prepareConcurrentReading() const override;
+
 	/*!
 	* \brief Appends data at the end of the file
 	*
@@ -100,6 +203,11 @@ public:
 	*/
 	virtual void push_back(std::uint8_t added) override;
 
+	/*!
+	* \brief Clears the contents
+	*/
+	virtual void clear() override;
+
 	/*!
 	* \brief Returns the extension typical for this type of archive
 	*
@@ -0,0 +1,167 @@
+#include "memory_mapped_file_watcher.hpp"
+#include <chrono>
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+MemoryMappedFileWatcher::MemoryMappedFileWatcher() :
+	descriptor_(-1),
+	stopDescriptors_{ -1, -1 }
+{
+#ifdef __linux__
+	descriptor_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (descriptor_ >= 0 && pipe2(stopDescriptors_, O_CLOEXEC) != 0) {
+		close(descriptor_);
+		descriptor_ = -1;
+	}
+#endif
+}
+
+MemoryMappedFileWatcher::~MemoryMappedFileWatcher()
+{
+#ifdef __linux__
+	if (reading_.joinable()) {
+		const char stop = 0;
+		while (write(stopDescriptors_[1], &stop, 1) < 0 && errno == EINTR) {}
+		reading_.join();
+	}
+	if (descriptor_ >= 0) {
+		close(descriptor_);
+		close(stopDescriptors_[0]);
+		close(stopDescriptors_[1]);
+	}
+#endif
+}
+
+MemoryMappedFileWatcher &MemoryMappedFileWatcher::instance()
+{
+	static MemoryMappedFileWatcher retval;
+	return retval;
+}
+
+void MemoryMappedFileWatcher::drain()
+{
+#ifdef __linux__
+	alignas(inotify_event) char buffer[4096];
+	bool counted = false;
+	while (true) {
+		const ssize_t length = read(descriptor_, buffer, sizeof(buffer));
+		if (length <= 0) break;
+		for (ssize_t position = 0; position < length; ) {
+			const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + position);
+			auto found = watches_.find(event->wd);
+			if (found != watches_.end()) {
+				found->second.changes.fetch_add(1, std::memory_order_relaxed);
+				counted = true;
+			}
+			position += sizeof(inotify_event) + event->len;
+		}
+	}
+	if (counted)
+		changed_.notify_all();
+#endif
+}
+
+void MemoryMappedFileWatcher::readEvents()
+{
+#ifdef __linux__
+	while (true) {
+		pollfd waiting[2] = { { descriptor_, POLLIN, 0 }, { stopDescriptors_[0], POLLIN, 0 } };
+		if (poll(waiting, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+		if (waiting[1].revents != 0)
+			return;
+		if (waiting[0].revents != 0) {
+			std::lock_guard<std::mutex> lock(mutex_);
+			drain();
+		}
+	}
+#endif
+}
+
+int MemoryMappedFileWatcher::watch(const std::string &path)
+{
+#ifdef __linux__
+	if (descriptor_ < 0) return -1;
+	std::lock_guard<std::mutex> lock(mutex_);
+	const int watch = inotify_add_watch(descriptor_, path.c_str(), IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF);
+	if (watch < 0) return -1;
+	watches_[watch].users++;
+	if (!reading_.joinable())
+		reading_ = std::thread([this] { readEvents(); });
+	return watch;
+#else
+	(void)path;
+	return -1;
+#endif
+}
+
+void MemoryMappedFileWatcher::unwatch(int watch)
+{
+#ifdef __linux__
+	if (watch < 0) return;
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto found = watches_.find(watch);
+	if (found == watches_.end()) return;
+	if (--found->second.users == 0) {
+		inotify_rm_watch(descriptor_, watch);
+		watches_.erase(found);
+	}
+#else
+	(void)watch;
+#endif
+}
+
+std::uint64_t MemoryMappedFileWatcher::changes(int watch)
+{
+	if (watch < 0) return 0;
+	std::lock_guard<std::mutex> lock(mutex_);
+	drain();
+	auto found = watches_.find(watch);
+	return (found == watches_.end()) ? 0 : found->second.changes.load(std::memory_order_relaxed);
+}
+
+void MemoryMappedFileWatcher::update()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (!watches_.empty())
+		drain();
+}
+
+const std::atomic<std::uint64_t> &MemoryMappedFileWatcher::counter(int watch)
+{
+	static const std::atomic<std::uint64_t> unwatched = 0;
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto found = watches_.find(watch);
+	return (found == watches_.end()) ? unwatched : found->second.changes;
+}
+
+bool MemoryMappedFileWatcher::wait(int watch, std::uint64_t seen, int timeout)
+{
+#ifdef __linux__
+	if (watch < 0) return false;
+	std::unique_lock<std::mutex> lock(mutex_);
+	drain();
+	auto changedSince = [&] {
+		auto found = watches_.find(watch);
+		return found != watches_.end() && found->second.changes.load(std::memory_order_relaxed) != seen;
+	};
+	if (timeout < 0) {
+		changed_.wait(lock, changedSince);
+		return true;
+	}
+	return changed_.wait_for(lock, std::chrono::milliseconds(timeout), changedSince);
+#else
+	(void)watch;
+	(void)seen;
+	(void)timeout;
+	return false;
+#endif
+}
@@ -0,0 +1,102 @@
+/*!
+* \file memory_mapped_file_watcher.hpp
+* \date 2026/10/18 15:20
+*
+* \author Ján Dugáček
+*
+* \brief Notifications about changes of files made by other processes
+*
+* All files share one inotify instance, because their number is strictly limited. A thread started with the first watch reads its events
+* and increments a counter of every watched file, so checking for changes is only a load of an atomic counter. Because the thread handles the
+* events a moment later, changes() reads the events itself, to be called when the caller needs every change made so far counted.
+* It's available only on Linux, elsewhere no file can be watched.
+*/
+
+#ifndef MEMORY_MAPPED_FILE_WATCHER_H
+#define MEMORY_MAPPED_FILE_WATCHER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+class MemoryMappedFileWatcher {
+	struct Watch {
+		int users = 0;
+		std::atomic<std::uint64_t> changes = 0;
+	};
+
+	int descriptor_;
+	int stopDescriptors_[2]; // Writing into the pipe stops the thread
+	std::mutex mutex_;
+	std::condition_variable changed_;
+	std::unordered_map<int, Watch> watches_; // Elements of unordered maps are never moved, so their counters can be referenced
+	std::thread reading_;
+
+	MemoryMappedFileWatcher();
+	void drain();
+	void readEvents();
+
+public:
+	MemoryMappedFileWatcher(const MemoryMappedFileWatcher &other) = delete;
+	MemoryMappedFileWatcher &operator=(const MemoryMappedFileWatcher &other) = delete;
+	~MemoryMappedFileWatcher();
+
+	/*!
+	* \brief Access to the watcher shared by all files
+	*
+	* \return The instance
+	*/
+	static MemoryMappedFileWatcher &instance();
+
+	/*!
+	* \brief Starts watching a file, watching the same file multiple times is possible
+	*
+	* \param Path to the file
+	* \return Identifier of the watch, negative if the file can't be watched
+	*/
+	int watch(const std::string &path);
+
+	/*!
+	* \brief Stops watching a file
+	*
+	* \param Identifier of the watch
+	*/
+	void unwatch(int watch);
+
+	/*!
+	* \brief Gets the number of changes of the file made so far, reading the events that weren't handled yet
+	*
+	* \param Identifier of the watch
+	* \return The number of changes, can be only compared with earlier values
+	*/
+	std::uint64_t changes(int watch);
+
+	/*!
+	* \brief Reads the events that weren't handled yet, so that changes made by this process are counted before it continues
+	*/
+	void update();
+
+	/*!
+	* \brief Gets the counter of changes of the file, updated by the watcher's thread, to be checked without any system calls
+	*
+	* \param Identifier of the watch
+	* \return The counter, it's valid until the watch is stopped, its values can be compared with those of changes()
+	*/
+	const std::atomic<std::uint64_t> &counter(int watch);
+
+	/*!
+	* \brief Waits until the file changes
+	*
+	* \param Identifier of the watch
+	* \param The number of changes known to the caller
+	* \param Maximal time to wait in milliseconds, negative number means forever
+	* \return Whether the file has changed
+	*/
+	bool wait(int watch, std::uint64_t seen, int timeout);
+};
+
+#endif //MEMORY_MAPPED_FILE_WATCHER_H
@@ -0,0 +1,261 @@
+/*!
+* \file memory_mapped_file_zone_map.hpp
+* \date 2026/10/18 21:10
+*
+* \author Ján Dugáček
+*
+* \brief Minimal and maximal keys of every block of records stored in a MemoryMappedFile, to skip blocks that can't contain searched keys
+*
+* Each block of records has a zone holding the range of its keys and optionally a bloom filter of them. The zones are kept in their own file
+* as an array, so it uses the same archivers as MemoryMappedFile. Blocks that aren't skipped are read without loading the blocks before them
+* if the archiver allows it, uncompressed files are read directly from disk, while compressed archives have to be decoded up to the block.
+*
+* \note The key must be trivially copyable and comparable through operator<
+* \note A zone map tracks a single key, records can be pruned by several fields through several zone maps in separate files
+* \note Records modified in place are not noticed, call rebuild() after modifying them
+*/
+
+#ifndef MEMORY_MAPPED_FILE_ZONE_MAP_H
+#define MEMORY_MAPPED_FILE_ZONE_MAP_H
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <functional>
+#include <vector>
+#include "memory_mapped_file.hpp"
+#include "memory_mapped_file_uncompressed.hpp"
+
+template<typename Key, int bloomBits = 0>
+struct MemoryMappedFileZone {
+	static_assert(bloomBits % 64 == 0, "The bloom filter must have a multiple of 64 bits");
+	static constexpr int BLOOM_HASHES = 3;
+
+	Key min;
+	Key max;
+	std::int32_t count;
+	std::array<std::uint64_t, bloomBits / 64> bloom;
+
+	static std::uint64_t hash(const Key &key)
+	{
+		std::uint8_t bytes[sizeof(Key)];
+		memcpy(bytes, &key, sizeof(Key));
+		std::uint64_t hashed = 0xcbf29ce484222325; // FNV-1a, then mixed so that all bits depend on all bytes
+		for (std::uint8_t byte : bytes)
+			hashed = (hashed ^ byte) * 0x100000001b3;
+		hashed = (hashed ^ (hashed >> 33)) * 0xff51afd7ed558ccd;
+		return hashed ^ (hashed >> 33);
+	}
+
+	static int bloomBit(std::uint64_t hashed, int probe)
+	{
+		return int((std::uint32_t(hashed) + std::uint32_t(probe) * std::uint32_t(hashed >> 32)) % std::uint32_t(bloomBits));
+	}
+
+	void add(const Key &key)
+	{
+		if (count == 0 || key < min)
+			min = key;
+		if (count == 0 || max < key)
+			max = key;
+		count++;
+		if constexpr (bloomBits > 0) {
+			const std::uint64_t hashed = hash(key);
+			for (int i = 0; i < BLOOM_HASHES; i++) {
+				const int bit = bloomBit(hashed, i);
+				bloom[bit >> 6] |= std::uint64_t(1) << (bit & 63);
+			}
+		}
+	}
+
+	bool overlaps(const Key &from, const Key &to) const
+	{
+		return count > 0 && !(max < from) && !(to < min);
+	}
+
+	bool mayContain(const Key &key) const
+	{
+		if (!overlaps(key, key))
+			return false;
+		if constexpr (bloomBits > 0) {
+			const std::uint64_t hashed = hash(key);
+			for (int i = 0; i < BLOOM_HASHES; i++) {
+				const int bit = bloomBit(hashed, i);
+				if (!((bloom[bit >> 6] >> (bit & 63)) & 1))
+					return false;
+			}
+		}
+		return true;
+	}
+};
+
+template<typename T, typename Key, typename archiverType = MemoryMappedFileUncompressed, int blockRecords = 1024, int bloomBits = 0>
+class MemoryMappedFileZoneMap {
+public:
+	using Zone = MemoryMappedFileZone<Key, bloomBits>;
+
+private:
+	MemoryMappedFile<T> &records_;
+	std::function<Key(const T &)> key_;
+	MemoryMappedFile<Zone, archiverType> zones_;
+	int covered_;
+
+	Zone readZone(int at) const
+	{
+		return static_cast<const MemoryMappedFile<Zone> &>(zones_)[at];
+	}
+
+	void add(const Key &key)
+	{
+		if (covered_ % blockRecords == 0)
+			zones_.push_back(Zone{});
+		const int last = zones_.size() - 1;
+		Zone zone = readZone(last);
+		zone.add(key);
+		zones_[last] = zone;
+		covered_++;
+	}
+
+	template<typename Selected, typename Callback>
+	void scan(Selected selected, Callback callback) const
+	{
+		std::vector<T> block;
+		const int zones = zones_.size();
+		for (int i = 0; i < zones; i++) {
+			const Zone zone = readZone(i);
+			if (!selected(zone))
+				continue;
+			block.resize(static_cast<unsigned int>(zone.count));
+			records_.read(i * blockRecords, zone.count, block.data());
+			for (int j = 0; j < zone.count; j++)
+				callback(block[static_cast<unsigned int>(j)], i * blockRecords + j);
+		}
+	}
+
+public:
+	/*!
+	* \brief Constructor, opens the zones and adds zones of records that were added since they were last used
+	*
+	* \param The file with the records
+	* \param Name of the file holding the zones
+	* \param Function obtaining the key from a record
+	*/
+	MemoryMappedFileZoneMap(MemoryMappedFile<T> &records, const std::string &fileName, std::function<Key(const T &)> key) :
+		records_(records), key_(std::move(key)), zones_(fileName), covered_(0)
+	{
+		const int zones = zones_.size();
+		if (zones > 0)
+			covered_ = (zones - 1) * blockRecords + readZone(zones - 1).count;
+		update();
+	}
+
+	/*!
+	* \brief Appends a record to the file and updates the zone of its block
+	*
+	* \param The record
+	* \note Assumes the zones are up to date, call update() if records were appended in other ways
+	*/
+	void push_back(const T &added)
+	{
+		records_.push_back(added);
+		add(key_(added));
+	}
+
+	/*!
+	* \brief Updates zones with the records appended since the last update, rebuilds them if the file has shrunk
+	*/
+	void update()
+	{
+		const int available = records_.size();
+		if (covered_ > available) {
+			rebuild();
+			return;
+		}
+		std::vector<T> block;
+		while (covered_ < available) {
+			const int count = std::min(available - covered_, blockRecords - covered_ % blockRecords);
+			block.resize(static_cast<unsigned int>(count));
+			records_.read(covered_, count, block.data());
+			for (const T &record : block)
+				add(key_(record));
+		}
+	}
+
+	/*!
+	* \brief Discards all zones and computes them again from the records
+	*/
+	void rebuild()
+	{
+		zones_.clear();
+		covered_ = 0;
+		update();
+	}
+
+	/*!
+	* \brief Calls a function on all records whose key is in the given range, skipping blocks that can't contain any
+	*
+	* \param The lowest key, inclusive
+	* \param The highest key, inclusive
+	* \param The function, receiving the record and its index
+	*/
+	void forEach(const Key &from, const Key &to, const std::function<void(const T &, int)> &function) const
+	{
+		scan([&] (const Zone &zone) { return zone.overlaps(from, to); }, [&] (const T &record, int index) {
+			const Key key = key_(record);
+			if (!(key < from) && !(to < key))
+				function(record, index);
+		});
+	}
+
+	/*!
+	* \brief Finds all records with the given key, skipping blocks that can't contain it
+	*
+	* \param The key
+	* \return Indexes of the records, in ascending order
+	* \note The bloom filter allows skipping blocks whose range of keys contains the key
+	*/
+	std::vector<int> find(const Key &key) const
+	{
+		std::vector<int> found;
+		scan([&] (const Zone &zone) { return zone.mayContain(key); }, [&] (const T &record, int index) {
+			const Key recordKey = key_(record);
+			if (!(recordKey < key) && !(key < recordKey))
+				found.push_back(index);
+		});
+		return found;
+	}
+
+	/*!
+	* \brief Gets the zone of a block
+	*
+	* \param Index of the block
+	* \return The zone
+	*/
+	Zone zone(int block) const
+	{
+		if (block < 0 || block >= zones_.size())
+			throw(std::logic_error("Reading behind the end of a zone map"));
+		return readZone(block);
+	}
+
+	/*!
+	* \brief Gets the number of blocks
+	*
+	* \return The number of zones
+	*/
+	int blocks() const
+	{
+		return zones_.size();
+	}
+
+	/*!
+	* \brief Adds zones of records appended in other ways and saves the zones if they were modified
+	*/
+	void flush()
+	{
+		update();
+		zones_.flush();
+	}
+};
+
+#endif //MEMORY_MAPPED_FILE_ZONE_MAP_H
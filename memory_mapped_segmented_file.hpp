@@ -0,0 +1,321 @@
+/*!
+* \file memory_mapped_segmented_file.hpp
+* \date 2026/10/18 13:05
+*
+* \author Ján Dugáček
+*
+* \brief Class for accessing an array of structs split into a sequence of files of limited size
+*
+* The records are appended to the newest file (segment) until it reaches a given number of records or a given age, then it's sealed and a new one
+* is started. Records keep their indexes when the oldest segments are removed, so the valid indexes start at firstIndex(). Sealed segments can
+* be converted to another archiver type in the background, typically to compress them. A small additional file lists the segments.
+*
+* \note RAII guarantees flushing the changes into files
+*/
+
+#ifndef MEMORY_MAPPED_SEGMENTED_FILE_H
+#define MEMORY_MAPPED_SEGMENTED_FILE_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <map>
+#include <stdexcept>
+#include <type_traits>
+#include "memory_mapped_file.hpp"
+#include "memory_mapped_file_uncompressed.hpp"
+
+template<typename T, typename activeType = MemoryMappedFileUncompressed, typename sealedType = activeType>
+class MemoryMappedSegmentedFile {
+public:
+	enum class SegmentState : std::int32_t {
+		ACTIVE,
+		SEALED,
+		CONVERTED
+	};
+
+	struct Segment {
+		std::int32_t number;
+		std::int32_t firstIndex;
+		std::int32_t records;
+		SegmentState state;
+		std::int64_t created;
+		std::int64_t sealed;
+	};
+
+private:
+	static constexpr bool CONVERTING = !std::is_same<activeType, sealedType>::value;
+
+	std::string fileName_;
+	int segmentRecords_;
+	std::chrono::seconds segmentAge_;
+	std::chrono::seconds retention_;
+	MemoryMappedFile<Segment, MemoryMappedFileUncompressed> manifest_;
+	mutable std::vector<Segment> segments_;
+	mutable std::map<int, std::future<void>> sealing_;
+	std::unique_ptr<MemoryMappedFile<T>> active_;
+	int activeRecords_;
+	mutable std::unique_ptr<MemoryMappedFile<T>> reading_;
+	mutable int readingNumber_;
+
+	static std::int64_t now()
+	{
+		return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	}
+
+	template<typename archiverType>
+	static void removeFile(const std::string &fileName)
+	{
+		archiverType file(fileName);
+		std::remove(file.extendedFileName(fileName).c_str());
+	}
+
+	std::string segmentName(int number) const
+	{
+		std::string numberString = std::to_string(number);
+		return fileName_ + "_" + std::string(numberString.size() < 8 ? 8 - numberString.size() : 0, '0') + numberString;
+	}
+
+	void persist()
+	{
+		manifest_.swap(segments_.data(), int(segments_.size()));
+	}
+
+	void startSealing(int number)
+	{
+		sealing_[number] = std::async(std::launch::async, [fileName = segmentName(number)] {
+			{
+				activeType source(fileName);
+				std::pmr::vector<std::uint8_t> contents(source.data(), source.memoryResource());
+				sealedType target(fileName);
+				target.swapContents(contents);
+				target.flush();
+			}
+			removeFile<activeType>(fileName);
+		});
+	}
+
+	bool waitForSealing(int number) const
+	{
+		auto found = sealing_.find(number);
+		if (found == sealing_.end()) return false;
+		found->second.get();
+		sealing_.erase(found);
+		for (Segment &segment : segments_)
+			if (segment.number == number)
+				segment.state = SegmentState::CONVERTED;
+		return true;
+	}
+
+	bool collectSealed(bool wait)
+	{
+		std::vector<int> finished;
+		for (auto &it : sealing_)
+			if (wait || it.second.wait_for(std::chrono::seconds::zero()) == std::future_status::ready)
+				finished.push_back(it.first);
+		for (int number : finished)
+			waitForSealing(number);
+		return !finished.empty();
+	}
+
+	const MemoryMappedFile<T> &segmentFile(const Segment &segment) const
+	{
+		if (segment.state == SegmentState::ACTIVE)
+			return *active_;
+		if (!reading_ || readingNumber_ != segment.number) {
+			reading_.reset();
+			waitForSealing(segment.number);
+			if (segment.state == SegmentState::CONVERTED)
+				reading_ = std::make_unique<MemoryMappedFile<T, sealedType>>(segmentName(segment.number));
+			else
+				reading_ = std::make_unique<MemoryMappedFile<T, activeType>>(segmentName(segment.number));
+			readingNumber_ = segment.number;
+		}
+		return *reading_;
+	}
+
+	void roll()
+	{
+		active_->flush();
+		Segment &last = segments_.back();
+		last.records = activeRecords_;
+		last.state = SegmentState::SEALED;
+		last.sealed = now();
+		const int sealedNumber = last.number;
+		segments_.push_back({ last.number + 1, last.firstIndex + activeRecords_, 0, SegmentState::ACTIVE, now(), 0 });
+
+		active_ = std::make_unique<MemoryMappedFile<T, activeType>>(segmentName(segments_.back().number));
+		active_->clear();
+		activeRecords_ = 0;
+		if (CONVERTING)
+			startSealing(sealedNumber);
+		persist();
+		expire();
+	}
+
+public:
+	/*!
+	* \brief Constructor, opens the segments if they exist
+	*
+	* \param Name of the file, the names of the segments are derived from it
+	* \param Maximal number of records in a segment
+	* \param Maximal age of a segment before a new one is started, zero means no limit
+	* \param How long are sealed segments kept, zero means forever
+	*/
+	MemoryMappedSegmentedFile(const std::string &fileName, int segmentRecords, std::chrono::seconds segmentAge = std::chrono::seconds::zero(),
+			std::chrono::seconds retention = std::chrono::seconds::zero()) :
+		fileName_(fileName), segmentRecords_(segmentRecords), segmentAge_(segmentAge), retention_(retention),
+		manifest_(fileName + manifestSuffix()), activeRecords_(0), readingNumber_(-1)
+	{
+		if (segmentRecords_ <= 0)
+			throw(std::logic_error("Segments must be able to hold at least one record"));
+		const MemoryMappedFile<Segment> &manifest = manifest_;
+		for (int i = 0; i < manifest.size(); i++)
+			segments_.push_back(manifest[i]);
+		if (segments_.empty()) {
+			segments_.push_back({ 0, 0, 0, SegmentState::ACTIVE, now(), 0 });
+			persist();
+		}
+		if (CONVERTING) {
+			for (const Segment &segment : segments_)
+				if (segment.state == SegmentState::SEALED)
+					startSealing(segment.number);
+		}
+		active_ = std::make_unique<MemoryMappedFile<T, activeType>>(segmentName(segments_.back().number));
+		activeRecords_ = active_->size();
+	}
+
+	/*!
+	* \brief Destructor, waits until the sealed segments are converted and saves the list of segments
+	*/
+	~MemoryMappedSegmentedFile()
+	{
+		try {
+			collectSealed(true);
+			persist();
+		}
+		catch(std::exception &exception) {
+			std::cout << "Failed to seal: " << exception.what();
+		}
+	}
+
+	/*!
+	* \brief Record access, modification not possible
+	*
+	* \param Index of the record, must be at least firstIndex()
+	* \return Const reference to the record, valid until another segment is accessed
+	*/
+	const T &operator[](int at) const
+	{
+		if (at < firstIndex() || at >= size())
+			throw(std::logic_error("Reading outside of the retained records"));
+		auto found = std::upper_bound(segments_.begin(), segments_.end(), at, [] (int index, const Segment &segment) {
+			return index < segment.firstIndex;
+		}) - 1;
+		return segmentFile(*found)[at - found->firstIndex];
+	}
+
+	/*!
+	* \brief Appends a record into the newest segment, starting a new one if it's full or too old
+	*
+	* \param The record
+	*/
+	void push_back(const T &added)
+	{
+		if (activeRecords_ >= segmentRecords_ || (segmentAge_.count() > 0 && activeRecords_ > 0
+				&& now() - segments_.back().created >= segmentAge_.count()))
+			roll();
+		active_->push_back(added);
+		activeRecords_++;
+	}
+
+	/*!
+	* \brief Removes the sealed segments that were sealed before the retention period
+	*/
+	void expire()
+	{
+		if (retention_.count() > 0)
+			expire(std::chrono::system_clock::now() - retention_);
+	}
+
+	/*!
+	* \brief Removes the sealed segments that were sealed before a given time
+	*
+	* \param The time
+	*/
+	void expire(std::chrono::system_clock::time_point before)
+	{
+		const std::int64_t limit = std::chrono::duration_cast<std::chrono::seconds>(before.time_since_epoch()).count();
+		auto removedUntil = segments_.begin();
+		while (removedUntil->state != SegmentState::ACTIVE && removedUntil->sealed < limit) {
+			waitForSealing(removedUntil->number);
+			if (readingNumber_ == removedUntil->number) {
+				reading_.reset();
+				readingNumber_ = -1;
+			}
+			removeFile<activeType>(segmentName(removedUntil->number));
+			if (CONVERTING)
+				removeFile<sealedType>(segmentName(removedUntil->number));
+			removedUntil++;
+		}
+		if (removedUntil != segments_.begin()) {
+			segments_.erase(segments_.begin(), removedUntil);
+			persist();
+		}
+	}
+
+	/*!
+	* \brief Saves the newest segment and the list of segments
+	*/
+	void flush()
+	{
+		active_->flush();
+		collectSealed(false);
+		persist();
+		manifest_.flush();
+	}
+
+	/*!
+	* \brief Gets the index of the oldest record that wasn't removed
+	*
+	* \return The index
+	*/
+	int firstIndex() const
+	{
+		return segments_.front().firstIndex;
+	}
+
+	/*!
+	* \brief Gets the index behind the newest record
+	*
+	* \return The number of records ever appended
+	*/
+	int size() const
+	{
+		return segments_.back().firstIndex + activeRecords_;
+	}
+
+	/*!
+	* \brief Gets the list of segments
+	*
+	* \return The segments, from the oldest one
+	*/
+	const std::vector<Segment> &segments() const
+	{
+		return segments_;
+	}
+
+	/*!
+	* \brief Returns the suffix appended to the file name to get the name of the file listing the segments
+	*
+	* \return The suffix
+	*/
+	static const std::string &manifestSuffix()
+	{
+		static std::string retval = "_segments";
+		return retval;
+	}
+};
+
+#endif //MEMORY_MAPPED_SEGMENTED_FILE_H